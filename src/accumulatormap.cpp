@@ -8,6 +8,10 @@
 #include "txdb.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 using namespace libzerocoin;
 using namespace std;
 
@@ -73,6 +77,47 @@ bool AccumulatorMap::Accumulate(const PublicCoin& pubCoin, bool fSkipValidation)
     return true;
 }
 
+//Add a list of zerocoins to the accumulators. Each denomination is independent, so each is accumulated on its own thread.
+bool AccumulatorMap::Accumulate(const std::list<PublicCoin>& listPubcoins, bool fSkipValidation)
+{
+    map<CoinDenomination, vector<const PublicCoin*> > mapPubcoins;
+    for (const PublicCoin& pubCoin : listPubcoins) {
+        CoinDenomination denom = pubCoin.getDenomination();
+        if (denom == CoinDenomination::ZQ_ERROR)
+            return false;
+        mapPubcoins[denom].push_back(&pubCoin);
+    }
+
+    std::atomic<bool> fFailed(false);
+    auto accumulateDenom = [&fFailed, fSkipValidation](Accumulator* accumulator, const vector<const PublicCoin*>& vPubcoins) {
+        try {
+            for (const PublicCoin* pubCoin : vPubcoins) {
+                if (fSkipValidation)
+                    accumulator->increment(pubCoin->getValue());
+                else
+                    accumulator->accumulate(*pubCoin);
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("AccumulatorMap::Accumulate : %s\n", e.what());
+            fFailed = true;
+        }
+    };
+
+    //The first denomination is accumulated on the calling thread
+    boost::thread_group threadGroup;
+    for (auto it = mapPubcoins.begin(); it != mapPubcoins.end(); ++it) {
+        Accumulator* accumulator = mapAccumulators.at(it->first).get();
+        const vector<const PublicCoin*>& vPubcoins = it->second;
+        if (it != mapPubcoins.begin())
+            threadGroup.create_thread([&accumulateDenom, accumulator, &vPubcoins]() { accumulateDenom(accumulator, vPubcoins); });
+    }
+    if (!mapPubcoins.empty())
+        accumulateDenom(mapAccumulators.at(mapPubcoins.begin()->first).get(), mapPubcoins.begin()->second);
+    threadGroup.join_all();
+
+    return !fFailed;
+}
+
 //Get the value of a specific accumulator
 CBigNum AccumulatorMap::GetValue(CoinDenomination denom)
 {
@@ -8,6 +8,8 @@
 #include "libzerocoin/Coin.h"
 #include "accumulatorcheckpoints.h"
 
+#include <list>
+
 //A map with an accumulator for each denomination
 class AccumulatorMap
 {
@@ -19,6 +21,7 @@ public:
     bool Load(uint256 nCheckpoint);
     void Load(const AccumulatorCheckpoints::Checkpoint& checkpoint);
     bool Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSkipValidation = false);
+    bool Accumulate(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation = false);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
     void Reset();
@@ -12,6 +12,8 @@
 #include "accumulatorcheckpoints.h"
 #include "zbeetchain.h"
 
+#include <boost/thread.hpp>
+
 using namespace libzerocoin;
 
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
@@ -145,6 +147,18 @@ bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint)
     return true;
 }
 
+void LoadIndexAccumulatorValues(const CBlockIndex* pindex, uint256& nPreviousCheckpoint)
+{
+    //populate accumulator checksum map in memory
+    if (pindex->nAccumulatorCheckpoint != 0 && pindex->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+        //Don't load any checkpoints that exist before v2 zbeet. The accumulator is invalid for v1 and not used.
+        if (pindex->nHeight >= Params().Zerocoin_Block_V2_Start())
+            LoadAccumulatorValuesFromDB(pindex->nAccumulatorCheckpoint);
+
+        nPreviousCheckpoint = pindex->nAccumulatorCheckpoint;
+    }
+}
+
 //Erase accumulator checkpoints for a certain block range
 bool EraseCheckpoints(int nStartHeight, int nEndHeight)
 {
@@ -252,7 +266,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
     bool fFilterInvalid = nHeight >= Params().Zerocoin_Block_RecalculateAccumulators();
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
-    int nTotalMintsFound = 0;
+    std::list<PublicCoin> listPubcoinsCheckpoint;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
 
     while (pindex->nHeight < nHeight - 10) {
@@ -275,19 +289,17 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
             return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
 
-        nTotalMintsFound += listPubcoins.size();
         LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
-
-        //add the pubcoins to accumulator
-        for (const PublicCoin pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true))
-                return error("%s: failed to add pubcoin to accumulator at height %d", __func__, pindex->nHeight);
-        }
+        listPubcoinsCheckpoint.splice(listPubcoinsCheckpoint.end(), listPubcoins);
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins to accumulator, one denomination per thread
+    if (!mapAccumulators.Accumulate(listPubcoinsCheckpoint, true))
+        return error("%s: failed to add pubcoins to accumulator for checkpoint at height %d", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
-    if (nTotalMintsFound == 0)
+    if (listPubcoinsCheckpoint.empty())
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
     else
         nCheckpoint = mapAccumulators.GetCheckpoint();
@@ -296,6 +308,39 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
     return true;
 }
 
+// Accumulate the mints of a run of consecutive checkpoints on top of checkpointStart. The eight denomination
+// accumulators are independent, so each one is carried through the whole run on its own thread.
+bool AccumulateCheckpointRun(ZerocoinParams* params, const AccumulatorCheckpoints::Checkpoint& checkpointStart,
+                             const std::vector<std::list<PublicCoin> >& vPubcoins,
+                             std::vector<AccumulatorCheckpoints::Checkpoint>& vCheckpoints)
+{
+    for (const std::list<PublicCoin>& listPubcoins : vPubcoins) {
+        for (const PublicCoin& pubcoin : listPubcoins) {
+            if (pubcoin.getDenomination() == CoinDenomination::ZQ_ERROR)
+                return error("%s: invalid pubcoin denomination", __func__);
+        }
+    }
+
+    // every checkpoint already holds an entry for each denomination, so the threads only write distinct values
+    vCheckpoints.assign(vPubcoins.size(), checkpointStart);
+    boost::thread_group threadGroup;
+    for (auto denom : zerocoinDenomList) {
+        threadGroup.create_thread([&, denom]() {
+            Accumulator accumulator(params, denom);
+            accumulator.setValue(checkpointStart.at(denom));
+            for (size_t i = 0; i < vPubcoins.size(); i++) {
+                for (const PublicCoin& pubcoin : vPubcoins[i]) {
+                    if (pubcoin.getDenomination() == denom)
+                        accumulator.increment(pubcoin.getValue());
+                }
+                vCheckpoints[i].at(denom) = accumulator.getValue();
+            }
+        });
+    }
+    threadGroup.join_all();
+    return true;
+}
+
 bool InvalidCheckpointRange(int nHeight)
 {
     return nHeight > Params().Zerocoin_Block_LastGoodCheckpoint() && nHeight < Params().Zerocoin_Block_RecalculateAccumulators();
@@ -356,12 +401,12 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     return n;
 }
 
-int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nHeightMintAdded, const CBlockIndex* pindex,
-                           libzerocoin::Accumulator* accumulator, bool isWitness)
+int AddBlockMintsToAccumulator(const libzerocoin::CoinDenomination denom, const CBigNum& bnPubcoin, const int nHeightMintAdded,
+                               const CBlockIndex* pindex, libzerocoin::Accumulator* accumulator, bool isWitness)
 {
     // if this block contains mints of the denomination that is being spent, then add them to the witness
     int nMintsAdded = 0;
-    if (pindex->MintedDenomination(coin.getDenomination())) {
+    if (pindex->MintedDenomination(denom)) {
         //grab mints from this block
         CBlock block;
         if(!ReadBlockFromDisk(block, pindex))
@@ -373,10 +418,10 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
 
         //add the mints to the witness
         for (const PublicCoin& pubcoin : listPubcoins) {
-            if (pubcoin.getDenomination() != coin.getDenomination())
+            if (pubcoin.getDenomination() != denom)
                 continue;
 
-            if (isWitness && pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
+            if (isWitness && pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == bnPubcoin)
                 continue;
 
             accumulator->increment(pubcoin.getValue());
@@ -387,6 +432,12 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
     return nMintsAdded;
 }
 
+int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nHeightMintAdded, const CBlockIndex* pindex,
+                           libzerocoin::Accumulator* accumulator, bool isWitness)
+{
+    return AddBlockMintsToAccumulator(coin.getDenomination(), coin.getValue(), nHeightMintAdded, pindex, accumulator, isWitness);
+}
+
 bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom, CBigNum& bnAccValue)
 {
     if (nHeight > chainActive.Height())
@@ -413,22 +464,9 @@ bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom
     return true;
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CBlockIndex* pindexCheckpoint)
+//Find where the mint was added and set the accumulator to the checkpoint right before the cluster of blocks containing it
+bool InitWitnessAccumulation(const PublicCoin& coin, Accumulator& accumulator, int& nHeightMintAdded, int& nHeightCheckpoint)
 {
-    LogPrint("zero", "%s: generating\n", __func__);
-    int nLockAttempts = 0;
-    while (nLockAttempts < 100) {
-        TRY_LOCK(cs_main, lockMain);
-        if(!lockMain) {
-            MilliSleep(50);
-            nLockAttempts++;
-            continue;
-        }
-        break;
-    }
-    if (nLockAttempts == 100)
-        return error("%s: could not get lock on cs_main", __func__);
-    LogPrint("zero", "%s: after lock\n", __func__);
     uint256 txid;
     if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid))
         return error("%s failed to read mint from db", __func__);
@@ -442,26 +480,68 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     if (!IsTransactionInChain(txid, nHeightTest))
         return error("%s: mint tx %s is not in chain", __func__, txid.GetHex());
 
-    int nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
+    nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
 
     //get the checkpoint added at the next multiple of 10
-    int nHeightCheckpoint = nHeightMintAdded + (10 - (nHeightMintAdded % 10));
-
-    //the height to start accumulating coins to add to witness
-    int nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
+    nHeightCheckpoint = nHeightMintAdded + (10 - (nHeightMintAdded % 10));
 
     //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
     CBigNum bnAccValue = 0;
-    if (GetAccumulatorValue(nHeightCheckpoint, coin.getDenomination(), bnAccValue)) {
-            accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, coin);
+    if (GetAccumulatorValue(nHeightCheckpoint, coin.getDenomination(), bnAccValue))
+        accumulator.setValue(bnAccValue);
+
+    return true;
+}
+
+//Whether the witness state was built on blocks that are still in the active chain
+bool IsMintWitnessStateOnChain(const CMintWitnessState& state)
+{
+    if (state.IsNull() || state.nHeightNext > chainActive.Height() + 1)
+        return false;
+
+    CBlockIndex* pindexLast = chainActive[state.nHeightNext - 1];
+    return pindexLast && pindexLast->GetBlockHash() == state.hashBlockLast;
+}
+
+//Whether any block in [nHeightStart, nHeightEnd) of the active chain contains a mint of the denomination
+bool HasMintsInRange(const CoinDenomination denom, int nHeightStart, int nHeightEnd)
+{
+    for (int nHeight = nHeightStart; nHeight < nHeightEnd; nHeight++) {
+        if (chainActive[nHeight]->MintedDenomination(denom))
+            return true;
     }
+    return false;
+}
+
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CBlockIndex* pindexCheckpoint, CMintWitnessState* pWitnessState)
+{
+    LogPrint("zero", "%s: generating\n", __func__);
+    int nLockAttempts = 0;
+    while (nLockAttempts < 100) {
+        TRY_LOCK(cs_main, lockMain);
+        if(!lockMain) {
+            MilliSleep(50);
+            nLockAttempts++;
+            continue;
+        }
+        break;
+    }
+    if (nLockAttempts == 100)
+        return error("%s: could not get lock on cs_main", __func__);
+    LogPrint("zero", "%s: after lock\n", __func__);
+
+    int nHeightMintAdded = 0;
+    int nHeightCheckpoint = 0;
+    if (!InitWitnessAccumulation(coin, accumulator, nHeightMintAdded, nHeightCheckpoint))
+        return false;
+    witness.resetValue(accumulator, coin);
+
+    //the height to start accumulating coins to add to witness
+    int nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
 
     //add the pubcoins from the blockchain up to the next checksum starting from the block
     CBlockIndex* pindex = chainActive[nHeightCheckpoint - 10];
-    int nChainHeight = chainActive.Height();
-    int nHeightStop = nChainHeight % 10;
-    nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
+    int nHeightStop = GetMintWitnessStopHeight();
 
     //If looking for a specific checkpoint
     if (pindexCheckpoint)
@@ -470,9 +550,20 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     //Iterate through the chain and calculate the witness
     int nCheckpointsAdded = 0;
     nMintsAdded = 0;
+    int nSecurityLevelIn = nSecurityLevel;
     RandomizeSecurityLevel(nSecurityLevel); //make security level not always the same and predictable
     libzerocoin::Accumulator witnessAccumulator = accumulator;
 
+    //Resume from the cached witness state, blocks below nHeightResume are already in the witness
+    int nHeightResume = 0;
+    bool fStateOnChain = pWitnessState && IsMintWitnessStateOnChain(*pWitnessState);
+    if (fStateOnChain && pWitnessState->bnPubcoin == coin.getValue() && pWitnessState->nHeightNext > pindex->nHeight) {
+        witnessAccumulator.setValue(pWitnessState->bnWitness);
+        nMintsAdded = pWitnessState->nMintsAdded;
+        nHeightResume = pWitnessState->nHeightNext;
+        LogPrint("zero", "%s: resuming witness from height %d\n", __func__, nHeightResume);
+    }
+
     // bool fDoubleCounted = false;
     while (pindex) {
         if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
@@ -485,7 +576,11 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
             if(InvalidCheckpointRange(pindex->nHeight))
                 continue;
 
-            bnAccValue = 0;
+            //The cached state went past this point; only usable if it did not accumulate anything beyond it
+            if (pindex->nHeight < nHeightResume && HasMintsInRange(coin.getDenomination(), pindex->nHeight, nHeightResume))
+                return GenerateAccumulatorWitness(coin, accumulator, witness, nSecurityLevelIn, nMintsAdded, strError, pindexCheckpoint);
+
+            CBigNum bnAccValue = 0;
             uint256 nCheckpointSpend = chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint;
             if (!GetAccumulatorValueFromDB(nCheckpointSpend, coin.getDenomination(), bnAccValue) || bnAccValue == 0)
                 return error("%s : failed to find checksum in database for accumulator", __func__);
@@ -494,7 +589,8 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
             break;
         }
 
-        nMintsAdded += AddBlockMintsToAccumulator(coin, nHeightMintAdded, pindex, &witnessAccumulator, true);
+        if (pindex->nHeight >= nHeightResume)
+            nMintsAdded += AddBlockMintsToAccumulator(coin, nHeightMintAdded, pindex, &witnessAccumulator, true);
 
         // 10 blocks were accumulated twice when zPIV v2 was activated
         // if (pindex->nHeight == 1050010 && !fDoubleCounted) {
@@ -510,6 +606,17 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     if (!witness.VerifyWitness(accumulator, coin))
         return error("%s: failed to verify witness", __func__);
 
+    //Remember how far the witness got, unless the cached state already got further on this chain
+    if (pWitnessState && pindex && (!fStateOnChain || pindex->nHeight > pWitnessState->nHeightNext)) {
+        pWitnessState->bnPubcoin = coin.getValue();
+        pWitnessState->denom = coin.getDenomination();
+        pWitnessState->nHeightMint = nHeightMintAdded;
+        pWitnessState->nHeightNext = pindex->nHeight;
+        pWitnessState->hashBlockLast = pindex->pprev->GetBlockHash();
+        pWitnessState->bnWitness = witnessAccumulator.getValue();
+        pWitnessState->nMintsAdded = nMintsAdded;
+    }
+
     // A certain amount of accumulated coins are required
     if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
         strError = _(strprintf("Less than %d mints added, unable to create spend", Params().Zerocoin_RequiredAccumulation()).c_str());
@@ -523,6 +630,60 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     return true;
 }
 
+int GetMintWitnessStopHeight()
+{
+    int nChainHeight = chainActive.Height();
+    return nChainHeight - (nChainHeight % 10) - 20; // at least two checkpoints deep
+}
+
+bool InitMintWitnessState(const PublicCoin& coin, CMintWitnessState& state)
+{
+    Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()), coin.getDenomination());
+    int nHeightMintAdded = 0;
+    int nHeightCheckpoint = 0;
+    if (!InitWitnessAccumulation(coin, accumulator, nHeightMintAdded, nHeightCheckpoint))
+        return false;
+
+    CBlockIndex* pindexStart = chainActive[nHeightCheckpoint - 10];
+    if (!pindexStart || !pindexStart->pprev)
+        return error("%s: no block to start the witness from at height %d", __func__, nHeightCheckpoint - 10);
+
+    state.bnPubcoin = coin.getValue();
+    state.denom = coin.getDenomination();
+    state.nHeightMint = nHeightMintAdded;
+    state.nHeightNext = pindexStart->nHeight;
+    state.hashBlockLast = pindexStart->pprev->GetBlockHash();
+    state.bnWitness = accumulator.getValue();
+    state.nMintsAdded = 0;
+    return true;
+}
+
+bool AdvanceMintWitnessState(CMintWitnessState& state, int nHeightStop)
+{
+    if (!IsMintWitnessStateOnChain(state))
+        return false;
+
+    Accumulator witnessAccumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()), state.denom, state.bnWitness);
+    CBlockIndex* pindex = chainActive[state.nHeightNext];
+    int nMintsAdded = 0;
+    while (pindex && pindex->nHeight < nHeightStop) {
+        nMintsAdded += AddBlockMintsToAccumulator(state.denom, state.bnPubcoin, state.nHeightMint, pindex, &witnessAccumulator, true);
+        state.nHeightNext = pindex->nHeight + 1;
+        state.hashBlockLast = pindex->GetBlockHash();
+        pindex = chainActive.Next(pindex);
+    }
+
+    state.bnWitness = witnessAccumulator.getValue();
+    state.nMintsAdded += nMintsAdded;
+    return true;
+}
+
+//! Whether the tip reached a new accumulator checkpoint since it was at nHeightLast, or went back below it
+bool IsMintWitnessUpdateDue(int nHeightLast, int nHeight)
+{
+    return nHeight < nHeightLast || nHeight - (nHeight % 10) > nHeightLast - (nHeightLast % 10);
+}
+
 map<CoinDenomination, int> GetMintMaturityHeight()
 {
     map<CoinDenomination, pair<int, int > > mapDenomMaturity;
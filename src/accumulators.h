@@ -9,20 +9,78 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/Denominations.h"
 #include "primitives/zerocoin.h"
+#include "accumulatorcheckpoints.h"
 #include "accumulatormap.h"
 #include "chain.h"
 #include "uint256.h"
 
 class CBlockIndex;
 
+/**
+ * Progress of the witness computation for a single mint, so that later spends and stakes
+ * of the mint only accumulate the blocks that were added since it was last updated.
+ */
+class CMintWitnessState
+{
+public:
+    CBigNum bnPubcoin;
+    libzerocoin::CoinDenomination denom;
+    int nHeightMint;        //! height of the block the mint was added in
+    int nHeightNext;        //! first height that is not yet accumulated into bnWitness
+    uint256 hashBlockLast;  //! hash of the block at nHeightNext - 1, used to detect reorgs
+    CBigNum bnWitness;      //! witness accumulator value over the blocks below nHeightNext
+    int nMintsAdded;        //! pubcoins of this denomination accumulated into bnWitness
+
+    CMintWitnessState() { SetNull(); }
+
+    void SetNull()
+    {
+        bnPubcoin = 0;
+        denom = libzerocoin::ZQ_ERROR;
+        nHeightMint = 0;
+        nHeightNext = 0;
+        hashBlockLast = 0;
+        bnWitness = 0;
+        nMintsAdded = 0;
+    }
+
+    bool IsNull() const { return nHeightNext == 0; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(bnPubcoin);
+        READWRITE(denom);
+        READWRITE(nHeightMint);
+        READWRITE(nHeightNext);
+        READWRITE(hashBlockLast);
+        READWRITE(bnWitness);
+        READWRITE(nMintsAdded);
+    }
+};
+
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr);
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr, CMintWitnessState* pWitnessState = nullptr);
+bool InitMintWitnessState(const libzerocoin::PublicCoin& coin, CMintWitnessState& state);
+bool AdvanceMintWitnessState(CMintWitnessState& state, int nHeightStop);
+bool IsMintWitnessUpdateDue(int nHeightLast, int nHeight);
+int GetMintWitnessStopHeight();
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, AccumulatorMap& mapAccumulators);
 void DatabaseChecksums(AccumulatorMap& mapAccumulators);
+/** Accumulate vPubcoins[i] for each checkpoint i of a run on top of checkpointStart, giving each checkpoint's
+ *  accumulator values in vCheckpoints[i]. Every denomination is carried through the run on its own thread. */
+bool AccumulateCheckpointRun(libzerocoin::ZerocoinParams* params, const AccumulatorCheckpoints::Checkpoint& checkpointStart,
+                             const std::vector<std::list<libzerocoin::PublicCoin> >& vPubcoins,
+                             std::vector<AccumulatorCheckpoints::Checkpoint>& vCheckpoints);
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint);
+/** Load the accumulator values of pindex's checkpoint while the block index is read in, unless the
+ *  entry read before had the same checkpoint (nPreviousCheckpoint, updated here) */
+void LoadIndexAccumulatorValues(const CBlockIndex* pindex, uint256& nPreviousCheckpoint);
 bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nCheckpointPrevious);
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination);
 uint32_t GetChecksum(const CBigNum &bnValue);
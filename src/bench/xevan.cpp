@@ -0,0 +1,82 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sph_4way.h"
+#include "hash.h"
+#include "xevanbatch.h"
+
+#include <vector>
+
+// Header sized messages, enough to fill several groups of XEVANBatch lanes
+static const size_t BENCH_XEVAN_MESSAGES = 64;
+static const size_t BENCH_XEVAN_MESSAGE_SIZE = 80;
+
+static std::vector<std::vector<unsigned char> > XevanMessages()
+{
+    std::vector<std::vector<unsigned char> > vMessages(BENCH_XEVAN_MESSAGES, std::vector<unsigned char>(BENCH_XEVAN_MESSAGE_SIZE));
+    for (size_t i = 0; i < vMessages.size(); i++)
+        for (size_t j = 0; j < vMessages[i].size(); j++)
+            vMessages[i][j] = (unsigned char)(i * 31 + j);
+    return vMessages;
+}
+
+static void XevanScalar(benchmark::State& state)
+{
+    std::vector<std::vector<unsigned char> > vMessages = XevanMessages();
+    while (state.KeepRunning()) {
+        for (const std::vector<unsigned char>& vch : vMessages)
+            XEVAN(vch.begin(), vch.end());
+    }
+}
+
+static void RunXevanBatch(benchmark::State& state, bool fAvx2)
+{
+    std::vector<std::vector<unsigned char> > vMessages = XevanMessages();
+    std::vector<XevanInput> vInputs;
+    for (const std::vector<unsigned char>& vch : vMessages)
+        vInputs.push_back(XevanInput(vch.data(), vch.data() + vch.size()));
+    std::vector<uint256> vHashes;
+
+    sph_avx2_set_enabled(fAvx2);
+    while (state.KeepRunning())
+        XEVANBatch(vInputs, vHashes);
+    sph_avx2_set_enabled(1);
+}
+
+static void XevanBatch(benchmark::State& state) { RunXevanBatch(state, true); }
+static void XevanBatchNoAvx2(benchmark::State& state) { RunXevanBatch(state, false); }
+
+// One call of a four lane function on XEVAN's 128 byte stage input
+static void Run4Way(benchmark::State& state, void (*Hash4Way)(const void* const[SPH_4WAY_LANES], size_t, void* const[SPH_4WAY_LANES]), bool fAvx2)
+{
+    unsigned char vchIn[SPH_4WAY_LANES][128] = {};
+    unsigned char vchOut[SPH_4WAY_LANES][64];
+    const void* data[SPH_4WAY_LANES];
+    void* dst[SPH_4WAY_LANES];
+    for (int j = 0; j < SPH_4WAY_LANES; j++) {
+        vchIn[j][0] = (unsigned char)j;
+        data[j] = vchIn[j];
+        dst[j] = vchOut[j];
+    }
+
+    sph_avx2_set_enabled(fAvx2);
+    while (state.KeepRunning())
+        Hash4Way(data, sizeof(vchIn[0]), dst);
+    sph_avx2_set_enabled(1);
+}
+
+static void Sha512_4Way(benchmark::State& state) { Run4Way(state, sph_sha512_4way, true); }
+static void Sha512_4WayNoAvx2(benchmark::State& state) { Run4Way(state, sph_sha512_4way, false); }
+static void Keccak512_4Way(benchmark::State& state) { Run4Way(state, sph_keccak512_4way, true); }
+static void Keccak512_4WayNoAvx2(benchmark::State& state) { Run4Way(state, sph_keccak512_4way, false); }
+
+BENCHMARK(XevanScalar);
+BENCHMARK(XevanBatch);
+BENCHMARK(XevanBatchNoAvx2);
+BENCHMARK(Sha512_4Way);
+BENCHMARK(Sha512_4WayNoAvx2);
+BENCHMARK(Keccak512_4Way);
+BENCHMARK(Keccak512_4WayNoAvx2);
@@ -0,0 +1,177 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+
+//! Bytes the heap really hands out for an allocation of nAlloc bytes, malloc rounds up and adds a header
+uint64_t MallocUsage(size_t nAlloc)
+{
+    if (nAlloc == 0)
+        return 0;
+    if (sizeof(void*) == 8)
+        return ((nAlloc + 31) >> 4) << 4;
+    return ((nAlloc + 15) >> 3) << 3;
+}
+
+template <typename T>
+uint64_t VectorUsage(const std::vector<T>& v)
+{
+    return MallocUsage(v.capacity() * sizeof(T));
+}
+
+//! Memory a deserialized block takes, several times its serialized size for blocks of small transactions
+uint64_t BlockMemoryUsage(const CBlock& block)
+{
+    uint64_t nUsage = sizeof(CBlock) + VectorUsage(block.vtx) + VectorUsage(block.vchBlockSig) +
+                      VectorUsage(block.payee) + VectorUsage(block.vMerkleTree);
+    for (const CTransaction& tx : block.vtx) {
+        nUsage += VectorUsage(tx.vin) + VectorUsage(tx.vout);
+        for (const CTxIn& txin : tx.vin)
+            nUsage += VectorUsage(txin.scriptSig);
+        for (const CTxOut& txout : tx.vout)
+            nUsage += VectorUsage(txout.scriptPubKey);
+    }
+    return nUsage;
+}
+
+/**
+ * Least recently used cache of deserialized blocks keyed by hash, so that blocks read over and
+ * over (recent blocks served to peers, getblock, witness generation) skip the disk and
+ * deserialization. Its size is bounded by the memory the blocks it holds take.
+ */
+class CBlockCache
+{
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        uint64_t nSize;
+    };
+
+    CCriticalSection cs_blockcache;
+    uint64_t nMaxBytes;
+    //! Cached blocks, most recently used first
+    std::list<Entry> listBlocks;
+    std::map<uint256, std::list<Entry>::iterator> mapBlocks;
+    uint64_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    //! Evict the least recently used blocks until the rest fit
+    void Trim()
+    {
+        AssertLockHeld(cs_blockcache);
+        while (nBytes > nMaxBytes) {
+            nBytes -= listBlocks.back().nSize;
+            mapBlocks.erase(listBlocks.back().hash);
+            listBlocks.pop_back();
+        }
+    }
+
+public:
+    CBlockCache() : nMaxBytes(DEFAULT_BLOCK_CACHE_SIZE << 20), nBytes(0), nHits(0), nMisses(0) {}
+
+    void SetMaxBytes(uint64_t nMaxBytesIn)
+    {
+        LOCK(cs_blockcache);
+        nMaxBytes = nMaxBytesIn;
+        Trim();
+    }
+
+    bool Get(const uint256& hash, CBlock& block)
+    {
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_blockcache);
+            std::map<uint256, std::list<Entry>::iterator>::iterator it = mapBlocks.find(hash);
+            if (it == mapBlocks.end()) {
+                nMisses++;
+                return false;
+            }
+            nHits++;
+            listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+            pblock = it->second->pblock;
+        }
+        block = *pblock;
+        return true;
+    }
+
+    void Set(const CBlock& block, const uint256& hash)
+    {
+        {
+            LOCK(cs_blockcache);
+            if (nMaxBytes == 0)
+                return;
+        }
+
+        std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+        uint64_t nSize = BlockMemoryUsage(*pblock);
+
+        LOCK(cs_blockcache);
+        if (nSize > nMaxBytes)
+            return;
+        std::map<uint256, std::list<Entry>::iterator>::iterator it = mapBlocks.find(hash);
+        if (it != mapBlocks.end()) {
+            listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+            return;
+        }
+
+        Entry entry;
+        entry.hash = hash;
+        entry.pblock = pblock;
+        entry.nSize = nSize;
+        listBlocks.push_front(entry);
+        mapBlocks[hash] = listBlocks.begin();
+        nBytes += nSize;
+        Trim();
+    }
+
+    void GetStats(uint64_t& nBlocksOut, uint64_t& nBytesOut, uint64_t& nHitsOut, uint64_t& nMissesOut)
+    {
+        LOCK(cs_blockcache);
+        nBlocksOut = listBlocks.size();
+        nBytesOut = nBytes;
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+CBlockCache& GetBlockCache()
+{
+    static CBlockCache blockCache;
+    return blockCache;
+}
+
+}
+
+void SetBlockCacheSize(uint64_t nMaxBytes)
+{
+    GetBlockCache().SetMaxBytes(nMaxBytes);
+}
+
+bool GetCachedBlock(const uint256& hash, CBlock& block)
+{
+    return GetBlockCache().Get(hash, block);
+}
+
+void CacheBlock(const CBlock& block, const uint256& hash)
+{
+    GetBlockCache().Set(block, hash);
+}
+
+void GetBlockCacheStats(uint64_t& nBlocks, uint64_t& nBytes, uint64_t& nHits, uint64_t& nMisses)
+{
+    GetBlockCache().GetStats(nBlocks, nBytes, nHits, nMisses);
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_BLOCKCACHE_H
+#define BEETLECOIN_BLOCKCACHE_H
+
+#include <stdint.h>
+
+class CBlock;
+class uint256;
+
+/** Default for -blockcachesize, maximum MiB of memory the blocks in the hot block cache take */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/** Limit the hot block cache to nMaxBytes of block memory, 0 disables it. Set from -blockcachesize at init. */
+void SetBlockCacheSize(uint64_t nMaxBytes);
+
+/** Copy the block with the given hash out of the hot block cache. Returns false if it isn't cached. */
+bool GetCachedBlock(const uint256& hash, CBlock& block);
+
+/**
+ * Remember a block that was just connected or read from disk, evicting the least recently used
+ * blocks once the cached blocks take more memory than the limit. hash must be the hash of block.
+ */
+void CacheBlock(const CBlock& block, const uint256& hash);
+
+/** Statistics of the hot block cache, nBytes is the memory the cached blocks take */
+void GetBlockCacheStats(uint64_t& nBlocks, uint64_t& nBytes, uint64_t& nHits, uint64_t& nMisses);
+
+#endif // BEETLECOIN_BLOCKCACHE_H
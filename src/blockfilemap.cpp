@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "main.h"
+#include "sync.h"
+
+#include <list>
+#include <string>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+typedef std::pair<std::string, int> MappedBlockFileKey;
+
+CCriticalSection cs_mappedBlockFiles;
+//! Mapped files, most recently used first
+std::list<std::pair<MappedBlockFileKey, std::shared_ptr<const CMappedBlockFile> > > listMappedBlockFiles;
+}
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> GetMappedBlockFile(const CDiskBlockPos& pos, const char* prefix, uint64_t nEnd)
+{
+#ifdef WIN32
+    return std::shared_ptr<const CMappedBlockFile>();
+#else
+    // whole blk files don't fit many times into a 32 bit address space
+    if (sizeof(void*) < 8 || pos.IsNull())
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    LOCK(cs_mappedBlockFiles);
+    MappedBlockFileKey key(prefix, pos.nFile);
+    for (auto it = listMappedBlockFiles.begin(); it != listMappedBlockFiles.end(); ++it) {
+        if (it->first != key)
+            continue;
+        if (it->second->size() >= nEnd) {
+            listMappedBlockFiles.splice(listMappedBlockFiles.begin(), listMappedBlockFiles, it);
+            return it->second;
+        }
+        // the file grew since it was mapped
+        listMappedBlockFiles.erase(it);
+        break;
+    }
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    struct stat st;
+    void* pdata = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size >= nEnd)
+        pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pdata == MAP_FAILED)
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    std::shared_ptr<const CMappedBlockFile> mapped = std::make_shared<CMappedBlockFile>((const char*)pdata, (size_t)st.st_size);
+    listMappedBlockFiles.push_front(std::make_pair(key, mapped));
+    while (listMappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        listMappedBlockFiles.pop_back();
+    return mapped;
+#endif
+}
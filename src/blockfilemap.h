@@ -0,0 +1,44 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_BLOCKFILEMAP_H
+#define BEETLECOIN_BLOCKFILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+struct CDiskBlockPos;
+
+/** Maximum number of blk and rev files kept memory mapped at the same time */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 16;
+
+/** A read-only memory mapping of the first size() bytes of a blk or rev file */
+class CMappedBlockFile
+{
+private:
+    const char* pdata;
+    size_t nSize;
+
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    CMappedBlockFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Return a mapping of the blk or rev file holding pos that covers at least its first nEnd bytes,
+ * mapping the file again if it grew since it was last mapped, which should be rare: the file
+ * blocks are being appended to is read through OpenDiskFile instead. The most recently used files stay
+ * mapped. Returns NULL if the file can't be mapped, in which case the caller should read it through
+ * OpenDiskFile instead.
+ */
+std::shared_ptr<const CMappedBlockFile> GetMappedBlockFile(const CDiskBlockPos& pos, const char* prefix, uint64_t nEnd);
+
+#endif // BEETLECOIN_BLOCKFILEMAP_H
@@ -0,0 +1,295 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexsnapshot.h"
+
+#include "accumulators.h"
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+//! Bump when the layout of the snapshot changes, older snapshots are then ignored
+const int BLOCKINDEX_SNAPSHOT_VERSION = 2;
+
+boost::filesystem::path GetSnapshotPath()
+{
+    return GetDataDir() / BLOCKINDEX_SNAPSHOT_FILENAME;
+}
+
+//! The state of the databases a snapshot was written for, it is stale as soon as any part changed
+class CSnapshotBase
+{
+public:
+    uint256 hashBestBlock;        //! best block of the coins database
+    uint64_t nGeneration;         //! generation of the block tree, bumped by every session loading it
+    int nLastBlockFile;
+    CBlockFileInfo infoLastBlockFile;
+
+    CSnapshotBase() : nGeneration(0), nLastBlockFile(0) {}
+
+    //! Fill in the current state, missing generation and block file records count as empty
+    void ReadCurrent(const uint256& hashBestBlockIn)
+    {
+        hashBestBlock = hashBestBlockIn;
+        nGeneration = 0;
+        pblocktree->ReadGeneration(nGeneration);
+        nLastBlockFile = 0;
+        pblocktree->ReadLastBlockFile(nLastBlockFile);
+        infoLastBlockFile.SetNull();
+        pblocktree->ReadBlockFileInfo(nLastBlockFile, infoLastBlockFile);
+    }
+
+    bool operator==(const CSnapshotBase& other) const
+    {
+        return hashBestBlock == other.hashBestBlock && nGeneration == other.nGeneration &&
+               nLastBlockFile == other.nLastBlockFile &&
+               infoLastBlockFile.nBlocks == other.infoLastBlockFile.nBlocks &&
+               infoLastBlockFile.nSize == other.infoLastBlockFile.nSize &&
+               infoLastBlockFile.nUndoSize == other.infoLastBlockFile.nUndoSize;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBestBlock);
+        READWRITE(nGeneration);
+        READWRITE(nLastBlockFile);
+        READWRITE(infoLastBlockFile);
+    }
+};
+
+//! The snapshot file contents, memory mapped where possible
+class CSnapshotData
+{
+public:
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    std::vector<char> vData;
+
+    const char* begin() const { return mapped ? mapped->data() : vData.data(); }
+    size_t size() const { return mapped ? mapped->size() : vData.size(); }
+};
+
+bool ReadSnapshotData(const boost::filesystem::path& path, CSnapshotData& data)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void* pdata = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        pdata = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pdata != MAP_FAILED) {
+        data.mapped = std::make_shared<CMappedBlockFile>((const char*)pdata, (size_t)st.st_size);
+        return true;
+    }
+#endif
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    try {
+        data.vData.resize(boost::filesystem::file_size(path));
+        if (!data.vData.empty())
+            filein.read(data.vData.data(), data.vData.size());
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+}
+
+bool WriteBlockIndexSnapshot(const uint256& hashBestBlock)
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    CSnapshotBase base;
+    base.ReadCurrent(hashBestBlock);
+
+    // parents go first, so the reader can resolve pprev by position
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    vSortedByHeight.reserve(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vSortedByHeight.push_back(std::make_pair(item.second->nHeight, item.second));
+    std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    boost::unordered_map<const CBlockIndex*, uint32_t> mapPosition;
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
+        mapPosition.insert(std::make_pair(vSortedByHeight[i].second, (uint32_t)i));
+
+    // Write to a temporary file first, a half written snapshot must never be picked up
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char*)&randv, sizeof(randv));
+    boost::filesystem::path pathTmp = GetDataDir() / strprintf("%s.%04x", BLOCKINDEX_SNAPSHOT_FILENAME, randv);
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    try {
+        // serialize entries, checksum everything written, then append csum
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(Params().MessageStart());
+        ss << BLOCKINDEX_SNAPSHOT_VERSION;
+        ss << base;
+        ss << (uint64_t)vSortedByHeight.size();
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            CBlockIndex* pindex = item.second;
+            uint32_t nPrev = 0;
+            if (pindex->pprev) {
+                boost::unordered_map<const CBlockIndex*, uint32_t>::const_iterator it = mapPosition.find(pindex->pprev);
+                if (it == mapPosition.end())
+                    throw std::runtime_error("parent of " + pindex->GetBlockHash().ToString() + " is not in the block index");
+                nPrev = it->second + 1;
+            }
+            ss << pindex->GetBlockHash();
+            ss << VARINT(nPrev);
+            ss << CDiskBlockIndex(pindex);
+
+            if (ss.size() >= (1 << 20)) {
+                hasher.write(&ss[0], ss.size());
+                fileout.write(&ss[0], ss.size());
+                ss.clear();
+            }
+        }
+        if (!ss.empty()) {
+            hasher.write(&ss[0], ss.size());
+            fileout.write(&ss[0], ss.size());
+        }
+        fileout << hasher.GetHash();
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, GetSnapshotPath())) {
+        boost::filesystem::remove(pathTmp);
+        return error("%s : Rename-into-place failed", __func__);
+    }
+
+    LogPrintf("Wrote block index snapshot with %u entries  %dms\n", vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(const uint256& hashBestBlock, std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    boost::filesystem::path path = GetSnapshotPath();
+    if (!boost::filesystem::exists(path))
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    CSnapshotData data;
+    bool fRead = ReadSnapshotData(path, data);
+    // the block tree database moves on from here, the snapshot won't match it again
+    RemoveBlockIndexSnapshot();
+    if (!fRead || data.size() < sizeof(uint256))
+        return error("%s : Failed to read %s", __func__, path.string());
+
+    const char* pbegin = data.begin();
+    const char* pend = pbegin + data.size() - sizeof(uint256);
+    uint256 hashChecksum;
+    memcpy(hashChecksum.begin(), pend, sizeof(uint256));
+    if (hashChecksum != Hash(pbegin, pend))
+        return error("%s : Checksum mismatch, data corrupted", __func__);
+
+    CBufferReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+    std::vector<CBlockIndex*> vIndex;
+    try {
+        unsigned char pchMsgTmp[4];
+        int nVersion;
+        reader >> FLATDATA(pchMsgTmp) >> nVersion;
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s : Invalid network magic number", __func__);
+        if (nVersion != BLOCKINDEX_SNAPSHOT_VERSION)
+            return error("%s : Unknown snapshot version %d", __func__, nVersion);
+
+        CSnapshotBase base, baseCurrent;
+        uint64_t nEntries;
+        reader >> base >> nEntries;
+        baseCurrent.ReadCurrent(hashBestBlock);
+        if (!(base == baseCurrent)) {
+            LogPrintf("%s : snapshot is for best block %s generation %u, the block tree moved on since, ignoring it\n",
+                __func__, base.hashBestBlock.ToString(), base.nGeneration);
+            return false;
+        }
+
+        vIndex.reserve(nEntries);
+        vSortedByHeight.reserve(nEntries);
+        uint256 nPreviousCheckpoint;
+        for (uint64_t i = 0; i < nEntries; i++) {
+            if (i % 10000 == 0)
+                boost::this_thread::interruption_point();
+
+            uint256 hashBlock;
+            uint32_t nPrev;
+            CDiskBlockIndex diskindex;
+            reader >> hashBlock;
+            reader >> VARINT(nPrev);
+            reader >> diskindex;
+            if (nPrev > vIndex.size())
+                throw std::ios_base::failure("parent after child");
+
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(hashBlock, (CBlockIndex*)NULL));
+            if (!ret.second)
+                throw std::ios_base::failure("duplicate entry " + hashBlock.ToString());
+
+            CBlockIndex* pindexNew = blockIndexArena.New(static_cast<const CBlockIndex&>(diskindex));
+            pindexNew->phashBlock = &ret.first->first;
+            pindexNew->pprev = nPrev ? vIndex[nPrev - 1] : NULL;
+            pindexNew->pnext = NULL;
+            pindexNew->pskip = NULL;
+            ret.first->second = pindexNew;
+            vIndex.push_back(pindexNew);
+            vSortedByHeight.push_back(std::make_pair(pindexNew->nHeight, pindexNew));
+
+            LoadIndexAccumulatorValues(pindexNew, nPreviousCheckpoint);
+        }
+        if (!reader.eof())
+            throw std::ios_base::failure("trailing data");
+    } catch (const std::exception& e) {
+        mapBlockIndex.clear();
+        blockIndexArena.Clear();
+        vSortedByHeight.clear();
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    LogPrintf("Loaded %u block index entries from snapshot  %dms\n", vIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void RemoveBlockIndexSnapshot()
+{
+    try {
+        boost::filesystem::remove(GetSnapshotPath());
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("%s : %s\n", __func__, e.what());
+    }
+}
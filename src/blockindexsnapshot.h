@@ -0,0 +1,40 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_BLOCKINDEXSNAPSHOT_H
+#define BEETLECOIN_BLOCKINDEXSNAPSHOT_H
+
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+class uint256;
+
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCKINDEX_SNAPSHOT = true;
+
+/** File in the data directory holding the block index written at the last clean shutdown */
+static const char* const BLOCKINDEX_SNAPSHOT_FILENAME = "blockindex.snapshot";
+
+/**
+ * Write all of mapBlockIndex to the snapshot file, parents before children. Call with cs_main
+ * held after the index was flushed to the block tree database, the snapshot is only valid for
+ * the state of the database at that point: the best block, the block tree generation and the
+ * size of the last block file are recorded with it.
+ */
+bool WriteBlockIndexSnapshot(const uint256& hashBestBlock);
+
+/**
+ * Fill mapBlockIndex from the snapshot in a single pass instead of scanning the block tree
+ * database. vSortedByHeight receives the loaded entries ordered by height. Fails, leaving
+ * mapBlockIndex empty, if there is no snapshot, it is damaged or the best block, block tree
+ * generation or last block file changed since it was written. The file is removed either way,
+ * so a later crash can't leave a stale one behind.
+ */
+bool LoadBlockIndexSnapshot(const uint256& hashBestBlock, std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight);
+
+/** Remove the snapshot, e.g. when the block index is rebuilt */
+void RemoveBlockIndexSnapshot();
+
+#endif // BEETLECOIN_BLOCKINDEXSNAPSHOT_H
@@ -5,9 +5,94 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "sync.h"
+
+#include <deque>
+#include <stdexcept>
 
 using namespace std;
 
+/**
+ * CZerocoinSupply implementation
+ */
+namespace
+{
+CCriticalSection cs_zerocoinSupply;
+//! deque so the interned entries never move
+std::deque<CZerocoinSupply> dequeZerocoinSupply;
+std::map<CZerocoinSupply, const CZerocoinSupply*> mapZerocoinSupplyInterned;
+}
+
+CZerocoinSupply::CZerocoinSupply(const std::map<libzerocoin::CoinDenomination, int64_t>& mapSupply)
+{
+    for (size_t i = 0; i < DENOMS; i++) {
+        std::map<libzerocoin::CoinDenomination, int64_t>::const_iterator it = mapSupply.find(libzerocoin::zerocoinDenomList[i]);
+        vCount[i] = (it != mapSupply.end()) ? it->second : 0;
+    }
+}
+
+std::map<libzerocoin::CoinDenomination, int64_t> CZerocoinSupply::ToMap() const
+{
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+    for (size_t i = 0; i < DENOMS; i++)
+        mapSupply.insert(std::make_pair(libzerocoin::zerocoinDenomList[i], vCount[i]));
+    return mapSupply;
+}
+
+size_t CZerocoinSupply::DenomIndex(libzerocoin::CoinDenomination denom)
+{
+    switch (denom) {
+    case libzerocoin::ZQ_ONE: return 0;
+    case libzerocoin::ZQ_FIVE: return 1;
+    case libzerocoin::ZQ_TEN: return 2;
+    case libzerocoin::ZQ_FIFTY: return 3;
+    case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+    case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+    case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+    case libzerocoin::ZQ_FIVE_THOUSAND: return 7;
+    default:
+        // std::map::at threw on these before
+        throw std::out_of_range("CZerocoinSupply : invalid denomination");
+    }
+}
+
+const CZerocoinSupply* CZerocoinSupply::Zero()
+{
+    static const CZerocoinSupply zero;
+    return &zero;
+}
+
+const CZerocoinSupply* CZerocoinSupply::Intern(const CZerocoinSupply& supply)
+{
+    if (supply == *Zero())
+        return Zero();
+
+    LOCK(cs_zerocoinSupply);
+    std::map<CZerocoinSupply, const CZerocoinSupply*>::iterator it = mapZerocoinSupplyInterned.find(supply);
+    if (it != mapZerocoinSupplyInterned.end())
+        return it->second;
+
+    dequeZerocoinSupply.push_back(supply);
+    const CZerocoinSupply* pSupply = &dequeZerocoinSupply.back();
+    mapZerocoinSupplyInterned.insert(std::make_pair(supply, pSupply));
+    return pSupply;
+}
+
+/**
+ * CBlockIndexArena implementation
+ */
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        size_t nEntries = (i + 1 == vChunks.size()) ? nUsed : CHUNK_ENTRIES;
+        for (size_t j = 0; j < nEntries; j++)
+            vChunks[i][j].~CBlockIndex();
+        ::operator delete(vChunks[i]);
+    }
+    vChunks.clear();
+    nUsed = CHUNK_ENTRIES;
+}
+
 /**
  * CChain implementation
  */
@@ -14,6 +14,9 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <algorithm>
+#include <map>
+#include <new>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -100,6 +103,55 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/** Zerocoin supply after a block: the number of mints of each denomination, in zerocoinDenomList order */
+class CZerocoinSupply
+{
+public:
+    static const size_t DENOMS = 8;
+    int64_t vCount[DENOMS];
+
+    CZerocoinSupply()
+    {
+        std::fill(vCount, vCount + DENOMS, 0);
+    }
+
+    explicit CZerocoinSupply(const std::map<libzerocoin::CoinDenomination, int64_t>& mapSupply);
+
+    std::map<libzerocoin::CoinDenomination, int64_t> ToMap() const;
+
+    int64_t Get(libzerocoin::CoinDenomination denom) const
+    {
+        return vCount[DenomIndex(denom)];
+    }
+
+    void Add(libzerocoin::CoinDenomination denom, int64_t nCount)
+    {
+        vCount[DenomIndex(denom)] += nCount;
+    }
+
+    bool operator==(const CZerocoinSupply& other) const
+    {
+        return std::equal(vCount, vCount + DENOMS, other.vCount);
+    }
+
+    bool operator<(const CZerocoinSupply& other) const
+    {
+        return std::lexicographical_compare(vCount, vCount + DENOMS, other.vCount, other.vCount + DENOMS);
+    }
+
+    /**
+     * Returns the shared copy of a supply. Most blocks don't mint or spend zerocoins, so long runs of
+     * block index entries point to the same entry. Entries are never freed and may be read without locks.
+     */
+    static const CZerocoinSupply* Intern(const CZerocoinSupply& supply);
+
+    //! The shared all zero supply that new block index entries start with
+    static const CZerocoinSupply* Zero();
+
+private:
+    static size_t DenomIndex(libzerocoin::CoinDenomination denom);
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -178,8 +230,8 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+    //! zerocoin specific fields, the supply is interned and shared with the blocks that have the same supply
+    const CZerocoinSupply* pZerocoinSupply;
     std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
     
     void SetNull()
@@ -212,9 +264,7 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
+        pZerocoinSupply = CZerocoinSupply::Zero();
         vMintDenominationsInBlock.clear();
     }
 
@@ -305,7 +355,18 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return pZerocoinSupply->Get(denom);
+    }
+
+    const CZerocoinSupply& GetZcSupply() const
+    {
+        return *pZerocoinSupply;
+    }
+
+    void SetZcSupply(const CZerocoinSupply& supply)
+    {
+        if (!(supply == *pZerocoinSupply))
+            pZerocoinSupply = CZerocoinSupply::Intern(supply);
     }
 
     /**
@@ -499,7 +560,13 @@ public:
         READWRITE(nNonce);
         if (this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
+            // kept as a map on disk so existing block index databases still load
+            std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+            if (!ser_action.ForRead())
+                mapZerocoinSupply = GetZcSupply().ToMap();
             READWRITE(mapZerocoinSupply);
+            if (ser_action.ForRead())
+                SetZcSupply(CZerocoinSupply(mapZerocoinSupply));
             READWRITE(vMintDenominationsInBlock);
         }
 
@@ -507,6 +574,10 @@ public:
 
     uint256 GetBlockHash() const
     {
+        // built from an in-memory index entry, which already knows its hash
+        if (phashBlock)
+            return *phashBlock;
+
         CBlockHeader block;
         block.nVersion = nVersion;
         block.hashPrevBlock = hashPrev;
@@ -530,6 +601,48 @@ public:
     }
 };
 
+/**
+ * Allocates block index entries in large contiguous chunks. Entries that are created together, as
+ * when the index is loaded, end up next to each other, which keeps walks over pprev and pskip in
+ * cache and saves the per allocation overhead. Entries live until Clear(). Not thread safe, callers
+ * hold cs_main.
+ */
+class CBlockIndexArena
+{
+public:
+    static const size_t CHUNK_ENTRIES = 4096;
+
+    CBlockIndexArena() : nUsed(CHUNK_ENTRIES) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        if (nUsed == CHUNK_ENTRIES) {
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(CHUNK_ENTRIES * sizeof(CBlockIndex))));
+            nUsed = 0;
+        }
+        CBlockIndex* pindex = new (vChunks.back() + nUsed) CBlockIndex(std::forward<Args>(args)...);
+        nUsed++;
+        return pindex;
+    }
+
+    //! Destroys all entries, pointers handed out before are invalid afterwards
+    void Clear();
+
+    size_t Size() const
+    {
+        return vChunks.empty() ? 0 : (vChunks.size() - 1) * CHUNK_ENTRIES + nUsed;
+    }
+
+private:
+    std::vector<CBlockIndex*> vChunks;
+    size_t nUsed; //! entries used in the last chunk
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
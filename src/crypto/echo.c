@@ -35,6 +35,12 @@
 #include <limits.h>
 
 #include "sph_echo.h"
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C"{
@@ -719,11 +725,109 @@ echo_small_compress(sph_echo_small_context *sc)
 	COMPRESS_SMALL(sc);
 }
 
+#if SPH_AESNI
+
+/*
+ * Multiply each byte by 2 in GF(2^8), as in the AES MixColumns.
+ */
+static SPH_AESNI_TARGET __m128i
+echo_mul2_aesni(__m128i x)
+{
+	__m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+		_mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+#define MIX_COLUMN_AESNI(ia, ib, ic, id)   do { \
+		__m128i a = W[ia]; \
+		__m128i b = W[ib]; \
+		__m128i c = W[ic]; \
+		__m128i d = W[id]; \
+		__m128i ab = _mm_xor_si128(a, b); \
+		__m128i bc = _mm_xor_si128(b, c); \
+		__m128i cd = _mm_xor_si128(c, d); \
+		__m128i abx = echo_mul2_aesni(ab); \
+		__m128i bcx = echo_mul2_aesni(bc); \
+		__m128i cdx = echo_mul2_aesni(cd); \
+		W[ia] = _mm_xor_si128(abx, _mm_xor_si128(bc, d)); \
+		W[ib] = _mm_xor_si128(bcx, _mm_xor_si128(a, cd)); \
+		W[ic] = _mm_xor_si128(cdx, _mm_xor_si128(ab, d)); \
+		W[id] = _mm_xor_si128(_mm_xor_si128(abx, bcx), \
+			_mm_xor_si128(cdx, _mm_xor_si128(ab, c))); \
+	} while (0)
+
+/*
+ * Same as COMPRESS_BIG, with each 128-bit word of the state held in an
+ * SSE register and the two AES rounds of BIG_SUB_WORDS done with AESENC.
+ */
+static SPH_AESNI_TARGET void
+echo_big_compress_aesni(sph_echo_big_context *sc)
+{
+	__m128i W[16];
+	__m128i zero = _mm_setzero_si128();
+	sph_u32 K0 = sc->C0;
+	sph_u32 K1 = sc->C1;
+	sph_u32 K2 = sc->C2;
+	sph_u32 K3 = sc->C3;
+	const unsigned char *V = (const unsigned char *)&sc->u;
+	unsigned u, n;
+
+	for (n = 0; n < 8; n ++) {
+		W[n] = _mm_loadu_si128((const __m128i *)(V + 16 * n));
+		W[n + 8] = _mm_loadu_si128((const __m128i *)(sc->buf + 16 * n));
+	}
+	for (u = 0; u < 10; u ++) {
+		__m128i tmp;
+
+		for (n = 0; n < 16; n ++) {
+			__m128i K = _mm_set_epi32((int)K3, (int)K2,
+				(int)K1, (int)K0);
+
+			W[n] = _mm_aesenc_si128(_mm_aesenc_si128(W[n], K), zero);
+			if ((K0 = T32(K0 + 1)) == 0) {
+				if ((K1 = T32(K1 + 1)) == 0)
+					if ((K2 = T32(K2 + 1)) == 0)
+						K3 = T32(K3 + 1);
+			}
+		}
+
+		/* BIG_SHIFT_ROWS */
+		tmp = W[1]; W[1] = W[5]; W[5] = W[9]; W[9] = W[13]; W[13] = tmp;
+		tmp = W[2]; W[2] = W[10]; W[10] = tmp;
+		tmp = W[6]; W[6] = W[14]; W[14] = tmp;
+		tmp = W[15]; W[15] = W[11]; W[11] = W[7]; W[7] = W[3]; W[3] = tmp;
+
+		MIX_COLUMN_AESNI(0, 1, 2, 3);
+		MIX_COLUMN_AESNI(4, 5, 6, 7);
+		MIX_COLUMN_AESNI(8, 9, 10, 11);
+		MIX_COLUMN_AESNI(12, 13, 14, 15);
+	}
+	for (n = 0; n < 8; n ++) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(V + 16 * n));
+		__m128i m = _mm_loadu_si128((const __m128i *)(sc->buf + 16 * n));
+
+		v = _mm_xor_si128(v, _mm_xor_si128(m,
+			_mm_xor_si128(W[n], W[n + 8])));
+		_mm_storeu_si128((__m128i *)((unsigned char *)&sc->u + 16 * n), v);
+	}
+}
+
+#undef MIX_COLUMN_AESNI
+
+#endif
+
 static void
 echo_big_compress(sph_echo_big_context *sc)
 {
 	DECL_STATE_BIG
 
+#if SPH_AESNI
+	if (sph_aesni_enabled()) {
+		echo_big_compress_aesni(sc);
+		return;
+	}
+#endif
 	COMPRESS_BIG(sc);
 }
 
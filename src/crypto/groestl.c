@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "sph_groestl.h"
+#include "sph_aesni.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -2870,6 +2871,225 @@ groestl_small_close(sph_groestl_small_context *sc,
 	groestl_small_init(sc, (unsigned)out_len << 3);
 }
 
+/*
+ * AES-NI implementation of the big (384 and 512 bit) permutations. The
+ * state is held one row per SSE register, so ShiftBytesWide is a byte
+ * rotation of each register and MixBytes is a linear combination of the
+ * eight registers. SubBytes is the AES S-box, applied with AESENCLAST and
+ * a zero key after undoing the AES ShiftRows that AESENCLAST also does;
+ * both byte permutations are merged into a single PSHUFB per row.
+ */
+#if SPH_AESNI && USE_LE
+
+#define SPH_GROESTL_AESNI   1
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+/*
+ * PSHUFB masks rotating a row left by 0, 1, 2, 3, 4, 5, 6 and 11 bytes,
+ * composed with the inverse AES ShiftRows.
+ */
+static const unsigned char groestl_shuf_aesni[8][16] = {
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4 },
+	{  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5 },
+	{  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6 },
+	{  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7 },
+	{  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8 },
+	{  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9 },
+	{ 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14 }
+};
+
+/* rows of P are rotated by 0, 1, 2, 3, 4, 5, 6, 11; rows of Q by 1, 3, 5, 11, 0, 2, 4, 6 */
+static const int groestl_shuf_p_aesni[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+static const int groestl_shuf_q_aesni[8] = { 1, 3, 5, 7, 0, 2, 4, 6 };
+
+/*
+ * Multiply each byte by 2 in GF(2^8) modulo the AES polynomial.
+ */
+static SPH_AESNI_TARGET __m128i
+groestl_mul2_aesni(__m128i x)
+{
+	__m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+		_mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+/*
+ * Load 128 state bytes (column after column) as eight rows, and back.
+ */
+static SPH_AESNI_TARGET void
+groestl_big_load_rows_aesni(__m128i x[8], const unsigned char *src)
+{
+	unsigned char t[8][16];
+	int r, c;
+
+	for (c = 0; c < 16; c ++)
+		for (r = 0; r < 8; r ++)
+			t[r][c] = src[(c << 3) + r];
+	for (r = 0; r < 8; r ++)
+		x[r] = _mm_loadu_si128((const __m128i *)t[r]);
+}
+
+static SPH_AESNI_TARGET void
+groestl_big_store_rows_aesni(unsigned char *dst, const __m128i x[8])
+{
+	unsigned char t[8][16];
+	int r, c;
+
+	for (r = 0; r < 8; r ++)
+		_mm_storeu_si128((__m128i *)t[r], x[r]);
+	for (c = 0; c < 16; c ++)
+		for (r = 0; r < 8; r ++)
+			dst[(c << 3) + r] = t[r][c];
+}
+
+#define MIX_ROW_AESNI(i0, i1, i2, i3, i4, i5, i6, i7)   do { \
+		__m128i x1 = _mm_xor_si128(x[i2], \
+			_mm_xor_si128(t[i4], t[i6])); \
+		__m128i x2 = _mm_xor_si128(_mm_xor_si128(t[i0], x[i2]), \
+			_mm_xor_si128(x[i5], x[i7])); \
+		__m128i x4 = _mm_xor_si128(t[i3], t[i6]); \
+		y[i0] = _mm_xor_si128(x1, groestl_mul2_aesni( \
+			_mm_xor_si128(x2, groestl_mul2_aesni(x4)))); \
+	} while (0)
+
+/*
+ * Apply the P (q == 0) or Q (q != 0) permutation to a state in rows.
+ */
+static SPH_AESNI_TARGET void
+groestl_big_perm_aesni(__m128i x[8], int q)
+{
+	const int *shuf = q ? groestl_shuf_q_aesni : groestl_shuf_p_aesni;
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi8((char)0xFF);
+	__m128i cols = _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50,
+		0x60, 0x70, (char)0x80, (char)0x90, (char)0xA0, (char)0xB0,
+		(char)0xC0, (char)0xD0, (char)0xE0, (char)0xF0);
+	__m128i mask[8];
+	int i, r;
+
+	for (i = 0; i < 8; i ++)
+		mask[i] = _mm_loadu_si128(
+			(const __m128i *)groestl_shuf_aesni[shuf[i]]);
+	for (r = 0; r < 14; r ++) {
+		__m128i t[8], y[8];
+
+		/* AddRoundConstant */
+		if (q) {
+			for (i = 0; i < 7; i ++)
+				x[i] = _mm_xor_si128(x[i], ones);
+			x[7] = _mm_xor_si128(x[7], _mm_xor_si128(cols,
+				_mm_set1_epi8((char)(0xFF ^ r))));
+		} else {
+			x[0] = _mm_xor_si128(x[0], _mm_xor_si128(cols,
+				_mm_set1_epi8((char)r)));
+		}
+
+		/* ShiftBytesWide and SubBytes */
+		for (i = 0; i < 8; i ++)
+			x[i] = _mm_aesenclast_si128(
+				_mm_shuffle_epi8(x[i], mask[i]), zero);
+
+		/*
+		 * MixBytes, circ(2, 2, 3, 4, 5, 3, 5, 7). Split by bits of the
+		 * coefficients, y[i] = X1 ^ 2 * (X2 ^ 2 * X4) with, for
+		 * t[i] = x[i] ^ x[i + 1] (indices modulo 8):
+		 * X1 = x[i + 2] ^ t[i + 4] ^ t[i + 6]
+		 * X2 = t[i] ^ x[i + 2] ^ x[i + 5] ^ x[i + 7]
+		 * X4 = t[i + 3] ^ t[i + 6]
+		 */
+		t[0] = _mm_xor_si128(x[0], x[1]);
+		t[1] = _mm_xor_si128(x[1], x[2]);
+		t[2] = _mm_xor_si128(x[2], x[3]);
+		t[3] = _mm_xor_si128(x[3], x[4]);
+		t[4] = _mm_xor_si128(x[4], x[5]);
+		t[5] = _mm_xor_si128(x[5], x[6]);
+		t[6] = _mm_xor_si128(x[6], x[7]);
+		t[7] = _mm_xor_si128(x[7], x[0]);
+		MIX_ROW_AESNI(0, 1, 2, 3, 4, 5, 6, 7);
+		MIX_ROW_AESNI(1, 2, 3, 4, 5, 6, 7, 0);
+		MIX_ROW_AESNI(2, 3, 4, 5, 6, 7, 0, 1);
+		MIX_ROW_AESNI(3, 4, 5, 6, 7, 0, 1, 2);
+		MIX_ROW_AESNI(4, 5, 6, 7, 0, 1, 2, 3);
+		MIX_ROW_AESNI(5, 6, 7, 0, 1, 2, 3, 4);
+		MIX_ROW_AESNI(6, 7, 0, 1, 2, 3, 4, 5);
+		MIX_ROW_AESNI(7, 0, 1, 2, 3, 4, 5, 6);
+		x[0] = y[0];
+		x[1] = y[1];
+		x[2] = y[2];
+		x[3] = y[3];
+		x[4] = y[4];
+		x[5] = y[5];
+		x[6] = y[6];
+		x[7] = y[7];
+	}
+}
+
+/*
+ * h <- P(h ^ m) ^ Q(m) ^ h, on 128-byte states in memory order.
+ */
+static SPH_AESNI_TARGET void
+groestl_big_compress_aesni(unsigned char *h, const unsigned char *m)
+{
+	__m128i hr[8], g[8], q[8];
+	int i;
+
+	groestl_big_load_rows_aesni(hr, h);
+	groestl_big_load_rows_aesni(q, m);
+	for (i = 0; i < 8; i ++)
+		g[i] = _mm_xor_si128(hr[i], q[i]);
+	groestl_big_perm_aesni(g, 0);
+	groestl_big_perm_aesni(q, 1);
+	for (i = 0; i < 8; i ++)
+		hr[i] = _mm_xor_si128(hr[i], _mm_xor_si128(g[i], q[i]));
+	groestl_big_store_rows_aesni(h, hr);
+}
+
+/*
+ * h <- P(h) ^ h, the output transformation before truncation.
+ */
+static SPH_AESNI_TARGET void
+groestl_big_final_aesni(unsigned char *h)
+{
+	__m128i hr[8], x[8];
+	int i;
+
+	groestl_big_load_rows_aesni(hr, h);
+	for (i = 0; i < 8; i ++)
+		x[i] = hr[i];
+	groestl_big_perm_aesni(x, 0);
+	for (i = 0; i < 8; i ++)
+		hr[i] = _mm_xor_si128(hr[i], x[i]);
+	groestl_big_store_rows_aesni(h, hr);
+}
+
+#undef MIX_ROW_AESNI
+
+#define COMPRESS_BIG_ANY   do { \
+		if (sph_aesni_enabled()) \
+			groestl_big_compress_aesni((unsigned char *)H, buf); \
+		else \
+			COMPRESS_BIG; \
+	} while (0)
+
+#define FINAL_BIG_ANY   do { \
+		if (sph_aesni_enabled()) \
+			groestl_big_final_aesni((unsigned char *)H); \
+		else \
+			FINAL_BIG; \
+	} while (0)
+
+#else
+
+#define COMPRESS_BIG_ANY   COMPRESS_BIG
+#define FINAL_BIG_ANY      FINAL_BIG
+
+#endif
+
 static void
 groestl_big_init(sph_groestl_big_context *sc, unsigned out_size)
 {
@@ -2932,7 +3152,7 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 		data = (const unsigned char *)data + clen;
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
-			COMPRESS_BIG;
+			COMPRESS_BIG_ANY;
 #if SPH_64
 			sc->count ++;
 #else
@@ -2995,7 +3215,7 @@ groestl_big_close(sph_groestl_big_context *sc,
 #endif
 	groestl_big_core(sc, pad, pad_len);
 	READ_STATE_BIG(sc);
-	FINAL_BIG;
+	FINAL_BIG_ANY;
 #if SPH_GROESTL_64
 	for (u = 0; u < 8; u ++)
 		enc64e(pad + (u << 3), H[u + 8]);
@@ -34,6 +34,13 @@
 #include <string.h>
 
 #include "sph_shavite.h"
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C"{
@@ -1475,6 +1482,111 @@ c512(sph_shavite_big_context *sc, const void *msg)
 
 #endif
 
+#if SPH_AESNI
+
+/*
+ * Same as c512, with each 128-bit word of the state and of the key
+ * schedule held in an SSE register and the AES rounds done with AESENC.
+ * A round of the key schedule is an AESENC with a zero key; in the
+ * compression function the key XOR preceding each AES round is folded
+ * into the AESENC of the round before.
+ */
+static SPH_AESNI_TARGET void
+c512_aesni(sph_shavite_big_context *sc, const void *msg)
+{
+	__m128i rk[112];
+	__m128i zero = _mm_setzero_si128();
+	__m128i p0, p1, p2, p3, t;
+	size_t u;
+	int r, s;
+
+	for (u = 0; u < 8; u ++)
+		rk[u] = _mm_loadu_si128((const __m128i *)msg + u);
+	u = 8;
+	for (;;) {
+		for (s = 0; s < 8; s ++) {
+			/* (rk[u - 31], rk[u - 30], rk[u - 29], rk[u - 32]) */
+			t = _mm_shuffle_epi32(rk[u - 8], 0x39);
+			rk[u] = _mm_xor_si128(_mm_aesenc_si128(t, zero),
+				rk[u - 1]);
+			if (u == 8) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(
+					(int)SPH_T32(~sc->count3), (int)sc->count2,
+					(int)sc->count1, (int)sc->count0));
+			} else if (u == 41) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(
+					(int)SPH_T32(~sc->count0), (int)sc->count1,
+					(int)sc->count2, (int)sc->count3));
+			} else if (u == 79) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(
+					(int)SPH_T32(~sc->count1), (int)sc->count0,
+					(int)sc->count3, (int)sc->count2));
+			} else if (u == 110) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(
+					(int)SPH_T32(~sc->count2), (int)sc->count3,
+					(int)sc->count0, (int)sc->count1));
+			}
+			u ++;
+		}
+		if (u == 112)
+			break;
+		for (s = 0; s < 8; s ++) {
+			/* rk[u - 7 .. u - 4] straddles two 128-bit words */
+			t = _mm_alignr_epi8(rk[u - 1], rk[u - 2], 4);
+			rk[u] = _mm_xor_si128(rk[u - 8], t);
+			u ++;
+		}
+	}
+
+	p0 = _mm_loadu_si128((const __m128i *)sc->h + 0);
+	p1 = _mm_loadu_si128((const __m128i *)sc->h + 1);
+	p2 = _mm_loadu_si128((const __m128i *)sc->h + 2);
+	p3 = _mm_loadu_si128((const __m128i *)sc->h + 3);
+	u = 0;
+	for (r = 0; r < 14; r ++) {
+		t = _mm_xor_si128(p1, rk[u]);
+		t = _mm_aesenc_si128(t, rk[u + 1]);
+		t = _mm_aesenc_si128(t, rk[u + 2]);
+		t = _mm_aesenc_si128(t, rk[u + 3]);
+		p0 = _mm_xor_si128(p0, _mm_aesenc_si128(t, zero));
+		t = _mm_xor_si128(p3, rk[u + 4]);
+		t = _mm_aesenc_si128(t, rk[u + 5]);
+		t = _mm_aesenc_si128(t, rk[u + 6]);
+		t = _mm_aesenc_si128(t, rk[u + 7]);
+		p2 = _mm_xor_si128(p2, _mm_aesenc_si128(t, zero));
+		u += 8;
+
+		/* WROT */
+		t = p3;
+		p3 = p2;
+		p2 = p1;
+		p1 = p0;
+		p0 = t;
+	}
+	_mm_storeu_si128((__m128i *)sc->h + 0,
+		_mm_xor_si128(_mm_loadu_si128((const __m128i *)sc->h + 0), p0));
+	_mm_storeu_si128((__m128i *)sc->h + 1,
+		_mm_xor_si128(_mm_loadu_si128((const __m128i *)sc->h + 1), p1));
+	_mm_storeu_si128((__m128i *)sc->h + 2,
+		_mm_xor_si128(_mm_loadu_si128((const __m128i *)sc->h + 2), p2));
+	_mm_storeu_si128((__m128i *)sc->h + 3,
+		_mm_xor_si128(_mm_loadu_si128((const __m128i *)sc->h + 3), p3));
+}
+
+#endif
+
+static void
+shavite_big_compress(sph_shavite_big_context *sc, const void *msg)
+{
+#if SPH_AESNI
+	if (sph_aesni_enabled()) {
+		c512_aesni(sc, msg);
+		return;
+	}
+#endif
+	c512(sc, msg);
+}
+
 static void
 shavite_small_init(sph_shavite_small_context *sc, const sph_u32 *iv)
 {
@@ -1590,7 +1702,7 @@ shavite_big_core(sph_shavite_big_context *sc, const void *data, size_t len)
 					}
 				}
 			}
-			c512(sc, buf);
+			shavite_big_compress(sc, buf);
 			ptr = 0;
 		}
 	}
@@ -1624,7 +1736,7 @@ shavite_big_close(sph_shavite_big_context *sc,
 	} else {
 		buf[ptr ++] = z;
 		memset(buf + ptr, 0, 128 - ptr);
-		c512(sc, buf);
+		shavite_big_compress(sc, buf);
 		memset(buf, 0, 110);
 		sc->count0 = sc->count1 = sc->count2 = sc->count3 = 0;
 	}
@@ -1634,7 +1746,7 @@ shavite_big_close(sph_shavite_big_context *sc,
 	sph_enc32le(buf + 122, count3);
 	buf[126] = out_size_w32 << 5;
 	buf[127] = out_size_w32 >> 3;
-	c512(sc, buf);
+	shavite_big_compress(sc, buf);
 	for (u = 0; u < out_size_w32; u ++)
 		sph_enc32le((unsigned char *)dst + (u << 2), sc->h[u]);
 }
@@ -0,0 +1,433 @@
+/*
+ * Four lane SHA-512 and Keccak-512, see sph_4way.h.
+ */
+
+#include <string.h>
+
+#include "sph_4way.h"
+#include "sph_keccak.h"
+#include "sph_sha2.h"
+
+#if SPH_AVX2
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* -1 until the CPU has been probed, then 0 or 1 */
+static volatile int avx2_state = -1;
+
+static int
+avx2_supported(void)
+{
+#if SPH_AVX2
+	unsigned eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	/* the OS must save the YMM registers, or using them corrupts state */
+	if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0)
+		return 0;
+	__asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 6) != 6)
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & bit_AVX2) != 0;
+#else
+	return 0;
+#endif
+}
+
+/* see sph_4way.h */
+int
+sph_avx2_enabled(void)
+{
+	int state = avx2_state;
+
+	/* probing is idempotent, so threads racing here all store the same value */
+	if (state < 0)
+		avx2_state = state = avx2_supported();
+	return state;
+}
+
+/* see sph_4way.h */
+void
+sph_avx2_set_enabled(int enabled)
+{
+	avx2_state = enabled ? avx2_supported() : 0;
+}
+
+#if SPH_AVX2
+
+/*
+ * Gather 64 bit word w of each lane's block into one register,
+ * lane 0 in the lowest quarter.
+ */
+#define SET4(w0, w1, w2, w3) \
+	_mm256_set_epi64x((long long)(w3), (long long)(w2), \
+		(long long)(w1), (long long)(w0))
+
+#define ROTR4(x, n) \
+	_mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define ROTL4(x, n) \
+	_mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - (n)))
+
+static const sph_u64 K512_4way[80] = {
+	SPH_C64(0x428A2F98D728AE22), SPH_C64(0x7137449123EF65CD),
+	SPH_C64(0xB5C0FBCFEC4D3B2F), SPH_C64(0xE9B5DBA58189DBBC),
+	SPH_C64(0x3956C25BF348B538), SPH_C64(0x59F111F1B605D019),
+	SPH_C64(0x923F82A4AF194F9B), SPH_C64(0xAB1C5ED5DA6D8118),
+	SPH_C64(0xD807AA98A3030242), SPH_C64(0x12835B0145706FBE),
+	SPH_C64(0x243185BE4EE4B28C), SPH_C64(0x550C7DC3D5FFB4E2),
+	SPH_C64(0x72BE5D74F27B896F), SPH_C64(0x80DEB1FE3B1696B1),
+	SPH_C64(0x9BDC06A725C71235), SPH_C64(0xC19BF174CF692694),
+	SPH_C64(0xE49B69C19EF14AD2), SPH_C64(0xEFBE4786384F25E3),
+	SPH_C64(0x0FC19DC68B8CD5B5), SPH_C64(0x240CA1CC77AC9C65),
+	SPH_C64(0x2DE92C6F592B0275), SPH_C64(0x4A7484AA6EA6E483),
+	SPH_C64(0x5CB0A9DCBD41FBD4), SPH_C64(0x76F988DA831153B5),
+	SPH_C64(0x983E5152EE66DFAB), SPH_C64(0xA831C66D2DB43210),
+	SPH_C64(0xB00327C898FB213F), SPH_C64(0xBF597FC7BEEF0EE4),
+	SPH_C64(0xC6E00BF33DA88FC2), SPH_C64(0xD5A79147930AA725),
+	SPH_C64(0x06CA6351E003826F), SPH_C64(0x142929670A0E6E70),
+	SPH_C64(0x27B70A8546D22FFC), SPH_C64(0x2E1B21385C26C926),
+	SPH_C64(0x4D2C6DFC5AC42AED), SPH_C64(0x53380D139D95B3DF),
+	SPH_C64(0x650A73548BAF63DE), SPH_C64(0x766A0ABB3C77B2A8),
+	SPH_C64(0x81C2C92E47EDAEE6), SPH_C64(0x92722C851482353B),
+	SPH_C64(0xA2BFE8A14CF10364), SPH_C64(0xA81A664BBC423001),
+	SPH_C64(0xC24B8B70D0F89791), SPH_C64(0xC76C51A30654BE30),
+	SPH_C64(0xD192E819D6EF5218), SPH_C64(0xD69906245565A910),
+	SPH_C64(0xF40E35855771202A), SPH_C64(0x106AA07032BBD1B8),
+	SPH_C64(0x19A4C116B8D2D0C8), SPH_C64(0x1E376C085141AB53),
+	SPH_C64(0x2748774CDF8EEB99), SPH_C64(0x34B0BCB5E19B48A8),
+	SPH_C64(0x391C0CB3C5C95A63), SPH_C64(0x4ED8AA4AE3418ACB),
+	SPH_C64(0x5B9CCA4F7763E373), SPH_C64(0x682E6FF3D6B2B8A3),
+	SPH_C64(0x748F82EE5DEFB2FC), SPH_C64(0x78A5636F43172F60),
+	SPH_C64(0x84C87814A1F0AB72), SPH_C64(0x8CC702081A6439EC),
+	SPH_C64(0x90BEFFFA23631E28), SPH_C64(0xA4506CEBDE82BDE9),
+	SPH_C64(0xBEF9A3F7B2C67915), SPH_C64(0xC67178F2E372532B),
+	SPH_C64(0xCA273ECEEA26619C), SPH_C64(0xD186B8C721C0C207),
+	SPH_C64(0xEADA7DD6CDE0EB1E), SPH_C64(0xF57D4F7FEE6ED178),
+	SPH_C64(0x06F067AA72176FBA), SPH_C64(0x0A637DC5A2C898A6),
+	SPH_C64(0x113F9804BEF90DAE), SPH_C64(0x1B710B35131C471B),
+	SPH_C64(0x28DB77F523047D84), SPH_C64(0x32CAAB7B40C72493),
+	SPH_C64(0x3C9EBE0A15C9BEBC), SPH_C64(0x431D67C49C100D4C),
+	SPH_C64(0x4CC5D4BECB3E42B6), SPH_C64(0x597F299CFC657E2A),
+	SPH_C64(0x5FCB6FAB3AD6FAEC), SPH_C64(0x6C44198C4A475817)
+};
+
+static const sph_u64 H512_4way[8] = {
+	SPH_C64(0x6A09E667F3BCC908), SPH_C64(0xBB67AE8584CAA73B),
+	SPH_C64(0x3C6EF372FE94F82B), SPH_C64(0xA54FF53A5F1D36F1),
+	SPH_C64(0x510E527FADE682D1), SPH_C64(0x9B05688C2B3E6C1F),
+	SPH_C64(0x1F83D9ABFB41BD6B), SPH_C64(0x5BE0CD19137E2179)
+};
+
+/*
+ * One SHA-512 compression of the 128 byte block at blk[i] into the
+ * state of each lane.
+ */
+static SPH_AVX2_TARGET void
+sha512_4way_comp(__m256i val[8], const unsigned char *const blk[4])
+{
+	__m256i W[80];
+	__m256i A, B, C, D, E, F, G, H, T1, T2;
+	int i;
+
+	for (i = 0; i < 16; i ++)
+		W[i] = SET4(sph_dec64be(blk[0] + 8 * i),
+			sph_dec64be(blk[1] + 8 * i),
+			sph_dec64be(blk[2] + 8 * i),
+			sph_dec64be(blk[3] + 8 * i));
+	for (i = 16; i < 80; i ++) {
+		__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(
+			ROTR4(W[i - 15], 1), ROTR4(W[i - 15], 8)),
+			_mm256_srli_epi64(W[i - 15], 7));
+		__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(
+			ROTR4(W[i - 2], 19), ROTR4(W[i - 2], 61)),
+			_mm256_srli_epi64(W[i - 2], 6));
+		W[i] = _mm256_add_epi64(_mm256_add_epi64(s1, W[i - 7]),
+			_mm256_add_epi64(s0, W[i - 16]));
+	}
+
+	A = val[0]; B = val[1]; C = val[2]; D = val[3];
+	E = val[4]; F = val[5]; G = val[6]; H = val[7];
+	for (i = 0; i < 80; i ++) {
+		__m256i bsg1 = _mm256_xor_si256(_mm256_xor_si256(
+			ROTR4(E, 14), ROTR4(E, 18)), ROTR4(E, 41));
+		__m256i ch = _mm256_xor_si256(_mm256_and_si256(E, F),
+			_mm256_andnot_si256(E, G));
+		__m256i bsg0 = _mm256_xor_si256(_mm256_xor_si256(
+			ROTR4(A, 28), ROTR4(A, 34)), ROTR4(A, 39));
+		__m256i maj = _mm256_or_si256(_mm256_and_si256(A, B),
+			_mm256_and_si256(C, _mm256_or_si256(A, B)));
+
+		T1 = _mm256_add_epi64(_mm256_add_epi64(H, bsg1),
+			_mm256_add_epi64(ch, _mm256_add_epi64(W[i],
+			_mm256_set1_epi64x((long long)K512_4way[i]))));
+		T2 = _mm256_add_epi64(bsg0, maj);
+		H = G; G = F; F = E;
+		E = _mm256_add_epi64(D, T1);
+		D = C; C = B; B = A;
+		A = _mm256_add_epi64(T1, T2);
+	}
+	val[0] = _mm256_add_epi64(val[0], A);
+	val[1] = _mm256_add_epi64(val[1], B);
+	val[2] = _mm256_add_epi64(val[2], C);
+	val[3] = _mm256_add_epi64(val[3], D);
+	val[4] = _mm256_add_epi64(val[4], E);
+	val[5] = _mm256_add_epi64(val[5], F);
+	val[6] = _mm256_add_epi64(val[6], G);
+	val[7] = _mm256_add_epi64(val[7], H);
+}
+
+static SPH_AVX2_TARGET void
+sha512_4way_avx2(const void *const data[4], size_t len, void *const dst[4])
+{
+	__m256i val[8];
+	unsigned char tail[4][256];
+	const unsigned char *blk[4];
+	size_t off, rem, tail_len;
+	sph_u64 out[8][4];
+	int i, j;
+
+	for (i = 0; i < 8; i ++)
+		val[i] = _mm256_set1_epi64x((long long)H512_4way[i]);
+
+	for (off = 0; off + 128 <= len; off += 128) {
+		for (j = 0; j < 4; j ++)
+			blk[j] = (const unsigned char *)data[j] + off;
+		sha512_4way_comp(val, blk);
+	}
+
+	/* 0x80, zeros and the 128 bit bit length end the last block or two */
+	rem = len - off;
+	tail_len = rem < 112 ? 128 : 256;
+	for (j = 0; j < 4; j ++) {
+		memset(tail[j], 0, tail_len);
+		memcpy(tail[j], (const unsigned char *)data[j] + off, rem);
+		tail[j][rem] = 0x80;
+		sph_enc64be(tail[j] + tail_len - 16, (sph_u64)(len >> 61));
+		sph_enc64be(tail[j] + tail_len - 8, (sph_u64)len << 3);
+		blk[j] = tail[j];
+	}
+	sha512_4way_comp(val, blk);
+	if (tail_len == 256) {
+		for (j = 0; j < 4; j ++)
+			blk[j] = tail[j] + 128;
+		sha512_4way_comp(val, blk);
+	}
+
+	for (i = 0; i < 8; i ++)
+		_mm256_storeu_si256((__m256i *)out[i], val[i]);
+	for (j = 0; j < 4; j ++)
+		for (i = 0; i < 8; i ++)
+			sph_enc64be((unsigned char *)dst[j] + 8 * i, out[i][j]);
+}
+
+static const sph_u64 RC_4way[24] = {
+	SPH_C64(0x0000000000000001), SPH_C64(0x0000000000008082),
+	SPH_C64(0x800000000000808A), SPH_C64(0x8000000080008000),
+	SPH_C64(0x000000000000808B), SPH_C64(0x0000000080000001),
+	SPH_C64(0x8000000080008081), SPH_C64(0x8000000000008009),
+	SPH_C64(0x000000000000008A), SPH_C64(0x0000000000000088),
+	SPH_C64(0x0000000080008009), SPH_C64(0x000000008000000A),
+	SPH_C64(0x000000008000808B), SPH_C64(0x800000000000008B),
+	SPH_C64(0x8000000000008089), SPH_C64(0x8000000000008003),
+	SPH_C64(0x8000000000008002), SPH_C64(0x8000000000000080),
+	SPH_C64(0x000000000000800A), SPH_C64(0x800000008000000A),
+	SPH_C64(0x8000000080008081), SPH_C64(0x8000000000008080),
+	SPH_C64(0x0000000080000001), SPH_C64(0x8000000080008008)
+};
+
+#define XOR5_4WAY(a, b, c, d, e) \
+	_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), \
+		_mm256_xor_si256(c, d)), e)
+#define CHI_4WAY(a, b, c) \
+	_mm256_xor_si256(a, _mm256_andnot_si256(b, c))
+
+/*
+ * Keccak-f[1600] on the state of each lane, A[x + 5 * y] holding
+ * word (x, y). The round is written out so the state stays in registers.
+ */
+static SPH_AVX2_TARGET void
+keccak_4way_f(__m256i A[25])
+{
+	__m256i B00, B01, B02, B03, B04, B05, B06, B07, B08, B09, B10, B11, B12,
+		B13, B14, B15, B16, B17, B18, B19, B20, B21, B22, B23, B24;
+	__m256i C0, C1, C2, C3, C4, D0, D1, D2, D3, D4;
+	int r;
+
+	for (r = 0; r < 24; r ++) {
+		C0 = XOR5_4WAY(A[0], A[5], A[10], A[15], A[20]);
+		C1 = XOR5_4WAY(A[1], A[6], A[11], A[16], A[21]);
+		C2 = XOR5_4WAY(A[2], A[7], A[12], A[17], A[22]);
+		C3 = XOR5_4WAY(A[3], A[8], A[13], A[18], A[23]);
+		C4 = XOR5_4WAY(A[4], A[9], A[14], A[19], A[24]);
+		D0 = _mm256_xor_si256(C4, ROTL4(C1, 1));
+		D1 = _mm256_xor_si256(C0, ROTL4(C2, 1));
+		D2 = _mm256_xor_si256(C1, ROTL4(C3, 1));
+		D3 = _mm256_xor_si256(C2, ROTL4(C4, 1));
+		D4 = _mm256_xor_si256(C3, ROTL4(C0, 1));
+
+		/* theta, then rho and pi: word (x, y) moves to (y, 2x + 3y) */
+		B00 = _mm256_xor_si256(A[0], D0);
+		B16 = ROTL4(_mm256_xor_si256(A[5], D0), 36);
+		B07 = ROTL4(_mm256_xor_si256(A[10], D0), 3);
+		B23 = ROTL4(_mm256_xor_si256(A[15], D0), 41);
+		B14 = ROTL4(_mm256_xor_si256(A[20], D0), 18);
+		B10 = ROTL4(_mm256_xor_si256(A[1], D1), 1);
+		B01 = ROTL4(_mm256_xor_si256(A[6], D1), 44);
+		B17 = ROTL4(_mm256_xor_si256(A[11], D1), 10);
+		B08 = ROTL4(_mm256_xor_si256(A[16], D1), 45);
+		B24 = ROTL4(_mm256_xor_si256(A[21], D1), 2);
+		B20 = ROTL4(_mm256_xor_si256(A[2], D2), 62);
+		B11 = ROTL4(_mm256_xor_si256(A[7], D2), 6);
+		B02 = ROTL4(_mm256_xor_si256(A[12], D2), 43);
+		B18 = ROTL4(_mm256_xor_si256(A[17], D2), 15);
+		B09 = ROTL4(_mm256_xor_si256(A[22], D2), 61);
+		B05 = ROTL4(_mm256_xor_si256(A[3], D3), 28);
+		B21 = ROTL4(_mm256_xor_si256(A[8], D3), 55);
+		B12 = ROTL4(_mm256_xor_si256(A[13], D3), 25);
+		B03 = ROTL4(_mm256_xor_si256(A[18], D3), 21);
+		B19 = ROTL4(_mm256_xor_si256(A[23], D3), 56);
+		B15 = ROTL4(_mm256_xor_si256(A[4], D4), 27);
+		B06 = ROTL4(_mm256_xor_si256(A[9], D4), 20);
+		B22 = ROTL4(_mm256_xor_si256(A[14], D4), 39);
+		B13 = ROTL4(_mm256_xor_si256(A[19], D4), 8);
+		B04 = ROTL4(_mm256_xor_si256(A[24], D4), 14);
+
+		/* chi */
+		A[0] = CHI_4WAY(B00, B01, B02);
+		A[1] = CHI_4WAY(B01, B02, B03);
+		A[2] = CHI_4WAY(B02, B03, B04);
+		A[3] = CHI_4WAY(B03, B04, B00);
+		A[4] = CHI_4WAY(B04, B00, B01);
+		A[5] = CHI_4WAY(B05, B06, B07);
+		A[6] = CHI_4WAY(B06, B07, B08);
+		A[7] = CHI_4WAY(B07, B08, B09);
+		A[8] = CHI_4WAY(B08, B09, B05);
+		A[9] = CHI_4WAY(B09, B05, B06);
+		A[10] = CHI_4WAY(B10, B11, B12);
+		A[11] = CHI_4WAY(B11, B12, B13);
+		A[12] = CHI_4WAY(B12, B13, B14);
+		A[13] = CHI_4WAY(B13, B14, B10);
+		A[14] = CHI_4WAY(B14, B10, B11);
+		A[15] = CHI_4WAY(B15, B16, B17);
+		A[16] = CHI_4WAY(B16, B17, B18);
+		A[17] = CHI_4WAY(B17, B18, B19);
+		A[18] = CHI_4WAY(B18, B19, B15);
+		A[19] = CHI_4WAY(B19, B15, B16);
+		A[20] = CHI_4WAY(B20, B21, B22);
+		A[21] = CHI_4WAY(B21, B22, B23);
+		A[22] = CHI_4WAY(B22, B23, B24);
+		A[23] = CHI_4WAY(B23, B24, B20);
+		A[24] = CHI_4WAY(B24, B20, B21);
+
+		A[0] = _mm256_xor_si256(A[0],
+			_mm256_set1_epi64x((long long)RC_4way[r]));
+	}
+}
+
+static SPH_AVX2_TARGET void
+keccak512_4way_absorb(__m256i A[25], const unsigned char *const blk[4])
+{
+	int i;
+
+	for (i = 0; i < 9; i ++)
+		A[i] = _mm256_xor_si256(A[i], SET4(sph_dec64le(blk[0] + 8 * i),
+			sph_dec64le(blk[1] + 8 * i),
+			sph_dec64le(blk[2] + 8 * i),
+			sph_dec64le(blk[3] + 8 * i)));
+	keccak_4way_f(A);
+}
+
+static SPH_AVX2_TARGET void
+keccak512_4way_avx2(const void *const data[4], size_t len, void *const dst[4])
+{
+	/* Keccak-512 absorbs 72 bytes (nine words) per permutation */
+	__m256i A[25];
+	unsigned char tail[4][72];
+	const unsigned char *blk[4];
+	size_t off, rem;
+	sph_u64 out[8][4];
+	int i, j;
+
+	for (i = 0; i < 25; i ++)
+		A[i] = _mm256_setzero_si256();
+
+	for (off = 0; off + 72 <= len; off += 72) {
+		for (j = 0; j < 4; j ++)
+			blk[j] = (const unsigned char *)data[j] + off;
+		keccak512_4way_absorb(A, blk);
+	}
+
+	/* the original Keccak padding, as sph_keccak512 uses it */
+	rem = len - off;
+	for (j = 0; j < 4; j ++) {
+		memset(tail[j], 0, sizeof tail[j]);
+		memcpy(tail[j], (const unsigned char *)data[j] + off, rem);
+		tail[j][rem] |= 0x01;
+		tail[j][71] |= 0x80;
+		blk[j] = tail[j];
+	}
+	keccak512_4way_absorb(A, blk);
+
+	for (i = 0; i < 8; i ++)
+		_mm256_storeu_si256((__m256i *)out[i], A[i]);
+	for (j = 0; j < 4; j ++)
+		for (i = 0; i < 8; i ++)
+			sph_enc64le((unsigned char *)dst[j] + 8 * i, out[i][j]);
+}
+
+#endif
+
+/* see sph_4way.h */
+void
+sph_sha512_4way(const void *const data[SPH_4WAY_LANES], size_t len,
+	void *const dst[SPH_4WAY_LANES])
+{
+	sph_sha512_context cc;
+	int j;
+
+#if SPH_AVX2
+	if (sph_avx2_enabled()) {
+		sha512_4way_avx2(data, len, dst);
+		return;
+	}
+#endif
+	for (j = 0; j < SPH_4WAY_LANES; j ++) {
+		sph_sha512_init(&cc);
+		sph_sha512(&cc, data[j], len);
+		sph_sha512_close(&cc, dst[j]);
+	}
+}
+
+/* see sph_4way.h */
+void
+sph_keccak512_4way(const void *const data[SPH_4WAY_LANES], size_t len,
+	void *const dst[SPH_4WAY_LANES])
+{
+	sph_keccak512_context cc;
+	int j;
+
+#if SPH_AVX2
+	if (sph_avx2_enabled()) {
+		keccak512_4way_avx2(data, len, dst);
+		return;
+	}
+#endif
+	for (j = 0; j < SPH_4WAY_LANES; j ++) {
+		sph_keccak512_init(&cc);
+		sph_keccak512(&cc, data[j], len);
+		sph_keccak512_close(&cc, dst[j]);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
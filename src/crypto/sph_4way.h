@@ -0,0 +1,87 @@
+/**
+ * Four lane versions of the SHA-512 and Keccak-512 functions, which hash
+ * four independent messages of the same length at once. Both functions
+ * work on 64 bit words, so on x86 CPUs with AVX2 each 256 bit register
+ * holds the same word of all four lanes and every instruction advances
+ * the four hashes together. Elsewhere, or with the AVX2 paths disabled,
+ * the lanes are hashed one after the other with the sph functions. The
+ * output is identical either way.
+ *
+ * The AVX2 paths are compiled with per-function target attributes, so
+ * the rest of the build does not need -mavx2 and the binary still runs on
+ * CPUs without the extension.
+ *
+ * @file     sph_4way.h
+ */
+
+#ifndef SPH_4WAY_H__
+#define SPH_4WAY_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#if (defined __x86_64__ || defined __i386__) \
+	&& (defined __clang__ || (defined __GNUC__ \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SPH_AVX2   1
+#else
+#define SPH_AVX2   0
+#endif
+
+#if SPH_AVX2
+#define SPH_AVX2_TARGET   __attribute__((target("avx2")))
+#endif
+
+/**
+ * Number of messages the four lane functions hash at once.
+ */
+#define SPH_4WAY_LANES   4
+
+/**
+ * Return non-zero if the AVX2 code paths are in use: the CPU and the
+ * operating system support AVX2 and they have not been disabled with
+ * <code>sph_avx2_set_enabled()</code>.
+ */
+int sph_avx2_enabled(void);
+
+/**
+ * Disable (<code>enabled == 0</code>) the AVX2 code paths, or enable
+ * them again if the CPU supports them. This is meant for tests and
+ * benchmarks comparing both paths; it must not be called while another
+ * thread is hashing.
+ */
+void sph_avx2_set_enabled(int enabled);
+
+/**
+ * Compute the SHA-512 hash of the <code>len</code> bytes at
+ * <code>data[i]</code> into the 64 bytes at <code>dst[i]</code>, for
+ * each of the four lanes. Lanes may share an input or an output buffer,
+ * but no output may overlap an input.
+ *
+ * @param data   the input data of each lane
+ * @param len    the input length (in bytes), the same for every lane
+ * @param dst    the destination buffer of each lane
+ */
+void sph_sha512_4way(const void *const data[SPH_4WAY_LANES], size_t len,
+	void *const dst[SPH_4WAY_LANES]);
+
+/**
+ * Compute the Keccak-512 hash (as <code>sph_keccak512</code>) of the
+ * <code>len</code> bytes at <code>data[i]</code> into the 64 bytes at
+ * <code>dst[i]</code>, for each of the four lanes.
+ *
+ * @param data   the input data of each lane
+ * @param len    the input length (in bytes), the same for every lane
+ * @param dst    the destination buffer of each lane
+ */
+void sph_keccak512_4way(const void *const data[SPH_4WAY_LANES], size_t len,
+	void *const dst[SPH_4WAY_LANES]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * CPU detection for the AES-NI code paths, see sph_aesni.h.
+ */
+
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <cpuid.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* -1 until the CPU has been probed, then 0 or 1 */
+static volatile int aesni_state = -1;
+
+static int
+aesni_supported(void)
+{
+#if SPH_AESNI
+	unsigned eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ecx & bit_AES) != 0 && (ecx & bit_SSSE3) != 0;
+#else
+	return 0;
+#endif
+}
+
+/* see sph_aesni.h */
+int
+sph_aesni_enabled(void)
+{
+	int state = aesni_state;
+
+	/* probing is idempotent, so threads racing here all store the same value */
+	if (state < 0)
+		aesni_state = state = aesni_supported();
+	return state;
+}
+
+/* see sph_aesni.h */
+void
+sph_aesni_set_enabled(int enabled)
+{
+	aesni_state = enabled ? aesni_supported() : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
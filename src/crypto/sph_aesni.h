@@ -0,0 +1,53 @@
+/**
+ * Runtime selection of the AES-NI code paths of the groestl, echo and
+ * shavite implementations. Those three functions are built on AES rounds
+ * (or the AES S-box); on x86 CPUs with the AES-NI and SSSE3 extensions
+ * their compression functions use the AES instructions instead of the
+ * lookup tables. The output is identical either way.
+ *
+ * The AES-NI paths are compiled with per-function target attributes, so
+ * the rest of the build does not need -maes and the binary still runs on
+ * CPUs without the extension.
+ *
+ * @file     sph_aesni.h
+ */
+
+#ifndef SPH_AESNI_H__
+#define SPH_AESNI_H__
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#if (defined __x86_64__ || defined __i386__) \
+	&& (defined __clang__ || (defined __GNUC__ \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SPH_AESNI   1
+#else
+#define SPH_AESNI   0
+#endif
+
+#if SPH_AESNI
+#define SPH_AESNI_TARGET   __attribute__((target("aes,ssse3")))
+#endif
+
+/**
+ * Return non-zero if the AES-NI code paths are in use: the CPU supports
+ * AES-NI and SSSE3 and they have not been disabled with
+ * <code>sph_aesni_set_enabled()</code>.
+ */
+int sph_aesni_enabled(void);
+
+/**
+ * Disable (<code>enabled == 0</code>) the AES-NI code paths, or enable
+ * them again if the CPU supports them. This is meant for tests and
+ * benchmarks comparing both paths; it must not be called while another
+ * thread is hashing.
+ */
+void sph_aesni_set_enabled(int enabled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,8 +34,10 @@ public:
 	 */
     AccumulatorProofOfKnowledge(const AccumulatorAndProofParams* p, const Commitment& commitmentToCoin, const AccumulatorWitness& witness);
 	/** Verifies that  a commitment c is accumulated in accumulated a
+	 * @param fFixedBaseQRN take the g_n and h_n powers from the fixed-base tables of the params,
+	 *        worth it when many proofs are verified (see BatchVerify)
 	 */
-	bool Verify(const Accumulator& a,const CBigNum& valueOfCommitmentToCoin) const;
+	bool Verify(const Accumulator& a,const CBigNum& valueOfCommitmentToCoin, bool fFixedBaseQRN = false) const;
 	
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -104,6 +104,40 @@ bool CoinSpend::Verify(const Accumulator& a, bool verifyParams) const
     return true;
 }
 
+bool BatchVerify(const Accumulator& a, const std::vector<const CoinSpend*>& vSpends, bool verifyParams)
+{
+    if (vSpends.empty())
+        return true;
+
+    // Shared inputs: every spend must reference this accumulator
+    const uint32_t nChecksum = vSpends.front()->accChecksum;
+    for (const CoinSpend* spend : vSpends) {
+        if (spend->accChecksum != nChecksum || spend->denomination != a.getDenomination())
+            return false;
+
+        if (ExtractVersionFromSerial(spend->coinSerialNumber) != spend->version)
+            return false;
+    }
+
+    // Cheapest proof first, the serial number signature of knowledge last
+    for (const CoinSpend* spend : vSpends) {
+        if (!spend->commitmentPoK.Verify(spend->serialCommitmentToCoinValue, spend->accCommitmentToCoinValue))
+            return false;
+    }
+
+    for (const CoinSpend* spend : vSpends) {
+        if (!spend->accumulatorPoK.Verify(a, spend->accCommitmentToCoinValue, true))
+            return false;
+    }
+
+    for (const CoinSpend* spend : vSpends) {
+        if (!spend->serialNumberSoK.Verify(spend->coinSerialNumber, spend->serialCommitmentToCoinValue, spend->signatureHash(), verifyParams))
+            return false;
+    }
+
+    return true;
+}
+
 const uint256 CoinSpend::signatureHash() const
 {
     CHashWriter h(0, 0);
@@ -151,6 +151,8 @@ public:
     }
 
 private:
+    friend bool BatchVerify(const Accumulator& a, const std::vector<const CoinSpend*>& vSpends, bool verifyParams);
+
     CoinDenomination denomination;
     uint32_t accChecksum;
     uint256 ptxHash;
@@ -168,5 +170,26 @@ private:
     SpendType spendType;
 };
 
+/** Verifies several spends that reference the same accumulator.
+ *
+ * All spends must be of the accumulator's denomination and carry the same
+ * accumulator checksum. The shared inputs are checked once, then each kind of
+ * sub-proof is verified for the whole batch before moving on to the next, more
+ * expensive one, so a batch containing an invalid spend is rejected early.
+ *
+ * Every proof is still checked individually: the group elements in the proofs are
+ * not known to lie in the prime order / quadratic residue subgroups, so a
+ * randomized linear combination could accept a batch that contains a proof the
+ * single spend verifier rejects. What the spends share are the bases: the g_n and
+ * h_n powers of the accumulator proofs, about half of their cost, come from
+ * fixed-base tables that are built once and then used by every batch.
+ *
+ * @param a the accumulator the spends were made against
+ * @param vSpends the spends to verify
+ * @param verifyParams whether to range check the serials and commitments
+ * @return true if every spend verifies
+ */
+bool BatchVerify(const Accumulator& a, const std::vector<const CoinSpend*>& vSpends, bool verifyParams = true);
+
 } /* namespace libzerocoin */
 #endif /* COINSPEND_H_ */
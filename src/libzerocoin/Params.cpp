@@ -14,8 +14,13 @@
 #include "Params.h"
 #include "ParamGeneration.h"
 
+#include <mutex>
+
 namespace libzerocoin {
 
+//! Guards building the fixed-base tables cached on the params
+static std::mutex csParamsCache;
+
 ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	this->zkp_hash_len = securityLevel;
 	this->zkp_iterations = securityLevel;
@@ -26,6 +31,11 @@ ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	// Generate the parameters
 	CalculateParams(*this, N, ZEROCOIN_PROTOCOL_VERSION, securityLevel);
 
+	// Build the fixed-base tables used by commitments and proofs
+	this->coinCommitmentGroup.precomputeTables();
+	this->serialNumberSoKCommitmentGroup.precomputeTables();
+	this->accumulatorParams.accumulatorPoKCommitmentGroup.precomputeTables();
+
 	this->accumulatorParams.initialized = true;
 	this->initialized = true;
 }
@@ -34,6 +44,31 @@ AccumulatorAndProofParams::AccumulatorAndProofParams() {
 	this->initialized = false;
 }
 
+CBigNum AccumulatorAndProofParams::qrnFixedPowMod(std::shared_ptr<const CBigNumFixedBase>& table, const CBigNum& base, const CBigNum& e) const {
+	const CBigNum& modulus = this->accumulatorModulus;
+	std::shared_ptr<const CBigNumFixedBase> current = std::atomic_load(&table);
+	if (!current || !current->matches(base, modulus)) {
+		std::lock_guard<std::mutex> lock(csParamsCache);
+		current = std::atomic_load(&table);
+		if (!current || !current->matches(base, modulus)) {
+			// The largest responses are s_beta and s_delta, of about |N| + k' + k'' + |p| bits plus the challenge
+			unsigned int nMaxExpBits = modulus.bitSize() + this->k_prime + this->k_dprime +
+			                           this->accumulatorPoKCommitmentGroup.modulus.bitSize() + 256;
+			current = std::make_shared<const CBigNumFixedBase>(base, modulus, nMaxExpBits, 4);
+			std::atomic_store(&table, current);
+		}
+	}
+	return current->pow_mod_fixed(e);
+}
+
+CBigNum AccumulatorAndProofParams::qrnGPowMod(const CBigNum& e) const {
+	return qrnFixedPowMod(this->qrnGTable, this->accumulatorQRNCommitmentGroup.g, e);
+}
+
+CBigNum AccumulatorAndProofParams::qrnHPowMod(const CBigNum& e) const {
+	return qrnFixedPowMod(this->qrnHTable, this->accumulatorQRNCommitmentGroup.h, e);
+}
+
 IntegerGroupParams::IntegerGroupParams() {
 	this->initialized = false;
 }
@@ -42,7 +77,37 @@ CBigNum IntegerGroupParams::randomElement() const {
 	// The generator of the group raised
 	// to a random number less than the order of the group
 	// provides us with a uniformly distributed random number.
-	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
+	return this->gPowMod(CBigNum::randBignum(this->groupOrder));
+}
+
+CBigNum IntegerGroupParams::fixedPowMod(std::shared_ptr<const CBigNumFixedBase>& table, const CBigNum& base, const CBigNum& e) const {
+	// Hidden order groups (e.g. the QRN group) cannot reduce the exponent
+	if (this->groupOrder <= 0 || !this->modulus.isOdd())
+		return base.pow_mod(e, this->modulus);
+
+	std::shared_ptr<const CBigNumFixedBase> current = std::atomic_load(&table);
+	if (!current || !current->matches(base, this->modulus)) {
+		std::lock_guard<std::mutex> lock(csParamsCache);
+		current = std::atomic_load(&table);
+		if (!current || !current->matches(base, this->modulus)) {
+			current = std::make_shared<const CBigNumFixedBase>(base, this->modulus, this->groupOrder);
+			std::atomic_store(&table, current);
+		}
+	}
+	return current->pow_mod_fixed(e);
+}
+
+CBigNum IntegerGroupParams::gPowMod(const CBigNum& e) const {
+	return fixedPowMod(this->gTable, this->g, e);
+}
+
+CBigNum IntegerGroupParams::hPowMod(const CBigNum& e) const {
+	return fixedPowMod(this->hTable, this->h, e);
+}
+
+void IntegerGroupParams::precomputeTables() const {
+	gPowMod(CBigNum(0));
+	hPowMod(CBigNum(0));
 }
 
 } /* namespace libzerocoin */
@@ -17,6 +17,8 @@
 #include "bignum.h"
 #include "ZerocoinDefines.h"
 
+#include <memory>
+
 namespace libzerocoin {
 
 class IntegerGroupParams {
@@ -32,6 +34,28 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Computes g^e mod modulus using the precomputed
+	 * fixed-base table for g.
+	 * @return g^e mod modulus
+	 */
+	CBigNum gPowMod(const CBigNum& e) const;
+
+	/**
+	 * Computes h^e mod modulus using the precomputed
+	 * fixed-base table for h.
+	 * @return h^e mod modulus
+	 */
+	CBigNum hPowMod(const CBigNum& e) const;
+
+	/**
+	 * Builds the fixed-base tables for g and h. Called once the
+	 * parameters are known; gPowMod/hPowMod build them on demand
+	 * otherwise. Groups of unknown order keep using pow_mod.
+	 */
+	void precomputeTables() const;
+
 	bool initialized;
 
 	/**
@@ -56,6 +80,17 @@ public:
 	 */
 	CBigNum groupOrder;
 
+private:
+	/**
+	 * Fixed-base tables for g and h. Not serialized and shared
+	 * between copies; rebuilt if g, h or modulus change.
+	 */
+	mutable std::shared_ptr<const CBigNumFixedBase> gTable;
+	mutable std::shared_ptr<const CBigNumFixedBase> hTable;
+
+	CBigNum fixedPowMod(std::shared_ptr<const CBigNumFixedBase>& table, const CBigNum& base, const CBigNum& e) const;
+
+public:
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 		    READWRITE(initialized);
@@ -139,6 +174,22 @@ public:
 	 * The statistical zero-knowledgeness of the accumulator proof.
 	 */
 	uint32_t k_dprime;
+
+	/**
+	 * g_n^e and h_n^e mod the accumulator modulus for the QRN group generators, through
+	 * fixed-base tables covering the exponents of accumulator proofs of knowledge. The
+	 * tables take a few MB, so they are only built when a batch of spends is first verified.
+	 */
+	CBigNum qrnGPowMod(const CBigNum& e) const;
+	CBigNum qrnHPowMod(const CBigNum& e) const;
+
+private:
+	mutable std::shared_ptr<const CBigNumFixedBase> qrnGTable;
+	mutable std::shared_ptr<const CBigNumFixedBase> qrnHTable;
+
+	CBigNum qrnFixedPowMod(std::shared_ptr<const CBigNumFixedBase>& table, const CBigNum& base, const CBigNum& e) const;
+
+public:
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 	    READWRITE(initialized);
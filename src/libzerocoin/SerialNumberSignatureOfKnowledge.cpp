@@ -48,11 +48,6 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
     if (params->coinCommitmentGroup.modulus != params->serialNumberSoKCommitmentGroup.groupOrder)
         throw std::runtime_error("Groups are not structured correctly.");
 
-    CBigNum a = params->coinCommitmentGroup.g;
-    CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
     CHashWriter hasher(0,0);
     hasher << *params << commitmentToCoin.getCommitmentValue() << coin.getSerialNumber() << msghash;
 
@@ -103,7 +98,7 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
         } else {
             s_notprime[i]       = r[i] - coin.getRandomness();
             sprime[i]           = v_expanded[i] - (commitmentToCoin.getRandomness() *
-                    b.pow_mod(r[i] - coin.getRandomness(), params->serialNumberSoKCommitmentGroup.groupOrder));
+                    params->coinCommitmentGroup.hPowMod(r[i] - coin.getRandomness()));
         }
     }
 }
@@ -111,24 +106,15 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
         const CBigNum& h_exp) const {
 
-    CBigNum a = params->coinCommitmentGroup.g;
-    CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
-    CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder) *
-            b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+    // a and b live in coinCommitmentGroup, whose modulus is the order of serialNumberSoKCommitmentGroup
+    CBigNum exponent = (params->coinCommitmentGroup.gPowMod(a_exp) *
+            params->coinCommitmentGroup.hPowMod(b_exp)) % params->serialNumberSoKCommitmentGroup.groupOrder;
 
-    return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+    return (params->serialNumberSoKCommitmentGroup.gPowMod(exponent) * params->serialNumberSoKCommitmentGroup.hPowMod(h_exp)) % params->serialNumberSoKCommitmentGroup.modulus;
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
         const uint256 msghash, bool isInParamsValidationRange) const {
-    CBigNum a = params->coinCommitmentGroup.g;
-    CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
     //// Params validation.
     if(isInParamsValidationRange) {
         // Check that the serial is within the max size
@@ -158,10 +144,10 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
                     return error("SoK Verify() :: sprime in pos %d not in valid range", i);
                 tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn);
             } else {
-                CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
+                CBigNum exp = params->coinCommitmentGroup.hPowMod(s_notprime[i]);
                 tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) %
                               params->serialNumberSoKCommitmentGroup.modulus) *
-                             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) %
+                             (params->serialNumberSoKCommitmentGroup.hPowMod(sprime[i]) %
                               params->serialNumberSoKCommitmentGroup.modulus)) %
                             params->serialNumberSoKCommitmentGroup.modulus;
             }
@@ -11,6 +11,7 @@
 #include "config/beetlecoin-config.h"
 #endif
 
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 #include <limits.h>
@@ -21,6 +22,8 @@
 #include "version.h"
 #include "random.h"
 
+#include <boost/thread/tss.hpp>
+
 /** Errors thrown by the bignum class */
 class bignum_error : public std::runtime_error
 {
@@ -28,30 +31,106 @@ public:
     explicit bignum_error(const std::string& str) : std::runtime_error(str) {}
 };
 
-/** RAII encapsulated BN_CTX (OpenSSL bignum context) */
-class CAutoBN_CTX
+/**
+ * Per-thread OpenSSL bignum state, so that hot arithmetic does not allocate:
+ * one reusable BN_CTX and a small cache of Montgomery contexts for the moduli
+ * the thread exponentiates with most (the fixed zerocoin group moduli).
+ */
+class CBigNumThreadState
 {
-protected:
+private:
+    static const size_t MAX_MONT_CACHE_SIZE = 8;
+
+    struct MontEntry {
+        BIGNUM* modulus;
+        BN_MONT_CTX* mont;
+    };
+
     BN_CTX* pctx;
-    BN_CTX* operator=(BN_CTX* pnew) { return pctx = pnew; }
+    std::vector<MontEntry> vMontCache;
+    size_t nNextEvict;
+
+    CBigNumThreadState(const CBigNumThreadState&);
+    CBigNumThreadState& operator=(const CBigNumThreadState&);
 
 public:
-    CAutoBN_CTX()
+    CBigNumThreadState() : nNextEvict(0)
     {
         pctx = BN_CTX_new();
         if (pctx == NULL)
-            throw bignum_error("CAutoBN_CTX : BN_CTX_new() returned NULL");
+            throw bignum_error("CBigNumThreadState : BN_CTX_new() returned NULL");
+    }
+
+    ~CBigNumThreadState()
+    {
+        for (const MontEntry& entry : vMontCache) {
+            BN_clear_free(entry.modulus);
+            BN_MONT_CTX_free(entry.mont);
+        }
+        BN_CTX_free(pctx);
+    }
+
+    BN_CTX* GetCtx() { return pctx; }
+
+    /** Montgomery context for the odd modulus m, owned by this thread */
+    BN_MONT_CTX* GetMontCtx(const BIGNUM* m)
+    {
+        for (const MontEntry& entry : vMontCache) {
+            if (BN_cmp(entry.modulus, m) == 0)
+                return entry.mont;
+        }
+
+        MontEntry entry;
+        entry.modulus = BN_dup(m);
+        entry.mont = BN_MONT_CTX_new();
+        if (entry.modulus == NULL || entry.mont == NULL || !BN_MONT_CTX_set(entry.mont, m, pctx)) {
+            BN_clear_free(entry.modulus);
+            BN_MONT_CTX_free(entry.mont);
+            throw bignum_error("CBigNumThreadState::GetMontCtx : BN_MONT_CTX_set failed");
+        }
+
+        if (vMontCache.size() < MAX_MONT_CACHE_SIZE) {
+            vMontCache.push_back(entry);
+        } else {
+            // Replace entries in turn; callers only use the returned context until their next call
+            MontEntry& old = vMontCache[nNextEvict];
+            BN_clear_free(old.modulus);
+            BN_MONT_CTX_free(old.mont);
+            old = entry;
+            nNextEvict = (nNextEvict + 1) % MAX_MONT_CACHE_SIZE;
+        }
+        return entry.mont;
+    }
+
+    /** The calling thread's state, created on first use and freed when the thread exits */
+    static CBigNumThreadState& Get()
+    {
+        static boost::thread_specific_ptr<CBigNumThreadState> ptrState;
+        if (!ptrState.get())
+            ptrState.reset(new CBigNumThreadState());
+        return *ptrState;
     }
+};
+
+/** RAII encapsulated BN_CTX (OpenSSL bignum context)
+ *
+ * Borrows the calling thread's reusable context rather than allocating one.
+ * OpenSSL functions balance their own BN_CTX_start/BN_CTX_end, so nested
+ * CAutoBN_CTX instances on the same thread can share it.
+ */
+class CAutoBN_CTX
+{
+protected:
+    BN_CTX* pctx;
 
-    ~CAutoBN_CTX()
+public:
+    CAutoBN_CTX()
     {
-        if (pctx != NULL)
-            BN_CTX_free(pctx);
+        pctx = CBigNumThreadState::Get().GetCtx();
     }
 
     operator BN_CTX*() { return pctx; }
     BN_CTX& operator*() { return *pctx; }
-    BN_CTX** operator&() { return &pctx; }
     bool operator!() { return (pctx == NULL); }
 };
 
@@ -455,15 +534,105 @@ public:
             // g^-x = (g^-1)^x
             CBigNum inv = this->inverse(m);
             CBigNum posE = e * -1;
-            if (!BN_mod_exp(ret.bn, inv.bn, posE.bn, m.bn, pctx))
+            if (!inv.mod_exp(ret, posE, m, pctx))
                 throw bignum_error("CBigNum::pow_mod: BN_mod_exp failed on negative exponent");
         }else
-            if (!BN_mod_exp(ret.bn, bn, e.bn, m.bn, pctx))
+            if (!mod_exp(ret, e, m, pctx))
                 throw bignum_error("CBigNum::pow_mod : BN_mod_exp failed");
 
         return ret;
     }
 
+    /**
+     * simultaneous modular multi-exponentiation: prod(bases[i]^exps[i]) mod m
+     * Uses Straus' interleaved windowed method so the squarings are shared
+     * between all the terms. Negative exponents invert their base.
+     * @param bases bases
+     * @param exps exponents, one per base
+     * @param m modulus
+     */
+    static CBigNum multi_pow_mod(const std::vector<CBigNum>& bases, const std::vector<CBigNum>& exps, const CBigNum& m) {
+        if (bases.size() != exps.size())
+            throw bignum_error("CBigNum::multi_pow_mod : bases and exponents differ in size");
+
+        // Montgomery multiplication needs an odd modulus
+        if (!BN_is_odd(m.bn)) {
+            CBigNum ret = 1;
+            for (unsigned int i = 0; i < bases.size(); i++)
+                ret = ret.mul_mod(bases[i].pow_mod(exps[i], m), m);
+            return ret;
+        }
+
+        const unsigned int nWindowBits = 4;
+        const unsigned int nDigits = (1u << nWindowBits) - 1;
+
+        CAutoBN_CTX pctx;
+        BN_MONT_CTX* mont = CBigNumThreadState::Get().GetMontCtx(m.bn);
+
+        // Table of base^1 .. base^(2^w - 1) in Montgomery form for every term
+        std::vector<CBigNum> vExp(exps.size());
+        std::vector<CBigNum> vTable(bases.size() * nDigits);
+        int nMaxBits = 0;
+        for (unsigned int i = 0; i < bases.size(); i++) {
+            CBigNum base;
+            if (exps[i] < 0) {
+                base = bases[i].inverse(m);
+                vExp[i] = -exps[i];
+            } else {
+                if (!BN_nnmod(base.bn, bases[i].bn, m.bn, pctx))
+                    throw bignum_error("CBigNum::multi_pow_mod : BN_nnmod failed");
+                vExp[i] = exps[i];
+            }
+            nMaxBits = std::max(nMaxBits, vExp[i].bitSize());
+
+            CBigNum* row = &vTable[i * nDigits];
+            if (!BN_to_montgomery(row[0].bn, base.bn, mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_to_montgomery failed");
+            for (unsigned int j = 1; j < nDigits; j++) {
+                if (!BN_mod_mul_montgomery(row[j].bn, row[j - 1].bn, row[0].bn, mont, pctx))
+                    throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+            }
+        }
+
+        // Scan all exponents together from the top window down
+        CBigNum acc;
+        bool fFirst = true;
+        const int nWindows = (nMaxBits + nWindowBits - 1) / nWindowBits;
+        for (int w = nWindows - 1; w >= 0; w--) {
+            if (!fFirst) {
+                for (unsigned int k = 0; k < nWindowBits; k++) {
+                    if (!BN_mod_mul_montgomery(acc.bn, acc.bn, acc.bn, mont, pctx))
+                        throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+                }
+            }
+            for (unsigned int i = 0; i < vExp.size(); i++) {
+                unsigned int digit = 0;
+                for (unsigned int b = 0; b < nWindowBits; b++) {
+                    if (BN_is_bit_set(vExp[i].bn, w * nWindowBits + b))
+                        digit |= 1u << b;
+                }
+                if (digit == 0)
+                    continue;
+                const CBigNum& entry = vTable[i * nDigits + digit - 1];
+                if (fFirst) {
+                    acc = entry;
+                    fFirst = false;
+                } else if (!BN_mod_mul_montgomery(acc.bn, acc.bn, entry.bn, mont, pctx)) {
+                    throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+                }
+            }
+        }
+
+        CBigNum ret = 1;
+        if (fFirst) {
+            // All exponents were zero
+            ret = ret % m;
+        } else if (!BN_from_montgomery(ret.bn, acc.bn, mont, pctx)) {
+            throw bignum_error("CBigNum::multi_pow_mod : BN_from_montgomery failed");
+        }
+        return ret;
+    }
+
    /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -523,6 +692,10 @@ public:
         return BN_is_one(bn);
     }
 
+    bool isOdd() const {
+        return BN_is_odd(bn);
+    }
+
 
 
     bool operator!() const
@@ -623,6 +796,16 @@ public:
         return ret;
     }
 
+private:
+    /** ret = this^e mod m for non-negative e, reusing the thread's Montgomery context for odd m */
+    bool mod_exp(CBigNum& ret, const CBigNum& e, const CBigNum& m, BN_CTX* pctx) const {
+        if (!BN_is_odd(m.bn))
+            return BN_mod_exp(ret.bn, bn, e.bn, m.bn, pctx);
+        BN_MONT_CTX* mont = CBigNumThreadState::Get().GetMontCtx(m.bn);
+        return BN_mod_exp_mont(ret.bn, bn, e.bn, m.bn, pctx, mont);
+    }
+
+public:
     friend inline const CBigNum operator+(const CBigNum& a, const CBigNum& b);
     friend inline const CBigNum operator-(const CBigNum& a, const CBigNum& b);
     friend inline const CBigNum operator/(const CBigNum& a, const CBigNum& b);
@@ -636,6 +819,7 @@ public:
     friend inline bool operator>=(const CBigNum& a, const CBigNum& b);
     friend inline bool operator<(const CBigNum& a, const CBigNum& b);
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
+    friend class CBigNumFixedBase;
 };
 
 inline const CBigNum operator+(const CBigNum& a, const CBigNum& b)
@@ -711,6 +895,156 @@ inline bool operator<(const CBigNum& a, const CBigNum& b)  { return (BN_cmp(a.bn
 inline bool operator>(const CBigNum& a, const CBigNum& b)  { return (BN_cmp(a.bn, b.bn) > 0); }
 inline std::ostream& operator<<(std::ostream &strm, const CBigNum &b) { return strm << b.ToString(10); }
 
+/** Precomputed powers of a fixed base for repeated modular exponentiation.
+ *
+ * For a base g of known order q modulo an odd m, stores
+ * g^(j * 2^(w*i)) mod m (in Montgomery form) for every w-bit window i of an
+ * exponent below q and every non-zero digit j. g^e mod m then costs at most
+ * bits(q)/w Montgomery multiplications and no squarings, instead of the
+ * ~bits(e) squarings BN_mod_exp needs. Like pow_mod, this is not constant time.
+ *
+ * Bases of unknown order (e.g. in the QRN group) get a table for exponents of
+ * up to a given number of bits instead. Their exponents are not reduced,
+ * larger ones fall back to pow_mod.
+ */
+class CBigNumFixedBase
+{
+private:
+    CBigNum base;
+    CBigNum modulus;
+    CBigNum order;
+    unsigned int nWindowBits;
+    unsigned int nWindows;
+    BN_MONT_CTX* mont;
+    std::vector<CBigNum> vTable;
+
+    CBigNumFixedBase(const CBigNumFixedBase&);
+    CBigNumFixedBase& operator=(const CBigNumFixedBase&);
+
+public:
+    /**
+     * @param g base
+     * @param m odd modulus
+     * @param q order of g mod m; exponents are reduced mod q
+     * @param nWindowBitsIn window width, trades table size against multiplications
+     */
+    CBigNumFixedBase(const CBigNum& g, const CBigNum& m, const CBigNum& q, unsigned int nWindowBitsIn = 4)
+        : base(g), modulus(m), order(q), nWindowBits(nWindowBitsIn), mont(NULL)
+    {
+        if (!BN_is_odd(m.bn) || q <= 0 || nWindowBits == 0 || nWindowBits > 8)
+            throw bignum_error("CBigNumFixedBase : invalid modulus, order or window");
+
+        build(order.bitSize());
+    }
+
+    /**
+     * @param g base of unknown order
+     * @param m odd modulus
+     * @param nMaxExpBits largest exponent size the table covers
+     * @param nWindowBitsIn window width, trades table size against multiplications
+     */
+    CBigNumFixedBase(const CBigNum& g, const CBigNum& m, unsigned int nMaxExpBits, unsigned int nWindowBitsIn)
+        : base(g), modulus(m), order(0), nWindowBits(nWindowBitsIn), mont(NULL)
+    {
+        if (!BN_is_odd(m.bn) || nMaxExpBits == 0 || nWindowBits == 0 || nWindowBits > 8)
+            throw bignum_error("CBigNumFixedBase : invalid modulus, exponent size or window");
+
+        build(nMaxExpBits);
+    }
+
+    ~CBigNumFixedBase()
+    {
+        BN_MONT_CTX_free(mont);
+    }
+
+    /** True if this table was built for base g modulo m */
+    bool matches(const CBigNum& g, const CBigNum& m) const
+    {
+        return base == g && modulus == m;
+    }
+
+    /**
+     * fixed-base modular exponentiation: g^e mod m
+     * Negative exponents are handled by reducing e mod q first, or for bases of
+     * unknown order by inverting g^-e.
+     * @param e exponent
+     */
+    CBigNum pow_mod_fixed(const CBigNum& e) const
+    {
+        CAutoBN_CTX pctx;
+        CBigNum exp;
+        if (order > 0) {
+            if (!BN_nnmod(exp.bn, e.bn, order.bn, pctx))
+                throw bignum_error("CBigNumFixedBase::pow_mod_fixed : BN_nnmod failed");
+        } else if (e < 0) {
+            return pow_mod_fixed(-e).inverse(modulus);
+        } else if ((unsigned int)e.bitSize() > nWindows * nWindowBits) {
+            return base.pow_mod(e, modulus);
+        } else {
+            exp = e;
+        }
+
+        const unsigned int nDigits = (1u << nWindowBits) - 1;
+        CBigNum acc;
+        bool fFirst = true;
+        for (unsigned int i = 0; i < nWindows; i++) {
+            unsigned int digit = 0;
+            for (unsigned int b = 0; b < nWindowBits; b++) {
+                if (BN_is_bit_set(exp.bn, i * nWindowBits + b))
+                    digit |= 1u << b;
+            }
+            if (digit == 0)
+                continue;
+            const CBigNum& entry = vTable[(size_t)i * nDigits + digit - 1];
+            if (fFirst) {
+                acc = entry;
+                fFirst = false;
+            } else if (!BN_mod_mul_montgomery(acc.bn, acc.bn, entry.bn, mont, pctx)) {
+                throw bignum_error("CBigNumFixedBase::pow_mod_fixed : BN_mod_mul_montgomery failed");
+            }
+        }
+
+        CBigNum ret;
+        if (fFirst)
+            return CBigNum(1);
+        if (!BN_from_montgomery(ret.bn, acc.bn, mont, pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod_fixed : BN_from_montgomery failed");
+        return ret;
+    }
+
+private:
+    void build(unsigned int nExpBits)
+    {
+        CAutoBN_CTX pctx;
+        mont = BN_MONT_CTX_new();
+        if (mont == NULL || !BN_MONT_CTX_set(mont, modulus.bn, pctx)) {
+            BN_MONT_CTX_free(mont);
+            throw bignum_error("CBigNumFixedBase : BN_MONT_CTX_set failed");
+        }
+
+        const unsigned int nDigits = (1u << nWindowBits) - 1;
+        nWindows = (nExpBits + nWindowBits - 1) / nWindowBits;
+        vTable.resize((size_t)nWindows * nDigits);
+
+        // Row i holds (g^(2^(w*i)))^j for j = 1 .. 2^w - 1
+        CBigNum rowBase;
+        if (!BN_nnmod(rowBase.bn, base.bn, modulus.bn, pctx) ||
+            !BN_to_montgomery(rowBase.bn, rowBase.bn, mont, pctx))
+            throw bignum_error("CBigNumFixedBase : BN_to_montgomery failed");
+        for (unsigned int i = 0; i < nWindows; i++) {
+            CBigNum* row = &vTable[(size_t)i * nDigits];
+            row[0] = rowBase;
+            for (unsigned int j = 1; j < nDigits; j++) {
+                if (!BN_mod_mul_montgomery(row[j].bn, row[j - 1].bn, rowBase.bn, mont, pctx))
+                    throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+            }
+            // Next row base is the current one raised to 2^w
+            if (!BN_mod_mul_montgomery(rowBase.bn, row[nDigits - 1].bn, row[0].bn, mont, pctx))
+                throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+        }
+    }
+};
+
 typedef CBigNum Bignum;
 
 #endif
\ No newline at end of file
@@ -14,6 +14,9 @@
 #include "accumulatormap.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockcache.h"
+#include "blockfilemap.h"
+#include "blockindexsnapshot.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -36,7 +39,9 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include "xevanbatch.h"
 #include "zbeetchain.h"
+#include "zbeetspendcache.h"
 
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
@@ -62,6 +67,7 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CBlockIndexArena blockIndexArena;
 std::map<uint256, uint256> mapProofOfStake;
 std::map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
@@ -97,7 +103,6 @@ struct COrphanTx {
 std::map<uint256, COrphanTx> mapOrphanTransactions;
 std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
 std::map<uint256, int64_t> mapRejectedBlocks;
-std::map<uint256, int64_t> mapZerocoinspends; //txid, time received
 
 void EraseOrphansFor(NodeId peer);
 
@@ -1076,7 +1081,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool cacheStore, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1100,6 +1105,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     bool fValidated = false;
     std::set<CBigNum> serials;
     std::list<libzerocoin::CoinSpend> vSpends;
+    std::map<std::pair<libzerocoin::CoinDenomination, uint32_t>, std::vector<const libzerocoin::CoinSpend*> > mapSpendsByAccumulator;
     CAmount nTotalRedeemed = 0;
     for (const CTxIn& txin : tx.vin) {
 
@@ -1124,19 +1130,8 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
 
         // Skip signature verification during initial block download
         if (fVerifySignature) {
-            //see if we have record of the accumulator used in the spend tx
-            CBigNum bnAccumulatorValue = 0;
-            if (!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue)) {
-                uint32_t nChecksum = newSpend.getAccumulatorChecksum();
-                return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
-            }
-
-            libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-                                    newSpend.getDenomination(), bnAccumulatorValue);
-
-            //Check that the coin has been accumulated
-            if(!newSpend.Verify(accumulator))
-                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            const libzerocoin::CoinSpend& spend = vSpends.back();
+            mapSpendsByAccumulator[std::make_pair(spend.getDenomination(), spend.getAccumulatorChecksum())].push_back(&spend);
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1148,6 +1143,29 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
         fValidated = true;
     }
 
+    //Spends of the same denomination against the same accumulator share the lookup and are verified as a batch
+    for (const auto& group : mapSpendsByAccumulator) {
+        //see if we have record of the accumulator used in the spend tx
+        uint32_t nChecksum = group.first.second;
+        CBigNum bnAccumulatorValue = 0;
+        if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccumulatorValue))
+            return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
+
+        libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start());
+
+        //Leave the proof verification to the caller if it asked for it, one check per accumulator
+        if (pvChecks) {
+            pvChecks->push_back(CZerocoinSpendCheck(paramsAccumulator, bnAccumulatorValue));
+            for (const libzerocoin::CoinSpend* spend : group.second)
+                pvChecks->back().AddSpend(*spend, tx.GetHash());
+        } else {
+            //Check that the coins have been accumulated, unless the same spends were verified before.
+            //Only spends checked for the mempool are remembered, block checks must not evict them.
+            if (!VerifyZerocoinSpendsCached(group.second, paramsAccumulator, bnAccumulatorValue, cacheStore))
+                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+        }
+    }
+
     if (!tx.IsCoinStake() && nTotalRedeemed < tx.GetValueOut()) {
         LogPrintf("redeemed = %s , spend = %s \n", FormatMoney(nTotalRedeemed), FormatMoney(tx.GetValueOut()));
         return state.DoS(100, error("Transaction spend more than was redeemed in zerocoins"));
@@ -1156,7 +1174,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool cacheStore, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1212,7 +1230,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, cacheStore, pvChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1306,7 +1324,18 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+/** Expire old transactions and evict the cheapest ones until the pool fits in nLimit bytes */
+static void LimitMempoolSize(CTxMemPool& pool, uint64_t nLimit, int64_t nAge)
+{
+    int nExpired = pool.Expire(GetTime() - nAge);
+    if (nExpired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", nExpired);
+
+    std::list<CTransaction> removed;
+    pool.TrimToSize(nLimit, removed);
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1320,7 +1349,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     if (chainHeight < Params().Zerocoin_StartHeight() && !IsInitialBlockDownload() && tx.ContainsZerocoins())
         return state.DoS(10, error("AcceptToMemoryPool: Zerocoin is not yet active"), REJECT_INVALID, "bad-tx");
 
-    if (!CheckTransaction(tx, chainHeight >= Params().Zerocoin_StartHeight(), true, state))
+    if (!CheckTransaction(tx, chainHeight >= Params().Zerocoin_StartHeight(), true, state, true))
         return state.DoS(100, error("AcceptToMemoryPool: CheckTransaction failed"), REJECT_INVALID, "bad-tx");
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -1385,17 +1414,26 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         if(tx.IsZerocoinSpend()){
             nValueIn = tx.GetZerocoinSpent();
 
+            //Check for double spending of serial #'s against the mempool first, it needs no disk access
+            std::vector<libzerocoin::CoinSpend> vSpends;
+            for (const CTxIn& txIn : tx.vin) {
+                if (!txIn.scriptSig.IsZerocoinSpend())
+                    continue;
+                vSpends.push_back(TxInToZerocoinSpend(txIn));
+                uint256 txidConflict;
+                if (pool.lookupZerocoinSerial(GetSerialHash(vSpends.back().getCoinSerialNumber()), txidConflict))
+                    return state.Invalid(error("AcceptToMemoryPool: zBEET spend tx %s conflicts with mempool tx %s",
+                                               tx.GetHash().GetHex(), txidConflict.GetHex()), REJECT_DUPLICATE, "bad-txns-zbeet-serial-in-mempool");
+            }
+
             //Check that txid is not already in the chain
             int nHeightTx = 0;
             if (IsTransactionInChain(tx.GetHash(), nHeightTx))
                 return state.Invalid(error("AcceptToMemoryPool: zBEET spend tx %s already in block %d",
                                            tx.GetHash().GetHex(), nHeightTx), REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
-            //Check for double spending of serial #'s
-            for (const CTxIn& txIn : tx.vin) {
-                if (!txIn.scriptSig.IsZerocoinSpend())
-                    continue;
-                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+            //Check for double spending of serial #'s against the chain
+            for (const libzerocoin::CoinSpend& spend : vSpends) {
                 if (!ContextualCheckZerocoinSpend(tx, spend, chainActive.Tip(), 0))
                     return state.Invalid(error("%s: ContextualCheckZerocoinSpend failed for tx %s", __func__,
                                                tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-zbeet");
@@ -1481,7 +1519,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         if (!tx.IsZerocoinSpend())
             view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height());
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1495,6 +1533,14 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                                         hash.ToString(), nFees, txMinFee),
                     REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // After evicting, the pool only takes transactions paying more than what it evicted
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            pool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+            CAmount nMempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (nMempoolRejectFee > 0 && nFees + nFeeDelta < nMempoolRejectFee && !tx.IsZerocoinSpend())
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (tx.IsZerocoinMint()) {
                 if(nFees < Params().Zerocoin_MintFee() * tx.GetZerocoinMintCount())
@@ -1532,6 +1578,17 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Keep unconfirmed chains short, every entry added to or removed from one updates the whole chain
+        CTxMemPool::setEntries setAncestors;
+        uint64_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        uint64_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+        uint64_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        uint64_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        std::string strChainError;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, strChainError))
+            return state.DoS(0, error("AcceptToMemoryPool: %s %s", hash.ToString(), strChainError),
+                REJECT_NONSTANDARD, "too-long-mempool-chain");
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -1551,19 +1608,29 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             return error("AcceptToMemoryPool: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
+        // Scripts passed MANDATORY_SCRIPT_VERIFY_FLAGS above, so CreateNewBlock need not re-run them
+        entry.SetInputsChecked();
+
         // Store transaction in memory
-        pool.addUnchecked(hash, entry);
+        if (!pool.addUnchecked(hash, entry))
+            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-zbeet-serial-in-mempool");
+
+        // Keep the pool within -maxmempool; the new transaction may be the one evicted
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
 
-    //Track zerocoinspends and ensure that they are given priority to make it into the blockchain
-    if (tx.IsZerocoinSpend())
-        mapZerocoinspends[tx.GetHash()] = GetAdjustedTime();
-
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fRejectInsaneFee, ignoreFees);
+}
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
 {
     AssertLockHeld(cs_main);
@@ -1571,7 +1638,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         *pfMissingInputs = false;
 
 
-    if (!CheckTransaction(tx, chainActive.Height() >= Params().Zerocoin_StartHeight(), true, state))
+    if (!CheckTransaction(tx, chainActive.Height() >= Params().Zerocoin_StartHeight(), true, state, true))
         return error("AcceptableInputs : CheckTransaction failed");
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -1855,18 +1922,71 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+/**
+ * Map the record at pos, which WriteBlockToDisk or CBlockUndo::WriteToDisk stored behind the network magic
+ * and its size, followed by nTrailer more bytes. On success [pbegin, pend) holds the record and its trailer
+ * and stays valid as long as the returned mapping. Returns NULL if the file can't be mapped or the header
+ * doesn't check out, so the caller can fall back to reading through OpenDiskFile. The files blocks are
+ * currently appended to are never mapped, they grow with every block and would have to be mapped again
+ * for most reads.
+ */
+static std::shared_ptr<const CMappedBlockFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer, const char*& pbegin, const char*& pend)
+{
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return std::shared_ptr<const CMappedBlockFile>();
+    {
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile)
+            return std::shared_ptr<const CMappedBlockFile>();
+    }
+
+    std::shared_ptr<const CMappedBlockFile> mapped = GetMappedBlockFile(pos, prefix, pos.nPos);
+    if (!mapped)
+        return mapped;
+
+    unsigned char buf[MESSAGE_START_SIZE];
+    unsigned int nSize;
+    try {
+        CBufferReader header(mapped->data() + pos.nPos - nHeaderSize, mapped->data() + pos.nPos, SER_DISK, CLIENT_VERSION);
+        header >> FLATDATA(buf) >> nSize;
+    } catch (const std::exception&) {
+        return std::shared_ptr<const CMappedBlockFile>();
+    }
+    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    uint64_t nEnd = (uint64_t)pos.nPos + nSize + nTrailer;
+    if (nEnd > mapped->size()) {
+        mapped = GetMappedBlockFile(pos, prefix, nEnd);
+        if (!mapped)
+            return mapped;
+    }
+
+    pbegin = mapped->data() + pos.nPos;
+    pend = mapped->data() + nEnd;
+    return mapped;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, straight from the mapped file where possible
     try {
-        filein >> block;
+        const char* pbegin;
+        const char* pend;
+        std::shared_ptr<const CMappedBlockFile> mapped = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+        if (mapped) {
+            CBufferReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1880,14 +2000,19 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fUseCache)
 {
+    if (fUseCache && GetCachedBlock(pindex->GetBlockHash(), block))
+        return true;
+
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
     if (block.GetHash() != pindex->GetBlockHash()) {
         LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
     }
+    if (fUseCache)
+        CacheBlock(block, pindex->GetBlockHash());
     return true;
 }
 
@@ -2167,6 +2292,46 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+bool CZerocoinSpendCheck::operator()()
+{
+    std::string strTxids;
+    for (const uint256& txid : vTxids)
+        strTxids += (strTxids.empty() ? "" : ",") + txid.ToString();
+
+    try {
+        std::vector<const libzerocoin::CoinSpend*> vpSpends;
+        for (const std::shared_ptr<libzerocoin::CoinSpend>& spend : vSpends)
+            vpSpends.push_back(spend.get());
+        if (!VerifyZerocoinSpendsCached(vpSpends, params, bnAccumulatorValue, false))
+            return ::error("CZerocoinSpendCheck(): a zerocoin spend in txs %s did not verify", strTxids);
+    } catch (const std::exception& e) {
+        return ::error("CZerocoinSpendCheck(): zerocoin spends in txs %s threw: %s", strTxids, e.what());
+    }
+    return true;
+}
+
+void CZerocoinSpendCheck::AddSpend(const libzerocoin::CoinSpend& spend, const uint256& txid)
+{
+    vSpends.push_back(std::make_shared<libzerocoin::CoinSpend>(spend));
+    if (vTxids.empty() || vTxids.back() != txid)
+        vTxids.push_back(txid);
+}
+
+void CZerocoinSpendCheck::Merge(CZerocoinSpendCheck& check)
+{
+    vSpends.insert(vSpends.end(), check.vSpends.begin(), check.vSpends.end());
+    vTxids.insert(vTxids.end(), check.vTxids.begin(), check.vTxids.end());
+    check.vSpends.clear();
+    check.vTxids.clear();
+}
+
+std::pair<libzerocoin::CoinDenomination, uint32_t> CZerocoinSpendCheck::GetAccumulatorKey() const
+{
+    if (vSpends.empty())
+        return std::make_pair(libzerocoin::ZQ_ERROR, 0);
+    return std::make_pair(vSpends.front()->getDenomination(), vSpends.front()->getAccumulatorChecksum());
+}
+
 std::map<COutPoint, COutPoint> mapInvalidOutPoints;
 std::map<CBigNum, CAmount> mapInvalidSerials;
 void AddInvalidSpendsToMap(const CBlock& block)
@@ -2337,7 +2502,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -2366,7 +2531,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
          * note we only undo zerocoin databasing in the following statement, value to and from BeetleCoin
          * addresses should still be handled by the typical bitcoin based undo code
          * */
-        if (tx.ContainsZerocoins()) {
+        if (tx.ContainsZerocoins() && !fJustCheck) {
             if (tx.IsZerocoinSpend()) {
                 //erase all zerocoinspends in this transaction
                 for (const CTxIn& txin : tx.vin) {
@@ -2460,7 +2625,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (!fVerifyingBlocks) {
+    if (!fVerifyingBlocks && !fJustCheck) {
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
         if(nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2510,6 +2675,16 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(16);
+//! Only one CheckBlock() may drive the zerocoin spend check queue at a time
+static CCriticalSection cs_zerocoinspendcheckqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("beetlecoin-zcspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
 void RecalculateZBEETMinted()
 {
     CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
@@ -2560,17 +2735,18 @@ void RecalculateZBEETSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        CZerocoinSupply supply = pindex->pprev->GetZcSupply();
 
         //Add mints to zBEET supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
             long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            supply.Add(denom, nDenomAdded);
         }
 
         //Remove spends from zBEET supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            supply.Add(denom, -1);
+        pindex->SetZcSupply(supply);
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2658,6 +2834,31 @@ bool RecalculateBEETSupply(int nHeightStart)
     return true;
 }
 
+// Whether the accumulator checkpoint at nHeight is the previous checkpoint plus the mints of blocks nHeight - 20
+// through nHeight - 11, as opposed to one of the special cases handled by InitializeAccumulators
+static bool IsCheckpointFromPrevious(int nHeight)
+{
+    return nHeight % 10 == 0 && nHeight > Params().Zerocoin_Block_V2_Start() + 20 &&
+           nHeight != Params().Zerocoin_Block_RecalculateAccumulators();
+}
+
+// Check a recalculated checkpoint against the block index and database its accumulator values
+static bool StoreReindexedCheckpoint(CBlockIndex* pindex, const uint256& nCheckpointCalculated, AccumulatorMap& mapAccumulators,
+                                     std::list<uint256>& listMissingCheckpoints, std::string& strError)
+{
+    //check that the calculated checkpoint is what is in the index.
+    if (nCheckpointCalculated != pindex->nAccumulatorCheckpoint) {
+        LogPrintf("%s : height=%d calculated_checkpoint=%s actual=%s\n", __func__, pindex->nHeight, nCheckpointCalculated.GetHex(), pindex->nAccumulatorCheckpoint.GetHex());
+        strError = _("Calculated accumulator checkpoint is not what is recorded by block index");
+        return error("%s: %s", __func__, strError);
+    }
+
+    DatabaseChecksums(mapAccumulators);
+    auto it = find(listMissingCheckpoints.begin(), listMissingCheckpoints.end(), pindex->nAccumulatorCheckpoint);
+    listMissingCheckpoints.erase(it);
+    return true;
+}
+
 bool ReindexAccumulators(std::list<uint256>& listMissingCheckpoints, std::string& strError)
 {
     // BeetleCoin: recalculate Accumulator Checkpoints that failed to database properly
@@ -2668,40 +2869,117 @@ bool ReindexAccumulators(std::list<uint256>& listMissingCheckpoints, std::string
         //search the chain to see when zerocoin started
         int nZerocoinStart = Params().Zerocoin_Block_V2_Start();
 
-        // find each checkpoint that is missing
-        CBlockIndex* pindex = chainActive[nZerocoinStart];
-        while (pindex) {
-            uiInterface.ShowProgress(_("Calculating missing accumulators..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - nZerocoinStart) / (double)(chainActive.Height() - nZerocoinStart) * 100))));
+        // find each checkpoint that is missing by iterating through the blockchain beginning with the first zerocoin block
+        std::vector<CBlockIndex*> vMissing;
+        std::set<uint256> setFound;
+        for (CBlockIndex* pindex = chainActive[nZerocoinStart]; pindex; pindex = chainActive.Next(pindex)) {
+            if (pindex->nAccumulatorCheckpoint == pindex->pprev->nAccumulatorCheckpoint)
+                continue;
+            if (find(listMissingCheckpoints.begin(), listMissingCheckpoints.end(), pindex->nAccumulatorCheckpoint) != listMissingCheckpoints.end() &&
+                setFound.insert(pindex->nAccumulatorCheckpoint).second)
+                vMissing.push_back(pindex);
+        }
+
+        // Checkpoints are recalculated a window at a time: the mints behind every checkpoint in the window are read on
+        // worker threads, then runs of consecutive checkpoints are accumulated one thread per denomination
+        static const size_t CHECKPOINT_WINDOW_SIZE = 100;
+        for (size_t nWindowStart = 0; nWindowStart < vMissing.size(); nWindowStart += CHECKPOINT_WINDOW_SIZE) {
+            uiInterface.ShowProgress(_("Calculating missing accumulators..."), std::max(1, std::min(99, (int)((double)(vMissing[nWindowStart]->nHeight - nZerocoinStart) / (double)(chainActive.Height() - nZerocoinStart) * 100))));
 
             if (ShutdownRequested())
                 return false;
 
-            // find checkpoints by iterating through the blockchain beginning with the first zerocoin block
-            if (pindex->nAccumulatorCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
-                if (find(listMissingCheckpoints.begin(), listMissingCheckpoints.end(), pindex->nAccumulatorCheckpoint) != listMissingCheckpoints.end()) {
+            size_t nWindowEnd = std::min(nWindowStart + CHECKPOINT_WINDOW_SIZE, vMissing.size());
+            std::vector<CBlockIndex*> vBlocks;
+            std::vector<size_t> vBlockCheckpoint;
+            for (size_t i = nWindowStart; i < nWindowEnd; i++) {
+                int nHeight = vMissing[i]->nHeight;
+                if (!IsCheckpointFromPrevious(nHeight))
+                    continue;
+                for (int nHeightBlock = std::max(nHeight - 20, Params().Zerocoin_StartHeight()); nHeightBlock < nHeight - 10; nHeightBlock++) {
+                    vBlocks.push_back(chainActive[nHeightBlock]);
+                    vBlockCheckpoint.push_back(i - nWindowStart);
+                }
+            }
+
+            std::vector<std::list<libzerocoin::PublicCoin> > vBlockPubcoins(vBlocks.size());
+            bool fSuccess = ReadBlocksParallel(vBlocks, [&](size_t i, const CBlock& block) {
+                //Whether this should filter out invalid/fraudulent outpoints
+                bool fFilterInvalid = vMissing[nWindowStart + vBlockCheckpoint[i]]->nHeight >= Params().Zerocoin_Block_RecalculateAccumulators();
+                return BlockToPubcoinList(block, vBlockPubcoins[i], fFilterInvalid);
+            });
+            if (!fSuccess) {
+                strError = _("Failed to calculate accumulator checkpoint");
+                return error("%s: %s", __func__, strError);
+            }
+
+            // blocks were queued in height order, so splicing keeps each checkpoint's mints in accumulation order
+            std::vector<std::list<libzerocoin::PublicCoin> > vPubcoins(nWindowEnd - nWindowStart);
+            for (size_t i = 0; i < vBlocks.size(); i++)
+                vPubcoins[vBlockCheckpoint[i]].splice(vPubcoins[vBlockCheckpoint[i]].end(), vBlockPubcoins[i]);
+
+            size_t nRunStart = nWindowStart;
+            while (nRunStart < nWindowEnd) {
+                CBlockIndex* pindex = vMissing[nRunStart];
+                AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
+                if (!IsCheckpointFromPrevious(pindex->nHeight)) {
                     uint256 nCheckpointCalculated = 0;
-                    AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
                     if (!CalculateAccumulatorCheckpoint(pindex->nHeight, nCheckpointCalculated, mapAccumulators)) {
                         // GetCheckpoint could have terminated due to a shutdown request. Check this here.
-                        if (ShutdownRequested())
-                            break;
+                        if (ShutdownRequested()) {
+                            uiInterface.ShowProgress("", 100);
+                            return true;
+                        }
                         strError = _("Failed to calculate accumulator checkpoint");
                         return error("%s: %s", __func__, strError);
                     }
 
-                    //check that the calculated checkpoint is what is in the index.
-                    if (nCheckpointCalculated != pindex->nAccumulatorCheckpoint) {
-                        LogPrintf("%s : height=%d calculated_checkpoint=%s actual=%s\n", __func__, pindex->nHeight, nCheckpointCalculated.GetHex(), pindex->nAccumulatorCheckpoint.GetHex());
-                        strError = _("Calculated accumulator checkpoint is not what is recorded by block index");
-                        return error("%s: %s", __func__, strError);
-                    }
+                    if (!StoreReindexedCheckpoint(pindex, nCheckpointCalculated, mapAccumulators, listMissingCheckpoints, strError))
+                        return false;
+                    nRunStart++;
+                    continue;
+                }
+
+                // a run continues while each checkpoint builds directly on the one calculated before it
+                size_t nRunEnd = nRunStart + 1;
+                while (nRunEnd < nWindowEnd && IsCheckpointFromPrevious(vMissing[nRunEnd]->nHeight) &&
+                       chainActive[vMissing[nRunEnd]->nHeight - 1]->nAccumulatorCheckpoint == vMissing[nRunEnd - 1]->nAccumulatorCheckpoint)
+                    nRunEnd++;
+
+                //Use the previous block's checkpoint to initialize the accumulator's state
+                uint256 nCheckpointPrev = chainActive[pindex->nHeight - 1]->nAccumulatorCheckpoint;
+                if (nCheckpointPrev != 0 && !mapAccumulators.Load(nCheckpointPrev)) {
+                    strError = _("Failed to calculate accumulator checkpoint");
+                    return error("%s: %s", __func__, strError);
+                }
+
+                AccumulatorCheckpoints::Checkpoint checkpointStart;
+                for (auto denom : libzerocoin::zerocoinDenomList)
+                    checkpointStart[denom] = mapAccumulators.GetValue(denom);
 
-                    DatabaseChecksums(mapAccumulators);
-                    auto it = find(listMissingCheckpoints.begin(), listMissingCheckpoints.end(), pindex->nAccumulatorCheckpoint);
-                    listMissingCheckpoints.erase(it);
+                std::vector<std::list<libzerocoin::PublicCoin> > vRunPubcoins(vPubcoins.begin() + (nRunStart - nWindowStart), vPubcoins.begin() + (nRunEnd - nWindowStart));
+                std::vector<AccumulatorCheckpoints::Checkpoint> vCheckpoints;
+                if (!AccumulateCheckpointRun(Params().Zerocoin_Params(false), checkpointStart, vRunPubcoins, vCheckpoints)) {
+                    strError = _("Failed to calculate accumulator checkpoint");
+                    return error("%s: %s", __func__, strError);
                 }
+
+                for (size_t i = 0; i < vCheckpoints.size(); i++) {
+                    CBlockIndex* pindexCheckpoint = vMissing[nRunStart + i];
+                    mapAccumulators.Load(vCheckpoints[i]);
+
+                    // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
+                    uint256 nCheckpointCalculated;
+                    if (vRunPubcoins[i].empty())
+                        nCheckpointCalculated = chainActive[pindexCheckpoint->nHeight - 1]->nAccumulatorCheckpoint;
+                    else
+                        nCheckpointCalculated = mapAccumulators.GetCheckpoint();
+
+                    if (!StoreReindexedCheckpoint(pindexCheckpoint, nCheckpointCalculated, mapAccumulators, listMissingCheckpoints, strError))
+                        return false;
+                }
+                nRunStart = nRunEnd;
             }
-            pindex = chainActive.Next(pindex);
         }
         uiInterface.ShowProgress("", 100);
     }
@@ -2716,11 +2994,9 @@ bool UpdateZBEETSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck
     std::list<libzerocoin::CoinDenomination> listSpends = ZerocoinSpendListFromBlock(block, fFilterInvalid);
 
     // Initialize zerocoin supply to the supply from previous block
-    if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion >= Params().Zerocoin_HeaderVersion()) {
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
-        }
-    }
+    CZerocoinSupply supply = pindex->GetZcSupply();
+    if (pindex->pprev && pindex->pprev->nVersion >= Params().Zerocoin_HeaderVersion())
+        supply = pindex->pprev->GetZcSupply();
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
@@ -2730,7 +3006,7 @@ bool UpdateZBEETSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
             pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            supply.Add(denom, 1);
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -2755,17 +3031,18 @@ bool UpdateZBEETSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            supply.Add(denom, -1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
-            if (pindex->GetZcMints(denom) < 0)
+            if (supply.Get(denom) < 0)
                 return error("Block contains zerocoins that spend more than are in the available supply to spend");
         }
     }
+    pindex->SetZcSupply(supply);
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->GetZcMints(denom));
 
     return true;
 }
@@ -2844,7 +3121,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
     unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-    std::vector<uint256> vSpendsInBlock;
     uint256 hashBlock = block.GetHash();
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
@@ -2866,7 +3142,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (tx.IsZerocoinSpend()) {
             int nHeightTx = 0;
             uint256 txid = tx.GetHash();
-            vSpendsInBlock.emplace_back(txid);
             if (IsTransactionInChain(txid, nHeightTx)) {
                 //when verifying blocks on init, the blocks are scanned without being disconnected - prevent that from causing an error
                 if (!fVerifyingBlocks || (fVerifyingBlocks && pindex->nHeight > nHeightTx))
@@ -3100,13 +3375,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (pindex->nHeight >= Params().Zerocoin_Block_FirstFraudulent() && pindex->nHeight <= Params().Zerocoin_Block_RecalculateAccumulators() + 1)
         AddInvalidSpendsToMap(block);
 
-    //Remove zerocoinspends from the pending map
-    for (const uint256& txid : vSpendsInBlock) {
-        auto it = mapZerocoinspends.find(txid);
-        if (it != mapZerocoinspends.end())
-            mapZerocoinspends.erase(it);
-    }
-
     return true;
 }
 
@@ -3306,6 +3574,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
             return error("ConnectTip() : ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(inv.hash);
+        CacheBlock(*pblock, inv.hash);
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
@@ -3327,7 +3596,9 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
 
     // Remove conflicting transactions from the mempool.
     std::list<CTransaction> txConflicted;
-    mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted);
+    // ConnectBlock set nMint to the change in money supply plus the fees
+    CAmount nBlockFees = pindexNew->nMint - (pindexNew->nMoneySupply - (pindexNew->pprev ? pindexNew->pprev->nMoneySupply : 0));
+    mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, nBlockFees, txConflicted);
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
@@ -3724,7 +3995,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     assert(pindexNew);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
@@ -3930,7 +4201,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, bool fCheckPayee, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
 {
     // These are checks that are independent of context.
 
@@ -4033,7 +4304,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         // but issue an initial reject message.
         // The case also exists that the sending peer could not have enough data to see
         // that this block is invalid, so don't issue an outright ban.
-        if (nHeight != 0 && !IsInitialBlockDownload()) {
+        if (nHeight != 0 && fCheckPayee && !IsInitialBlockDownload()) {
             if (!IsBlockPayeeValid(block, nHeight)) {
                 mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
                 return state.DoS(0, error("%s : Couldn't find masternode/budget payment", __func__),
@@ -4048,9 +4319,25 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check transactions
     bool fZerocoinActive = nHeight >= Params().Zerocoin_StartHeight();
     std::vector<CBigNum> vBlockSerials;
+
+    // Zerocoin spends of the whole block are grouped by the accumulator they were made against,
+    // each group is verified as one batch
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks;
+    std::map<std::pair<libzerocoin::CoinDenomination, uint32_t>, size_t> mapZerocoinCheckByAccumulator;
+
     for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(tx, fZerocoinActive, nHeight >= Params().Zerocoin_Block_EnforceSerialRange(), state))
+        std::vector<CZerocoinSpendCheck> vChecks;
+        if (!CheckTransaction(tx, fZerocoinActive, nHeight >= Params().Zerocoin_Block_EnforceSerialRange(), state, false, &vChecks))
             return error("%s : CheckTransaction failed", __func__);
+        for (CZerocoinSpendCheck& check : vChecks) {
+            auto ret = mapZerocoinCheckByAccumulator.insert(std::make_pair(check.GetAccumulatorKey(), vZerocoinChecks.size()));
+            if (ret.second) {
+                vZerocoinChecks.push_back(CZerocoinSpendCheck());
+                check.swap(vZerocoinChecks.back());
+            } else {
+                vZerocoinChecks[ret.first->second].Merge(check);
+            }
+        }
 
         // double check that there are no double spent zBEET spends in this block
         if (tx.IsZerocoinSpend()) {
@@ -4075,6 +4362,33 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("%s : out-of-bounds SigOpCount", __func__),
             REJECT_INVALID, "bad-blk-sigops", true);
 
+    // Leave the proof verification to the caller if it asked for it
+    if (pvZerocoinChecks) {
+        pvZerocoinChecks->swap(vZerocoinChecks);
+        return true;
+    }
+
+    // The batches are verified on the check threads. If another block is already using
+    // the queue, fall back to verifying inline rather than waiting for it.
+    TRY_LOCK(cs_zerocoinspendcheckqueue, lockZerocoinQueue);
+    bool fParallelZerocoinChecks = nScriptCheckThreads && lockZerocoinQueue;
+    bool fZerocoinSpendsValid = true;
+    if (fParallelZerocoinChecks) {
+        CCheckQueueControl<CZerocoinSpendCheck> control(&zerocoinspendcheckqueue);
+        control.Add(vZerocoinChecks);
+        fZerocoinSpendsValid = control.Wait();
+    } else {
+        for (CZerocoinSpendCheck& check : vZerocoinChecks) {
+            if (!check()) {
+                fZerocoinSpendsValid = false;
+                break;
+            }
+        }
+    }
+    if (!fZerocoinSpendsValid)
+        return state.DoS(100, error("%s : zerocoin spend did not verify", __func__),
+            REJECT_INVALID, "bad-zc-spend");
+
     return true;
 }
 
@@ -4198,6 +4512,31 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
+bool CheckBlockHeaders(const std::vector<CBlock>& vHeaders, CValidationState& state, size_t& nContinuous)
+{
+    // XEVAN the pre-v4 headers in one batch on the XEVAN threads, each header keeps its hash for the checks under cs_main
+    std::vector<XevanInput> vInputs;
+    std::vector<size_t> vInputHeader;
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        if (vHeaders[i].nVersion >= 4)
+            continue;
+        vInputs.push_back(XevanInput((const unsigned char*)BEGIN(vHeaders[i].nVersion), (const unsigned char*)END(vHeaders[i].nNonce)));
+        vInputHeader.push_back(i);
+    }
+    std::vector<uint256> vHashes;
+    XEVANBatch(vInputs, vHashes);
+    for (size_t i = 0; i < vHashes.size(); i++)
+        vHeaders[vInputHeader[i]].SetCachedHash(vHashes[i]);
+
+    // everything else about a header, its timestamp included, is checked by AcceptBlockHeader
+    for (nContinuous = 1; nContinuous < vHeaders.size(); nContinuous++) {
+        if (vHeaders[nContinuous].hashPrevBlock != vHeaders[nContinuous - 1].GetHash())
+            return state.DoS(20, error("%s : non-continuous headers sequence", __func__), REJECT_INVALID, "bad-prevblk");
+    }
+    nContinuous = vHeaders.size();
+    return true;
+}
+
 bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
@@ -4449,11 +4788,11 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp, bool fPreChecked)
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
-    bool checked = CheckBlock(*pblock, state);
+    bool checked = CheckBlock(*pblock, state, !fPreChecked, !fPreChecked);
 
     int nMints = 0;
     int nSpends = 0;
@@ -4472,7 +4811,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     if (nMints || nSpends)
         LogPrintf("%s : block contains %d zBEET mints and %d zBEET spends\n", __func__, nMints, nSpends);
 
-    if (!CheckBlockSignature(*pblock))
+    if (!fPreChecked && !CheckBlockSignature(*pblock))
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -4626,9 +4965,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -4638,19 +4975,35 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(std::string& strError)
 {
-    if (!pblocktree->LoadBlockIndexGuts())
-        return false;
+    // The snapshot written at the last clean shutdown comes sorted by height already
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    bool fSnapshot = false;
+    if (GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT))
+        fSnapshot = LoadBlockIndexSnapshot(pcoinsTip->GetBestBlock(), vSortedByHeight);
+    else
+        RemoveBlockIndexSnapshot();
 
-    boost::this_thread::interruption_point();
+    if (!fSnapshot) {
+        if (!pblocktree->LoadBlockIndexGuts())
+            return false;
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        boost::this_thread::interruption_point();
+
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
     }
-    std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // Whatever this session writes to the block tree, no snapshot written before matches it anymore
+    uint64_t nGeneration = 0;
+    pblocktree->ReadGeneration(nGeneration);
+    if (!pblocktree->WriteGeneration(nGeneration + 1))
+        return error("%s : failed to write the block tree generation", __func__);
+
+    // Calculate nChainWork
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
@@ -4742,90 +5095,238 @@ bool static LoadBlockIndexDB(std::string& strError)
     return true;
 }
 
-CVerifyDB::CVerifyDB()
+namespace
+{
+CCriticalSection cs_verifyDBStatus;
+CVerifyDBStatus verifyDBStatus;
+
+bool VerifyDBFailed(const std::string& strError)
 {
-    uiInterface.ShowProgress(_("Verifying blocks..."), 0);
+    {
+        LOCK(cs_verifyDBStatus);
+        verifyDBStatus.state = CVerifyDBStatus::FAILED;
+        verifyDBStatus.strError = strError;
+    }
+    return error("VerifyDB() : *** %s", strError);
+}
+
+//! A block of the best chain to check at levels 0 to 2, copied out of the index under cs_main
+struct CVerifyDBBlock {
+    int nHeight;
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    CDiskBlockPos pos;
+    CDiskBlockPos posUndo;
+};
+}
+
+CVerifyDBStatus GetVerifyDBStatus()
+{
+    LOCK(cs_verifyDBStatus);
+    return verifyDBStatus;
+}
+
+CVerifyDB::CVerifyDB(bool fShowProgressIn) : fShowProgress(fShowProgressIn), nProgressStart(0)
+{
+    if (fShowProgress)
+        uiInterface.ShowProgress(_("Verifying blocks..."), 0);
 }
 
 CVerifyDB::~CVerifyDB()
 {
-    uiInterface.ShowProgress("", 100);
+    if (fShowProgress)
+        uiInterface.ShowProgress("", 100);
+}
+
+void CVerifyDB::ShowProgress(int nPercent)
+{
+    if (fShowProgress)
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, nProgressStart + nPercent * (100 - nProgressStart) / 100)));
 }
 
 bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth)
 {
-    LOCK(cs_main);
-    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
-        return true;
+    std::vector<CVerifyDBBlock> vBlocks;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
+            return true;
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0)
-        nCheckDepth = 1000000000; // suffices until the year 19000
-    if (nCheckDepth > chainActive.Height())
-        nCheckDepth = chainActive.Height();
+        // Verify blocks in the best chain
+        if (nCheckDepth <= 0)
+            nCheckDepth = 1000000000; // suffices until the year 19000
+        if (nCheckDepth > chainActive.Height())
+            nCheckDepth = chainActive.Height();
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+            if (pindex->nHeight < chainActive.Height() - nCheckDepth)
+                break;
+            CVerifyDBBlock item;
+            item.nHeight = pindex->nHeight;
+            item.hashBlock = pindex->GetBlockHash();
+            item.hashPrevBlock = pindex->pprev->GetBlockHash();
+            item.pos = pindex->GetBlockPos();
+            item.posUndo = pindex->GetUndoPos();
+            vBlocks.push_back(item);
+        }
+    }
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    {
+        LOCK(cs_verifyDBStatus);
+        verifyDBStatus.state = CVerifyDBStatus::RUNNING;
+        verifyDBStatus.nCheckLevel = nCheckLevel;
+        verifyDBStatus.nCheckDepth = nCheckDepth;
+        verifyDBStatus.nBlocksChecked = 0;
+        verifyDBStatus.strError.clear();
+    }
+
+    // check levels 0 to 2 don't depend on each other, spread the blocks over worker threads
+    std::atomic<size_t> nNext(0);
+    std::atomic<size_t> nDone(0);
+    std::atomic<bool> fFailed(false);
+    size_t nFailure = vBlocks.size();
+    std::string strFailure;
+    CCriticalSection cs_failure;
+    auto worker = [&](bool fReportProgress) {
+        for (size_t i = nNext++; i < vBlocks.size() && !fFailed && !ShutdownRequested(); i = nNext++) {
+            const CVerifyDBBlock& item = vBlocks[i];
+            std::string strError;
+            CBlock block;
+            CValidationState state;
+            // check level 0: read from disk
+            if (!ReadBlockFromDisk(block, item.pos) || block.GetHash() != item.hashBlock)
+                strError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", item.nHeight, item.hashBlock.ToString());
+            // check level 1: verify block validity. The payees were checked when the block came in, the
+            // masternode state they were checked against is gone. The spend proofs are verified without cs_main.
+            if (strError.empty() && nCheckLevel >= 1) {
+                std::vector<CZerocoinSpendCheck> vZerocoinChecks;
+                bool fValid;
+                {
+                    LOCK(cs_main);
+                    fValid = CheckBlock(block, state, true, true, true, false, &vZerocoinChecks);
+                }
+                for (size_t j = 0; fValid && j < vZerocoinChecks.size(); j++)
+                    fValid = vZerocoinChecks[j]();
+                if (!fValid)
+                    strError = strprintf("found bad block at %d, hash=%s", item.nHeight, item.hashBlock.ToString());
+            }
+            // check level 2: verify undo validity
+            if (strError.empty() && nCheckLevel >= 2 && !item.posUndo.IsNull()) {
+                CBlockUndo undo;
+                if (!undo.ReadFromDisk(item.posUndo, item.hashPrevBlock))
+                    strError = strprintf("found bad undo data at %d, hash=%s", item.nHeight, item.hashBlock.ToString());
+            }
+            if (!strError.empty()) {
+                LOCK(cs_failure);
+                // report the failure closest to the tip, like the sequential walk did
+                if (i < nFailure) {
+                    nFailure = i;
+                    strFailure = strError;
+                }
+                fFailed = true;
+            }
+            nDone++;
+            if (fReportProgress)
+                ShowProgress((int)(nDone * (nCheckLevel >= 3 ? 50 : 100) / vBlocks.size()));
+            LOCK(cs_verifyDBStatus);
+            verifyDBStatus.nBlocksChecked++;
+        }
+    };
+    int nThreads = std::max(1, std::min<int>(nScriptCheckThreads, vBlocks.size()));
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind<void>(worker, false));
+    worker(true);
+    {
+        // the workers reference this frame, they must be gone before an interruption unwinds it
+        boost::this_thread::disable_interruption noInterruption;
+        threadGroup.join_all();
+    }
+    boost::this_thread::interruption_point();
+    if (fFailed)
+        return VerifyDBFailed(strFailure);
+    if (ShutdownRequested())
+        return true;
+
+    if (nCheckLevel >= 3) {
+        nProgressStart = 50;
+        std::string strError;
+        bool fVerified = VerifyCoins(coinsview, nCheckLevel, nCheckDepth, strError);
+        nProgressStart = 0;
+        if (!fVerified)
+            return VerifyDBFailed(strError);
+        if (ShutdownRequested())
+            return true;
+    }
+
+    LOCK(cs_verifyDBStatus);
+    verifyDBStatus.state = CVerifyDBStatus::PASSED;
+    return true;
+}
+
+bool CVerifyDB::VerifyCoins(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, std::string& strError)
+{
+    auto fail = [&strError](const std::string& strFailure) {
+        strError = strFailure;
+        return error("VerifyDB() : *** %s", strFailure);
+    };
+
+    // check levels 3 and 4 walk the private view back and forth and need the chain to stay put. Like levels 0 to 2
+    // they read the blocks from disk rather than the block cache, that is the data being verified.
+    LOCK(cs_main);
+    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL || nCheckLevel < 3)
+        return true;
+    if (nCheckDepth <= 0 || nCheckDepth > chainActive.Height())
+        nCheckDepth = chainActive.Height();
+    nCheckLevel = std::min(4, nCheckLevel);
+
     CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexState = chainActive.Tip();
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
+    // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
         boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+        ShowProgress((int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if ((coins.GetCacheSize() + pcoinsTip->GetCacheSize()) > nCoinCacheSize)
+            break;
         CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!undo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size();
-        }
+        if (!ReadBlockFromDisk(block, pindex, false))
+            return fail(strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString()));
+        bool fClean = true;
+        if (!DisconnectBlock(block, state, pindex, coins, &fClean, true))
+            return fail(strprintf("irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString()));
+        pindexState = pindex->pprev;
+        if (!fClean) {
+            nGoodTransactions = 0;
+            pindexFailure = pindex;
+        } else
+            nGoodTransactions += block.vtx.size();
         if (ShutdownRequested())
             return true;
     }
     if (pindexFailure)
-        return error("VerifyDB() : *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+        return fail(strprintf("coin database inconsistencies found (last %i blocks, %i good transactions before that)", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions));
 
     // check level 4: try reconnecting blocks
     if (nCheckLevel >= 4) {
         CBlockIndex* pindex = pindexState;
         while (pindex != chainActive.Tip()) {
             boost::this_thread::interruption_point();
-            uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
+            ShowProgress(100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50));
             pindex = chainActive.Next(pindex);
             CBlock block;
-            if (!ReadBlockFromDisk(block, pindex))
-                return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            if (!ReadBlockFromDisk(block, pindex, false))
+                return fail(strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString()));
             if (!ConnectBlock(block, state, pindex, coins, false))
-                return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                return fail(strprintf("found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString()));
         }
     }
 
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
-
     return true;
 }
 
@@ -4852,16 +5353,16 @@ void UnloadBlockIndex()
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
 {
     // Load block index from databases
-    if (!fReindex && !LoadBlockIndexDB(strError))
+    if (fReindex)
+        RemoveBlockIndexSnapshot();
+    else if (!LoadBlockIndexDB(strError))
         return false;
     return true;
 }
@@ -4907,101 +5408,284 @@ bool InitBlockIndex()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
+// The checks of CheckBlock and ProcessNewBlock that depend on nothing but the block itself, so they can run off cs_main
+static bool CheckBlockContextFree(const CBlock& block)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    if (!CheckProofOfWork(block.GetHash(), block.nBits))
+        return false;
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    bool mutated;
+    if (block.BuildMerkleTree(&mutated) != block.hashMerkleRoot || mutated)
+        return false;
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+    // the key of a zerocoin stake is extracted with TxInToZerocoinSpend, which looks at chainActive
+    if (block.IsProofOfStake() && block.vtx[1].IsZerocoinSpend())
+        return false;
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
+    return CheckBlockSignature(block);
+}
+
+/**
+ * Staged pipeline behind LoadExternalBlockFile. A reader thread scans the file for blocks, a pool of workers
+ * runs CheckBlockContextFree on them, and the caller takes the blocks back in file order to connect them.
+ */
+class CBlockImportPipeline
+{
+public:
+    struct Entry {
+        CBlock block;
+        uint64_t nBlockPos;
+        bool fDone;
+        bool fPreChecked;
+
+        Entry() : nBlockPos(0), fDone(false), fPreChecked(false) {}
+    };
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condReader;
+    boost::condition_variable condWorker;
+    boost::condition_variable condConnector;
+
+    //! Every block read and not yet handed to the connector, in file order
+    std::deque<std::shared_ptr<Entry> > queueRead;
+    //! Blocks waiting for a worker
+    std::deque<std::shared_ptr<Entry> > queueUnchecked;
+    size_t nMaxInFlight;
+    bool fReaderDone;
+    bool fStop;
+    std::string strReaderError;
+    boost::thread_group threadGroup;
+
+    bool Push(const std::shared_ptr<Entry>& entry)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queueRead.size() >= nMaxInFlight && !fStop)
+            condReader.wait(lock);
+        if (fStop)
+            return false;
+        queueRead.push_back(entry);
+        queueUnchecked.push_back(entry);
+        condWorker.notify_one();
+        return true;
+    }
+
+    void ThreadRead(FILE* fileIn)
+    {
+        RenameThread("beetlecoin-blkread");
+        try {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof()) {
+                blkdat.SetPos(nRewind);
+                nRewind++;         // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos() + 1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                        continue;
+                } catch (std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                try {
+                    // read block
+                    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+                    entry->nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(entry->nBlockPos + nSize);
+                    blkdat.SetPos(entry->nBlockPos);
+                    blkdat >> entry->block;
+                    nRewind = blkdat.GetPos();
+                    if (!Push(entry))
                         break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                } catch (std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
                 }
+            }
+        } catch (std::runtime_error& e) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            strReaderError = e.what();
+        }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fReaderDone = true;
+        condWorker.notify_all();
+        condConnector.notify_all();
+    }
+
+    void ThreadCheck()
+    {
+        RenameThread("beetlecoin-blkcheck");
+        while (true) {
+            std::shared_ptr<Entry> entry;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queueUnchecked.empty() && !fReaderDone && !fStop)
+                    condWorker.wait(lock);
+                if (queueUnchecked.empty() || fStop)
+                    return;
+                entry = queueUnchecked.front();
+                queueUnchecked.pop_front();
+            }
+
+            bool fPreChecked = false;
+            try {
+                fPreChecked = CheckBlockContextFree(entry->block);
+            } catch (const std::exception&) {
+                // leave it to ProcessNewBlock
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            entry->fPreChecked = fPreChecked;
+            entry->fDone = true;
+            condConnector.notify_all();
+        }
+    }
+
+public:
+    explicit CBlockImportPipeline(FILE* fileIn) : fReaderDone(false), fStop(false)
+    {
+        // Sized by -par like the other verification threads, -par=1 still gets one checker
+        int nWorkers = std::max(1, nScriptCheckThreads);
+        nMaxInFlight = 4 * nWorkers;
+        threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this, fileIn));
+        for (int i = 0; i < nWorkers; i++)
+            threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+    }
+
+    ~CBlockImportPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            condReader.notify_all();
+            condWorker.notify_all();
+        }
+        threadGroup.join_all();
+    }
+
+    //! Wait for the next block in file order. Returns false once the file is exhausted.
+    bool Next(std::shared_ptr<Entry>& entry)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queueRead.empty() || !queueRead.front()->fDone) {
+            if (queueRead.empty() && fReaderDone)
+                return false;
+            condConnector.wait(lock);
+        }
+        entry = queueRead.front();
+        queueRead.pop_front();
+        condReader.notify_one();
+        return true;
+    }
+
+    //! The error that stopped the reader, if any. Only meaningful once Next has returned false.
+    std::string GetReaderError()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return strReaderError;
+    }
+};
+
+bool ReadExternalBlockFile(FILE* fileIn, const std::function<bool(CBlock&, uint64_t, bool)>& func, std::string& strError)
+{
+    CBlockImportPipeline pipeline(fileIn);
+    std::shared_ptr<CBlockImportPipeline::Entry> entry;
+    while (pipeline.Next(entry)) {
+        if (!func(entry->block, entry->nBlockPos, entry->fPreChecked))
+            break;
+    }
+
+    strError = pipeline.GetReaderError();
+    return strError.empty();
+}
+
+namespace
+{
+//! Disk positions of blocks with unknown parent, by parent hash (only used for reindex)
+std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+//! Process one block of an external block file, and any earlier blocks that waited for it
+bool ImportExternalBlock(CBlock& block, uint64_t nBlockPos, bool fPreChecked, CDiskBlockPos* dbp, int& nLoaded)
+{
+    boost::this_thread::interruption_point();
+
+    try {
+        if (dbp)
+            dbp->nPos = nBlockPos;
+
+        // detect out of order blocks, and store them for later
+        uint256 hash = block.GetHash();
+        if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+            CValidationState state;
+            if (ProcessNewBlock(state, NULL, &block, dbp, fPreChecked))
+                nLoaded++;
+            if (state.IsError())
+                return false;
+        } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+            LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+        }
+
+        // Recursively process earlier encountered successors of this block
+        std::deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                if (ReadBlockFromDisk(block, it->second)) {
+                    LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        head.ToString());
+                    CValidationState dummy;
+                    if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
+                        nLoaded++;
+                        queue.push_back(block.GetHash());
                     }
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
             }
         }
-    } catch (std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+    } catch (std::exception& e) {
+        LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
     }
+    return true;
+}
+}
+
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    std::string strReaderError;
+    ReadExternalBlockFile(fileIn, [&](CBlock& block, uint64_t nBlockPos, bool fPreChecked) {
+        return ImportExternalBlock(block, nBlockPos, fPreChecked, dbp, nLoaded);
+    }, strReaderError);
+
+    if (!strReaderError.empty())
+        AbortNode(std::string("System error: ") + strReaderError);
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -6051,13 +6735,18 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
 
+        // Hash the whole batch before taking cs_main. The headers up to a break in the sequence are still accepted.
+        CValidationState stateHeaders;
+        size_t nContinuous = 0;
+        bool fContinuous = CheckBlockHeaders(headers, stateHeaders, nContinuous);
+
+        LOCK(cs_main);
+
         bool ret = true;
         bool bFirst = true;
         std::string strError = "";
@@ -6067,16 +6756,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         CBlockIndex *pindexLast = NULL;
 
-        for (const CBlockHeader& header : headers) {
+        for (size_t n = 0; n < nContinuous; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), 20);
-                ret = false;
-                strError = "non-continuous headers sequence";
-                break;
-            }
-
             CBlockHeader pblockheader = CBlockHeader(header);
             if (!AcceptBlockHeader(pblockheader, state, &pindexLast)) {
                 int nDoS;
@@ -6097,6 +6779,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         }
 
+        int nDoSHeaders;
+        if (ret && !fContinuous && stateHeaders.IsInvalid(nDoSHeaders)) {
+            Misbehaving(pfrom->GetId(), nDoSHeaders);
+            ret = false;
+            strError = "non-continuous headers sequence";
+        }
+
         if (GetBoolArg("-headerspamfilter", DEFAULT_HEADER_SPAM_FILTER))
         {
             LOCK(cs_main);
@@ -6808,16 +7497,24 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, straight from the mapped file where possible
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        const char* pbegin;
+        const char* pend;
+        std::shared_ptr<const CMappedBlockFile> mapped = MapDiskRecord(pos, "rev", sizeof(hashChecksum), pbegin, pend);
+        if (mapped) {
+            CBufferReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            reader >> *this;
+            reader >> hashChecksum;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+            filein >> *this;
+            filein >> hashChecksum;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -6845,10 +7542,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -33,7 +33,9 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -51,6 +53,7 @@ class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -83,12 +86,26 @@ static const unsigned int MAX_TX_SIGOPS_CURRENT = MAX_BLOCK_SIGOPS_CURRENT / 5;
 static const unsigned int MAX_TX_SIGOPS_LEGACY = MAX_BLOCK_SIGOPS_LEGACY / 5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of transactions kept in the memory pool */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, expiration time for memory pool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -limitancestorcount, max number of in-pool ancestors of a transaction, including itself */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of a transaction together with its in-pool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+/** Default for -limitdescendantcount, max number of in-pool descendants of any ancestor, including itself */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of any ancestor together with its in-pool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Default for -checklevel, how thorough the block verification at startup is */
+static const int DEFAULT_CHECKLEVEL = 3;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -139,6 +156,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Owns the CBlockIndex entries of mapBlockIndex */
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -166,7 +185,6 @@ extern int64_t nReserveBalance;
 
 extern std::map<uint256, int64_t> mapRejectedBlocks;
 extern std::map<unsigned int, unsigned int> mapHashedBlocks;
-extern std::map<uint256, int64_t> mapZerocoinspends; //txid, time received
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex* pindexBestHeader;
@@ -200,9 +218,10 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @param[in]   pfrom   The node which we are receiving the block from; it is added to mapBlockSource and may be penalised if the block is invalid.
  * @param[in]   pblock  The block we want to process.
  * @param[out]  dbp     If pblock is stored to disk (or already there), this will be set to its location.
+ * @param[in]   fPreChecked  The proof of work, merkle root and block signature of pblock were already verified.
  * @return True if state.IsValid()
  */
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = NULL);
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = NULL, bool fPreChecked = false);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -213,6 +232,12 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/**
+ * Scan a file of blocks in blk file format, reading on one thread and checking proof of work, merkle root
+ * and signature of the blocks on others. func gets each block in file order with its position and whether
+ * those checks passed, and returns false to stop. Takes over fileIn. False with strError if reading failed.
+ */
+bool ReadExternalBlockFile(FILE* fileIn, const std::function<bool(CBlock&, uint64_t, bool)>& func, std::string& strError);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
@@ -232,6 +257,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinSpendCheck();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -272,6 +299,9 @@ void FlushStateToDisk();
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee = false, bool ignoreFees = false);
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
 int GetInputAge(CTxIn& vin);
@@ -365,9 +395,9 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool cacheStore = false, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool cacheStore = false, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -449,11 +479,48 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the proof verification of the zerocoin spends of one denomination
+ * against one accumulator, verified together as a batch (see libzerocoin::BatchVerify).
+ * The accumulator is rebuilt from its value when the check runs, so no chain state is touched by the worker
+ */
+class CZerocoinSpendCheck
+{
+private:
+    std::vector<std::shared_ptr<libzerocoin::CoinSpend> > vSpends;
+    std::vector<uint256> vTxids;
+    const libzerocoin::ZerocoinParams* params;
+    CBigNum bnAccumulatorValue;
+
+public:
+    CZerocoinSpendCheck() : params(NULL) {}
+    CZerocoinSpendCheck(const libzerocoin::ZerocoinParams* paramsIn, const CBigNum& bnAccumulatorValueIn) : params(paramsIn), bnAccumulatorValue(bnAccumulatorValueIn) {}
+
+    bool operator()();
+
+    void AddSpend(const libzerocoin::CoinSpend& spend, const uint256& txid);
+
+    /** Take over the spends of a check against the same accumulator */
+    void Merge(CZerocoinSpendCheck& check);
+
+    /** Denomination and accumulator checksum the spends were made against */
+    std::pair<libzerocoin::CoinDenomination, uint32_t> GetAccumulatorKey() const;
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        vSpends.swap(check.vSpends);
+        vTxids.swap(check.vTxids);
+        std::swap(params, check.params);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the block of pindex, from the hot block cache unless fUseCache is false (which also leaves the cache untouched) */
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fUseCache = true);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -461,8 +528,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. With fJustCheck only coins is
+ *  modified: the zerocoin database, the accumulator checkpoints and the wallet are left alone. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fJustCheck = false);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -472,7 +540,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
+/**
+ * Hash the headers of a headers message in one batch without any lock, and check that they link. nContinuous is
+ * set to the number of leading headers that form a sequence, state to a DoS for the first one that doesn't.
+ */
+bool CheckBlockHeaders(const std::vector<CBlock>& vHeaders, CValidationState& state, size_t& nContinuous);
+/**
+ * fCheckPayee false skips the masternode/budget payee check, which only holds for new blocks. If pvZerocoinChecks
+ * is given the zerocoin spend proofs are not verified here but handed to the caller, who can run them without cs_main.
+ */
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true,
+                bool fCheckPayee = true, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = NULL);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
@@ -621,12 +699,48 @@ public:
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB
 {
+private:
+    bool fShowProgress;
+    int nProgressStart; //! progress already shown when VerifyCoins starts
+    void ShowProgress(int nPercent);
+
 public:
-    CVerifyDB();
+    CVerifyDB(bool fShowProgressIn = true);
     ~CVerifyDB();
+    /**
+     * Levels 0 to 2 check the blocks on -par threads, only the structural part of CheckBlock takes cs_main
+     * and the spend proofs are verified without it. Levels 3 and 4 continue with VerifyCoins.
+     */
     bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth);
+    /**
+     * Levels 3 and 4 on a private view on top of coinsview, holding cs_main throughout. Level 3 disconnects
+     * blocks from that view only and is safe to run while the node is serving. Reconnecting blocks at level 4
+     * rewrites their zerocoin spends and mints, so outside of verifychain it only runs at startup with
+     * -checklevel=4, with fVerifyingBlocks set and before the wallet is loaded.
+     */
+    bool VerifyCoins(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, std::string& strError);
 };
 
+/** Progress of the latest VerifyDB run, see getverifystatus */
+struct CVerifyDBStatus {
+    enum State {
+        NOT_STARTED,
+        RUNNING,
+        PASSED,
+        FAILED
+    };
+
+    State state;
+    int nCheckLevel;
+    int nCheckDepth;
+    int nBlocksChecked; //! blocks through check levels 0 to 2
+    std::string strError;
+
+    CVerifyDBStatus() : state(NOT_STARTED), nCheckLevel(0), nCheckDepth(0), nBlocksChecked(0) {}
+};
+
+CVerifyDBStatus GetVerifyDBStatus();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
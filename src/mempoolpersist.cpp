@@ -0,0 +1,213 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempoolpersist.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+//! Bump when the layout of the dump changes, older dumps are then ignored
+const int MEMPOOL_DUMP_VERSION = 2;
+
+//! Set once LoadMempool is done with the dump, or found none. Until then the dump is kept.
+std::atomic<bool> fMempoolLoaded(false);
+
+boost::filesystem::path GetDumpPath()
+{
+    return GetDataDir() / MEMPOOL_DUMP_FILENAME;
+}
+
+class CDumpedEntry
+{
+public:
+    CTransaction tx;
+    int64_t nTime;
+
+    CDumpedEntry() : nTime(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(tx);
+        READWRITE(nTime);
+    }
+};
+}
+
+bool DumpMempool(const CTxMemPool& pool)
+{
+    if (!fMempoolLoaded) {
+        LogPrintf("%s : the previous mempool dump was not loaded completely, keeping it\n", __func__);
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+
+    // Parents have fewer in-pool ancestors than their children, so the loader sees them first
+    std::vector<std::pair<uint64_t, CDumpedEntry> > vEntries;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(pool.cs);
+        vEntries.reserve(pool.mapTx.size());
+        for (const std::pair<const uint256, CTxMemPoolEntry>& item : pool.mapTx) {
+            const CTxMemPoolEntry& entry = item.second;
+            vEntries.push_back(std::make_pair(entry.GetCountWithAncestors(), CDumpedEntry()));
+            CDumpedEntry& dumped = vEntries.back().second;
+            dumped.tx = entry.GetTx();
+            dumped.nTime = entry.GetTime();
+        }
+        mapDeltas = pool.mapDeltas;
+    }
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const std::pair<uint64_t, CDumpedEntry>& a, const std::pair<uint64_t, CDumpedEntry>& b) {
+        return a.first < b.first;
+    });
+
+    // Write to a temporary file first, a half written dump must never be picked up
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char*)&randv, sizeof(randv));
+    boost::filesystem::path pathTmp = GetDataDir() / strprintf("%s.%04x", MEMPOOL_DUMP_FILENAME, randv);
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    try {
+        // serialize entries and deltas, then append a checksum of everything written
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(Params().MessageStart());
+        ss << MEMPOOL_DUMP_VERSION;
+        ss << (uint64_t)vEntries.size();
+        for (const std::pair<uint64_t, CDumpedEntry>& item : vEntries)
+            ss << item.second;
+        ss << mapDeltas;
+        uint256 hash = Hash(ss.begin(), ss.end());
+        ss << hash;
+        fileout.write(&ss[0], ss.size());
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, GetDumpPath())) {
+        boost::filesystem::remove(pathTmp);
+        return error("%s : Rename-into-place failed", __func__);
+    }
+
+    LogPrintf("Dumped mempool with %u transactions  %dms\n", vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+namespace
+{
+//! Re-validate the entries of the dump file into pool, false if there is none or it can't be read
+bool LoadMempoolDump(CTxMemPool& pool)
+{
+    boost::filesystem::path path = GetDumpPath();
+    if (!boost::filesystem::exists(path))
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    std::vector<char> vData;
+    {
+        FILE* file = fopen(path.string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s : Failed to open %s", __func__, path.string());
+        try {
+            vData.resize(boost::filesystem::file_size(path));
+            if (!vData.empty())
+                filein.read(vData.data(), vData.size());
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    if (vData.size() < sizeof(uint256))
+        return error("%s : Failed to read %s", __func__, path.string());
+
+    const char* pbegin = vData.data();
+    const char* pend = pbegin + vData.size() - sizeof(uint256);
+    uint256 hashChecksum;
+    memcpy(hashChecksum.begin(), pend, sizeof(uint256));
+    if (hashChecksum != Hash(pbegin, pend))
+        return error("%s : Checksum mismatch, data corrupted", __func__);
+
+    std::vector<CDumpedEntry> vEntries;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    CBufferReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+    try {
+        unsigned char pchMsgTmp[4];
+        int nVersion;
+        uint64_t nEntries;
+        reader >> FLATDATA(pchMsgTmp) >> nVersion >> nEntries;
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s : Invalid network magic number", __func__);
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s : Unknown mempool dump version %d", __func__, nVersion);
+
+        vEntries.resize(nEntries);
+        for (CDumpedEntry& dumped : vEntries)
+            reader >> dumped;
+        reader >> mapDeltas;
+        if (!reader.eof())
+            throw std::ios_base::failure("trailing data");
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    for (const std::pair<const uint256, std::pair<double, CAmount> >& item : mapDeltas)
+        pool.PrioritiseTransaction(item.first, item.first.ToString(), item.second.first, item.second.second);
+
+    int64_t nExpiryTime = GetTime() - GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    unsigned int nAccepted = 0, nFailed = 0, nExpired = 0;
+    size_t i = 0;
+    while (i < vEntries.size()) {
+        boost::this_thread::interruption_point();
+
+        LOCK(cs_main);
+        for (size_t nEnd = std::min(i + MEMPOOL_LOAD_BATCH_SIZE, vEntries.size()); i < nEnd; i++) {
+            const CDumpedEntry& dumped = vEntries[i];
+            if (dumped.nTime < nExpiryTime) {
+                nExpired++;
+                continue;
+            }
+
+            CValidationState state;
+            if (AcceptToMemoryPoolWithTime(pool, state, dumped.tx, false, NULL, dumped.nTime))
+                nAccepted++;
+            else
+                nFailed++;
+        }
+    }
+
+    LogPrintf("Loaded %u mempool transactions from dump, %u failed, %u expired  %dms\n", nAccepted, nFailed, nExpired, GetTimeMillis() - nStart);
+    return true;
+}
+}
+
+bool LoadMempool(CTxMemPool& pool)
+{
+    // An interruption throws past this, so a dump not loaded completely survives the shutdown
+    bool fLoaded = LoadMempoolDump(pool);
+    fMempoolLoaded = true;
+    return fLoaded;
+}
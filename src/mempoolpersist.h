@@ -0,0 +1,35 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_MEMPOOLPERSIST_H
+#define BEETLECOIN_MEMPOOLPERSIST_H
+
+class CTxMemPool;
+
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+
+/** File in the data directory holding the memory pool written at shutdown */
+static const char* const MEMPOOL_DUMP_FILENAME = "mempool.dat";
+
+/** Number of dumped transactions re-validated per cs_main acquisition while loading */
+static const unsigned int MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+/**
+ * Write the transactions in the pool to the dump file, together with their entry time
+ * and the prioritisation deltas of mapDeltas. Does nothing until LoadMempool is done,
+ * so that a dump that was not loaded completely isn't lost.
+ */
+bool DumpMempool(const CTxMemPool& pool);
+
+/**
+ * Re-validate the dumped transactions into the pool, a batch at a time so cs_main is not
+ * held for the whole run. Meant for a background thread once the chain is loaded. Entries
+ * keep their entry time, dumped ones older than -mempoolexpiry are dropped. Every
+ * transaction, zerocoin spends included, goes through AcceptToMemoryPool in full. Returns
+ * false if there is no dump or it can't be read.
+ */
+bool LoadMempool(CTxMemPool& pool);
+
+#endif // BEETLECOIN_MEMPOOLPERSIST_H
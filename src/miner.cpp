@@ -31,7 +31,6 @@
 
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 
 using namespace std;
 
@@ -40,54 +39,10 @@ using namespace std;
 // BeetleCoinMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
-{
-    bool byFee;
-
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
-    {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
-    }
-};
-
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -98,6 +53,241 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 }
 
 std::pair<int, std::pair<uint256, uint256> > pCheckpointCache;
+
+CAmount AddMempoolTransactions(CBlockTemplate* pblocktemplate, int nHeight, uint64_t& nBlockSize)
+{
+    // Largest block you're willing to create:
+    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
+
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    CBlock* pblock = &pblocktemplate->block;
+    CAmount nFees = 0;
+    CCoinsViewCache view(pcoinsTip);
+
+    bool fPrintPriority = GetBoolArg("-printpriority", false);
+    // A block with zerocoin transactions before zerocoin starts would fail TestBlockValidity and clear the pool
+    bool fZerocoinDisabled = GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) || nHeight < Params().Zerocoin_StartHeight();
+
+    // Collect transactions into block
+    nBlockSize = 1000;
+    int nBlockSigOps = 100;
+    const unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+
+    CTxMemPool::setEntries setInBlock;
+    CTxMemPool::setEntries setFailed;
+    std::set<uint256> setBlockSerials;
+
+    // Check a single mempool transaction against the block assembled so far
+    // and add it. Its in-pool parents have to be in the block already.
+    auto addTx = [&](CTxMemPool::txiter iter, double dPriority) -> bool {
+        CTxMemPoolEntry& entry = iter->second;
+        const CTransaction& tx = entry.GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+            return false;
+        if (fZerocoinDisabled && tx.ContainsZerocoins())
+            return false;
+
+        // Size limits
+        unsigned int nTxSize = entry.GetTxSize();
+        if (nBlockSize + nTxSize >= nBlockMaxSize)
+            return false;
+
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = entry.GetSigOpCount();
+        if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+            return false;
+
+        if (!tx.IsZerocoinSpend()) {
+            //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+            for (const CTxIn& txin : tx.vin) {
+                if (invalid_out::ContainsOutPoint(txin.prevout)) {
+                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                    return false;
+                }
+            }
+        }
+
+        if (!view.HaveInputs(tx))
+            return false;
+
+        // double check that there are no double spent zBEET spends in this block or tx
+        const vector<uint256>& vTxSerials = entry.GetZerocoinSerialHashes();
+        if (tx.IsZerocoinSpend()) {
+            int nHeightTx = 0;
+            if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+                return false;
+
+            //This zBEET serial has already been included in the block or twice in this tx, do not add this tx.
+            std::set<uint256> setTxSerials;
+            for (const uint256& hashSerial : vTxSerials) {
+                if (setBlockSerials.count(hashSerial) || !setTxSerials.insert(hashSerial).second)
+                    return false;
+            }
+
+            for (const CTxIn txIn : tx.vin) {
+                if (txIn.scriptSig.IsZerocoinSpend()) {
+                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+                    bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend.getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                    if (!spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
+                        return false;
+                }
+            }
+        }
+
+        CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+        nTxSigOps += GetP2SHSigOpCount(tx, view);
+        if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+            return false;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+        // AcceptToMemoryPool already ran this check, and a pass holds for
+        // as long as the transaction stays in the pool.
+        CValidationState state;
+        if (!entry.InputsChecked()) {
+            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+                return false;
+            entry.SetInputsChecked();
+        }
+
+        CTxUndo txundo;
+        UpdateCoins(tx, state, view, txundo, nHeight);
+
+        // Added
+        pblock->vtx.push_back(tx);
+        pblocktemplate->vTxFees.push_back(nTxFees);
+        pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+        nBlockSize += nTxSize;
+        nBlockSigOps += nTxSigOps;
+        nFees += nTxFees;
+        setInBlock.insert(iter);
+
+        setBlockSerials.insert(vTxSerials.begin(), vTxSerials.end());
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, CFeeRate(entry.GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
+        }
+        return true;
+    };
+
+    // Zerocoin spends come first.
+    //Priority = (age^6+100000)*amount - gives higher priority to zbeets that have been in mempool long
+    //and higher priority to zbeets that are large in value
+    vector<pair<double, CTxMemPool::txiter> > vZerocoinSpends;
+    for (CTxMemPool::txiter iter : mempool.GetZerocoinSpends()) {
+        double nTimePriority = std::pow(GetTime() - iter->second.GetTime(), 6);
+
+        // zBEET spends can have very large priority, use non-overflowing safe functions
+        double dPriority = double_safe_addition(0, (nTimePriority * 100000));
+        dPriority = double_safe_multiplication(dPriority, iter->second.GetTx().GetZerocoinSpent());
+        vZerocoinSpends.push_back(make_pair(dPriority, iter));
+    }
+    std::sort(vZerocoinSpends.begin(), vZerocoinSpends.end(), [](const pair<double, CTxMemPool::txiter>& a, const pair<double, CTxMemPool::txiter>& b) {
+        return a.first > b.first;
+    });
+    for (const pair<double, CTxMemPool::txiter>& spend : vZerocoinSpends)
+        addTx(spend.second, spend.first);
+
+    // Then high-priority transactions up to nBlockPrioritySize, regardless of
+    // fee. A transaction whose parents are not in the block yet is left for
+    // the fee rate pass below.
+    if (nBlockPrioritySize > 0) {
+        const CTxMemPool::indexed_priority& byPriority = mempool.GetPriorityIndex(nHeight);
+        for (CTxMemPool::txiter iter : byPriority) {
+            double dPriority = iter->second.GetCachedPriority();
+            if (!AllowFree(dPriority) || nBlockSize + iter->second.GetTxSize() >= nBlockPrioritySize)
+                break;
+
+            bool fParentsInBlock = true;
+            for (CTxMemPool::txiter itParent : mempool.GetMemPoolParents(iter)) {
+                if (!setInBlock.count(itParent)) {
+                    fParentsInBlock = false;
+                    break;
+                }
+            }
+            if (fParentsInBlock && !setInBlock.count(iter))
+                addTx(iter, dPriority);
+        }
+    }
+
+    // Fill the rest by ancestor fee rate: each candidate is added together
+    // with the in-pool ancestors the block does not contain yet.
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+    const CTxMemPool::indexed_ancestor_fee& byAncestorFee = mempool.GetAncestorFeeIndex();
+    for (CTxMemPool::txiter iter : byAncestorFee) {
+        if (setInBlock.count(iter) || setFailed.count(iter))
+            continue;
+
+        const CTxMemPoolEntry& entry = iter->second;
+
+        // Everything after this point pays less, so stop once past the minimum block size
+        CFeeRate ancestorFeeRate(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors());
+        if (ancestorFeeRate < ::minRelayTxFee && nBlockSize + entry.GetSizeWithAncestors() >= nBlockMinSize)
+            break;
+
+        CTxMemPool::setEntries setAncestors;
+        mempool.CalculateMemPoolAncestors(iter, setAncestors);
+        vector<CTxMemPool::txiter> vPackage;
+        uint64_t nPackageSize = entry.GetTxSize();
+        unsigned int nPackageSigOps = entry.GetSigOpCount();
+        bool fFailedAncestor = false;
+        for (CTxMemPool::txiter itAncestor : setAncestors) {
+            if (setInBlock.count(itAncestor))
+                continue;
+            if (setFailed.count(itAncestor)) {
+                fFailedAncestor = true;
+                break;
+            }
+            vPackage.push_back(itAncestor);
+            nPackageSize += itAncestor->second.GetTxSize();
+            nPackageSigOps += itAncestor->second.GetSigOpCount();
+        }
+        if (fFailedAncestor) {
+            setFailed.insert(iter);
+            continue;
+        }
+        vPackage.push_back(iter);
+
+        if (nBlockSize + nPackageSize >= nBlockMaxSize || nBlockSigOps + nPackageSigOps >= nMaxBlockSigOps) {
+            // Give up once the block is nearly full and nothing else fits
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 4000)
+                break;
+            continue;
+        }
+        nConsecutiveFailed = 0;
+
+        // A transaction always has more in-pool ancestors than any of its
+        // parents, so this puts the package in a valid order.
+        std::sort(vPackage.begin(), vPackage.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+            if (a->second.GetCountWithAncestors() != b->second.GetCountWithAncestors())
+                return a->second.GetCountWithAncestors() < b->second.GetCountWithAncestors();
+            return a->first < b->first;
+        });
+        for (CTxMemPool::txiter itPackage : vPackage) {
+            if (!addTx(itPackage, itPackage->second.GetModifiedPriority(nHeight)))
+                setFailed.insert(itPackage);
+        }
+    }
+
+    return nFees;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
 {
     CReserveKey reservekey(pwallet);
@@ -158,22 +348,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             return NULL;
     }
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
 
@@ -182,246 +356,11 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            uint256 txid = tx.GetHash();
-            for (const CTxIn& txin : tx.vin) {
-                //zerocoinspend has special vin
-                if (tx.IsZerocoinSpend()) {
-                    nTotalIn = tx.GetZerocoinSpent();
-
-                    //Give a high priority to zerocoinspends to get into the next block
-                    //Priority = (age^6+100000)*amount - gives higher priority to zbeets that have been in mempool long
-                    //and higher priority to zbeets that are large in value
-                    int64_t nTimeSeen = GetAdjustedTime();
-                    double nConfs = 100000;
-
-                    auto it = mapZerocoinspends.find(txid);
-                    if (it != mapZerocoinspends.end()) {
-                        nTimeSeen = it->second;
-                    } else {
-                        //for some reason not in map, add it
-                        mapZerocoinspends[txid] = nTimeSeen;
-                    }
-
-                    double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
-
-                    // zBEET spends can have very large priority, use non-overflowing safe functions
-                    dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
-                    dPriority = double_safe_multiplication(dPriority, nTotalIn);
-
-                    continue;
-                }
-
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (invalid_out::ContainsOutPoint(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
-                }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                // zBEET spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
 
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            // double check that there are no double spent zBEET spends in this block or tx
-            if (tx.IsZerocoinSpend()) {
-                int nHeightTx = 0;
-                if (IsTransactionInChain(tx.GetHash(), nHeightTx))
-                    continue;
-
-                bool fDoubleSerial = false;
-                for (const CTxIn txIn : tx.vin) {
-                    if (txIn.scriptSig.IsZerocoinSpend()) {
-                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                        bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend.getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
-                        if (!spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
-                            fDoubleSerial = true;
-                        if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (fDoubleSerial)
-                            break;
-                        vTxSerials.emplace_back(spend.getCoinSerialNumber());
-                    }
-                }
-                //This zBEET serial has already been included in the block, do not add this tx.
-                if (fDoubleSerial)
-                    continue;
-            }
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        uint64_t nBlockSize;
+        size_t nFirstTx = pblock->vtx.size();
+        nFees = AddMempoolTransactions(pblocktemplate.get(), nHeight, nBlockSize);
+        uint64_t nBlockTx = pblock->vtx.size() - nFirstTx;
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -7,6 +7,8 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
+
 #include <stdint.h>
 
 class CBlock;
@@ -23,6 +25,13 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake);
+/**
+ * Append mempool transactions for a block at nHeight on top of pcoinsTip to the block of pblocktemplate:
+ * zerocoin spends first, then high priority transactions up to -blockprioritysize, then packages of a
+ * transaction and its in-pool ancestors not in the block yet, by ancestor fee rate. Sets nBlockSize to the
+ * size of the block so far and returns the fees of the added transactions. Needs cs_main and mempool.cs.
+ */
+CAmount AddMempoolTransactions(CBlockTemplate* pblocktemplate, int nHeight, uint64_t& nBlockSize);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
@@ -0,0 +1,286 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2015 The Bitcoin developers
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "policyestimator.h"
+
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <algorithm>
+
+namespace
+{
+//! Starts the estimator data in fee_estimates.dat. Negative, so that it can't be taken for
+//! the best seen height that files of the old sample based estimator start with.
+const int FEE_ESTIMATOR_FORMAT = -2;
+
+std::vector<double> MakeBuckets(double dMin, double dMax, double dSpacing)
+{
+    std::vector<double> vBuckets;
+    for (double dBoundary = dMin; dBoundary <= dMax; dBoundary *= dSpacing)
+        vBuckets.push_back(dBoundary);
+    vBuckets.push_back(1e99);
+    return vBuckets;
+}
+}
+
+void CConfirmStats::Initialize(const std::vector<double>& defaultBuckets, unsigned int maxConfirms, double _decay)
+{
+    decay = _decay;
+    buckets = defaultBuckets;
+    bucketMap.clear();
+    for (unsigned int i = 0; i < buckets.size(); i++)
+        bucketMap[buckets[i]] = i;
+    confAvg.assign(maxConfirms, std::vector<double>(buckets.size(), 0));
+    txCtAvg.assign(buckets.size(), 0);
+    avg.assign(buckets.size(), 0);
+}
+
+void CConfirmStats::UpdateMovingAverages()
+{
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        for (unsigned int i = 0; i < confAvg.size(); i++)
+            confAvg[i][j] *= decay;
+        txCtAvg[j] *= decay;
+        avg[j] *= decay;
+    }
+}
+
+void CConfirmStats::Record(int blocksToConfirm, double val)
+{
+    if (blocksToConfirm < 1)
+        return;
+    unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    for (size_t i = blocksToConfirm - 1; i < confAvg.size(); i++)
+        confAvg[i][bucketindex]++;
+    txCtAvg[bucketindex]++;
+    avg[bucketindex] += val;
+}
+
+double CConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal, double successBreakPoint) const
+{
+    if (confTarget < 1 || confTarget > (int)confAvg.size())
+        return -1;
+    const std::vector<double>& confirmed = confAvg[confTarget - 1];
+
+    // Going down from the best bucket, collect buckets until the range has enough
+    // transactions, then check whether enough of them confirmed in time. The range
+    // found last is the cheapest one that still worked.
+    double nConf = 0;
+    double totalNum = 0;
+    int curNearBucket = buckets.size() - 1;
+    int bestNearBucket = curNearBucket;
+    int bestFarBucket = curNearBucket;
+    bool foundAnswer = false;
+    for (int bucket = buckets.size() - 1; bucket >= 0; bucket--) {
+        nConf += confirmed[bucket];
+        totalNum += txCtAvg[bucket];
+        if (totalNum >= sufficientTxVal / (1 - decay)) {
+            if (nConf / totalNum < successBreakPoint)
+                break;
+            foundAnswer = true;
+            nConf = 0;
+            totalNum = 0;
+            bestNearBucket = curNearBucket;
+            bestFarBucket = bucket;
+            curNearBucket = bucket - 1;
+        }
+    }
+    if (!foundAnswer)
+        return -1;
+
+    // Median of the transactions in the range, the average value of the bucket it falls into
+    double txSum = 0;
+    for (int j = bestFarBucket; j <= bestNearBucket; j++)
+        txSum += txCtAvg[j];
+    if (txSum == 0)
+        return -1;
+    txSum = txSum / 2;
+    for (int j = bestFarBucket; j <= bestNearBucket; j++) {
+        if (txCtAvg[j] < txSum) {
+            txSum -= txCtAvg[j];
+        } else {
+            return avg[j] / txCtAvg[j];
+        }
+    }
+    return -1;
+}
+
+void CConfirmStats::Write(CAutoFile& fileout) const
+{
+    fileout << decay;
+    fileout << buckets;
+    fileout << avg;
+    fileout << txCtAvg;
+    fileout << confAvg;
+}
+
+void CConfirmStats::Read(CAutoFile& filein)
+{
+    double fileDecay;
+    std::vector<double> fileBuckets;
+    std::vector<double> fileAvg;
+    std::vector<double> fileTxCtAvg;
+    std::vector<std::vector<double> > fileConfAvg;
+    filein >> fileDecay >> fileBuckets >> fileAvg >> fileTxCtAvg >> fileConfAvg;
+
+    if (fileDecay <= 0 || fileDecay >= 1)
+        throw std::runtime_error("Corrupt estimates file. Decay must be between 0 and 1 (non-inclusive)");
+    if (fileBuckets.size() <= 1 || fileBuckets.size() > 1000)
+        throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 buckets");
+    if (fileAvg.size() != fileBuckets.size() || fileTxCtAvg.size() != fileBuckets.size())
+        throw std::runtime_error("Corrupt estimates file. Mismatch in bucket count");
+    if (fileConfAvg.size() != GetMaxConfirms())
+        throw std::runtime_error("Corrupt estimates file. Mismatch in confirm count");
+    for (unsigned int i = 0; i < fileConfAvg.size(); i++) {
+        if (fileConfAvg[i].size() != fileBuckets.size())
+            throw std::runtime_error("Corrupt estimates file. Mismatch in bucket count");
+    }
+    for (unsigned int i = 1; i < fileBuckets.size(); i++) {
+        if (fileBuckets[i] <= fileBuckets[i - 1])
+            throw std::runtime_error("Corrupt estimates file. Buckets out of order");
+    }
+
+    // Now that we've processed the entire data and not thrown any errors, take it over
+    Initialize(fileBuckets, fileConfAvg.size(), fileDecay);
+    avg = fileAvg;
+    txCtAvg = fileTxCtAvg;
+    confAvg = fileConfAvg;
+}
+
+CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee) : minRelayFee(_minRelayFee), nBestSeenHeight(0)
+{
+    feeStats.Initialize(MakeBuckets(MIN_FEERATE, MAX_FEERATE, FEE_SPACING), MAX_BLOCK_CONFIRMS, DEFAULT_DECAY);
+    priStats.Initialize(MakeBuckets(MIN_PRIORITY, MAX_PRIORITY, PRI_SPACING), MAX_BLOCK_CONFIRMS, DEFAULT_DECAY);
+}
+
+void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight, const std::vector<CTxMemPoolEntry>& entries, const CBlockFeeSummary& summary)
+{
+    // A block replacing one we saw (re-org) replaces its totals as well
+    while (!blockSummaries.empty() && blockSummaries.back().nHeight >= summary.nHeight)
+        blockSummaries.pop_back();
+    if (!blockSummaries.empty() && blockSummaries.back().nHeight + 1 != summary.nHeight)
+        blockSummaries.clear();
+    blockSummaries.push_back(summary);
+    if (blockSummaries.size() > MAX_BLOCK_FEE_SUMMARIES)
+        blockSummaries.pop_front();
+
+    if ((int)nBlockHeight <= nBestSeenHeight) {
+        // Ignore side chains and re-orgs; assuming they are random
+        // they don't affect the estimate.
+        // And if an attacker can re-org the chain at will, then
+        // you've got much bigger problems than "attacker can influence
+        // transaction fees."
+        return;
+    }
+    nBestSeenHeight = nBlockHeight;
+
+    feeStats.UpdateMovingAverages();
+    priStats.UpdateMovingAverages();
+
+    unsigned int nFeeRecorded = 0, nPriRecorded = 0;
+    for (const CTxMemPoolEntry& entry : entries) {
+        // How many blocks did it take for miners to include this transaction?
+        int blocksToConfirm = nBlockHeight - entry.GetHeight();
+        if (blocksToConfirm <= 0) {
+            // Re-org made us lose height, this should only happen if we happen
+            // to re-org on a difficulty transition point: very rare!
+            continue;
+        }
+
+        // We need to guess why the transaction was included in a block-- either
+        // because it is high-priority or because it has sufficient fees.
+        CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+        double dPriority = entry.GetPriority(entry.GetHeight()); // Want priority when it went IN
+        bool sufficientFee = (feeRate > minRelayFee);
+        bool sufficientPriority = AllowFree(dPriority);
+        if (sufficientFee && !sufficientPriority) {
+            feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+            nFeeRecorded++;
+        } else if (sufficientPriority && !sufficientFee) {
+            priStats.Record(blocksToConfirm, dPriority);
+            nPriRecorded++;
+        } else {
+            // Neither or both fee and priority sufficient to get confirmed:
+            // don't know why they got confirmed.
+        }
+    }
+
+    LogPrint("estimatefee", "Block %u: recorded %u fee and %u priority confirmations, estimates fee=%s prio=%g for 1 block\n",
+        nBlockHeight, nFeeRecorded, nPriRecorded, estimateFee(1).ToString(), estimatePriority(1));
+}
+
+CFeeRate CBlockPolicyEstimator::estimateFee(int nBlocksToConfirm) const
+{
+    double median = feeStats.EstimateMedianVal(nBlocksToConfirm, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT);
+    if (median < 0)
+        return CFeeRate(0);
+    return CFeeRate((CAmount)median);
+}
+
+double CBlockPolicyEstimator::estimatePriority(int nBlocksToConfirm) const
+{
+    return priStats.EstimateMedianVal(nBlocksToConfirm, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT);
+}
+
+bool CBlockPolicyEstimator::GetBlockFeeSummary(int nStartHeight, int nEndHeight, CBlockFeeSummary& total) const
+{
+    total = CBlockFeeSummary();
+    if (blockSummaries.empty() || nStartHeight > nEndHeight)
+        return false;
+    int nFirstHeight = blockSummaries.front().nHeight;
+    if (nStartHeight < nFirstHeight || nEndHeight > blockSummaries.back().nHeight)
+        return false;
+
+    total.nHeight = nEndHeight;
+    for (int nHeight = nStartHeight; nHeight <= nEndHeight; nHeight++) {
+        const CBlockFeeSummary& summary = blockSummaries[nHeight - nFirstHeight];
+        total.nTxCount += summary.nTxCount;
+        total.nTxBytes += summary.nTxBytes;
+        total.nFees += summary.nFees;
+    }
+    return true;
+}
+
+void CBlockPolicyEstimator::Write(CAutoFile& fileout) const
+{
+    fileout << FEE_ESTIMATOR_FORMAT;
+    fileout << nBestSeenHeight;
+    feeStats.Write(fileout);
+    priStats.Write(fileout);
+    std::vector<CBlockFeeSummary> vSummaries(blockSummaries.begin(), blockSummaries.end());
+    fileout << vSummaries;
+}
+
+void CBlockPolicyEstimator::Read(CAutoFile& filein)
+{
+    int nFormat, nFileBestSeenHeight;
+    filein >> nFormat;
+    if (nFormat != FEE_ESTIMATOR_FORMAT)
+        throw std::runtime_error("Estimates file is from an older estimator, ignoring it");
+    filein >> nFileBestSeenHeight;
+
+    CConfirmStats fileFeeStats = feeStats;
+    CConfirmStats filePriStats = priStats;
+    fileFeeStats.Read(filein);
+    filePriStats.Read(filein);
+
+    std::vector<CBlockFeeSummary> vSummaries;
+    filein >> vSummaries;
+    if (vSummaries.size() > MAX_BLOCK_FEE_SUMMARIES)
+        throw std::runtime_error("Corrupt estimates file. Too many block summaries");
+    for (unsigned int i = 1; i < vSummaries.size(); i++) {
+        if (vSummaries[i].nHeight != vSummaries[i - 1].nHeight + 1)
+            throw std::runtime_error("Corrupt estimates file. Block summaries not consecutive");
+    }
+
+    nBestSeenHeight = nFileBestSeenHeight;
+    feeStats = fileFeeStats;
+    priStats = filePriStats;
+    blockSummaries.assign(vSummaries.begin(), vSummaries.end());
+    LogPrint("estimatefee", "Read estimates up to height %d and %u block summaries\n", nBestSeenHeight, blockSummaries.size());
+}
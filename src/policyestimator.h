@@ -0,0 +1,137 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2015 The Bitcoin developers
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_POLICYESTIMATOR_H
+#define BEETLECOIN_POLICYESTIMATOR_H
+
+#include "amount.h"
+#include "serialize.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class CAutoFile;
+class CTxMemPoolEntry;
+
+/**
+ * The estimator sorts every transaction a block confirms into a bucket by its fee rate
+ * (or priority) and remembers, per bucket, how many transactions confirmed within 1, 2,
+ * ... MAX_BLOCK_CONFIRMS blocks of entering the mempool. All counts decay exponentially
+ * per block, so old blocks fade out without having to keep their samples. An estimate
+ * walks the buckets from the best value down and returns the median value of the cheapest
+ * range of buckets in which at least MIN_SUCCESS_PCT of the transactions confirmed within
+ * the target. Updating is O(buckets * confirms) per block and an estimate O(buckets).
+ */
+
+/** Track confirm delays up to this many blocks */
+static const unsigned int MAX_BLOCK_CONFIRMS = 25;
+
+/** Decay of the counts per block, a half life of about 350 blocks */
+static const double DEFAULT_DECAY = .998;
+
+/** Share of the transactions in a bucket range that must have confirmed within the target */
+static const double MIN_SUCCESS_PCT = .85;
+
+/** Decayed transactions per block a bucket range needs before it is trusted */
+static const double SUFFICIENT_FEETXS = 0.1;
+static const double SUFFICIENT_PRITXS = 0.1;
+
+/** Bucket boundaries, the buckets are spaced exponentially between these */
+static const double MIN_FEERATE = 10;
+static const double MAX_FEERATE = 1e8;
+static const double FEE_SPACING = 1.1;
+static const double MIN_PRIORITY = 10;
+static const double MAX_PRIORITY = 1e16;
+static const double PRI_SPACING = 2;
+
+/** Number of recent blocks whose fee totals are kept for getfeeinfo */
+static const unsigned int MAX_BLOCK_FEE_SUMMARIES = 10000;
+
+/** Totals of the transactions in a block, except the coinbase and coinstake */
+class CBlockFeeSummary
+{
+public:
+    int nHeight;
+    int64_t nTxCount;
+    int64_t nTxBytes;
+    CAmount nFees;
+
+    CBlockFeeSummary() : nHeight(0), nTxCount(0), nTxBytes(0), nFees(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nHeight);
+        READWRITE(nTxCount);
+        READWRITE(nTxBytes);
+        READWRITE(nFees);
+    }
+};
+
+/** Decayed confirmation counts of one kind of value (fee rate or priority) by bucket */
+class CConfirmStats
+{
+private:
+    std::vector<double> buckets;               //! Upper bound of each bucket, the last one catches everything above
+    std::map<double, unsigned int> bucketMap;  //! Bucket index by upper bound
+    std::vector<std::vector<double> > confAvg; //! confAvg[i][b]: transactions in bucket b confirmed within i + 1 blocks
+    std::vector<double> txCtAvg;               //! Confirmed transactions in each bucket
+    std::vector<double> avg;                   //! Sum of the values of the confirmed transactions in each bucket
+    double decay;
+
+public:
+    void Initialize(const std::vector<double>& defaultBuckets, unsigned int maxConfirms, double decay);
+
+    /** Age all counts by one block */
+    void UpdateMovingAverages();
+
+    /** Record a transaction with value val that confirmed blocksToConfirm (>= 1) blocks after entering the pool */
+    void Record(int blocksToConfirm, double val);
+
+    /**
+     * The median value of the lowest range of buckets in which enough transactions confirmed within
+     * confTarget blocks, or -1 if there is not enough data.
+     */
+    double EstimateMedianVal(int confTarget, double sufficientTxVal, double successBreakPoint) const;
+
+    unsigned int GetMaxConfirms() const { return confAvg.size(); }
+
+    void Write(CAutoFile& fileout) const;
+    void Read(CAutoFile& filein);
+};
+
+class CBlockPolicyEstimator
+{
+private:
+    CFeeRate minRelayFee;
+    int nBestSeenHeight;
+    CConfirmStats feeStats;
+    CConfirmStats priStats;
+    std::deque<CBlockFeeSummary> blockSummaries; //! Consecutive recent blocks, oldest first
+
+public:
+    CBlockPolicyEstimator(const CFeeRate& minRelayFee);
+
+    /** Learn from the pool entries a block at nBlockHeight confirmed, and remember the block's totals */
+    void processBlock(unsigned int nBlockHeight, const std::vector<CTxMemPoolEntry>& entries, const CBlockFeeSummary& summary);
+
+    /** Fee rate needed to confirm within nBlocksToConfirm blocks, CFeeRate(0) if unknown */
+    CFeeRate estimateFee(int nBlocksToConfirm) const;
+
+    /** Priority needed to confirm within nBlocksToConfirm blocks, -1 if unknown */
+    double estimatePriority(int nBlocksToConfirm) const;
+
+    /** Sum the block totals of heights nStartHeight to nEndHeight, false if some of them are not known */
+    bool GetBlockFeeSummary(int nStartHeight, int nEndHeight, CBlockFeeSummary& total) const;
+
+    void Write(CAutoFile& fileout) const;
+    void Read(CAutoFile& filein);
+};
+
+#endif // BEETLECOIN_POLICYESTIMATOR_H
@@ -13,10 +13,55 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+CBlockHeader& CBlockHeader::operator=(const CBlockHeader& other)
+{
+    nVersion = other.nVersion;
+    hashPrevBlock = other.hashPrevBlock;
+    hashMerkleRoot = other.hashMerkleRoot;
+    nTime = other.nTime;
+    nBits = other.nBits;
+    nNonce = other.nNonce;
+    nAccumulatorCheckpoint = other.nAccumulatorCheckpoint;
+
+    // copies keep the hash other has cached, if any
+    if (other.nHashCacheState.load(std::memory_order_acquire) == HASH_CACHE_READY) {
+        hashCached = other.hashCached;
+        memcpy(vchHashedHeader, other.vchHashedHeader, sizeof(vchHashedHeader));
+        nHashCacheState.store(HASH_CACHE_READY, std::memory_order_release);
+    } else {
+        nHashCacheState.store(HASH_CACHE_EMPTY, std::memory_order_release);
+    }
+    return *this;
+}
+
+void CBlockHeader::SetCachedHash(const uint256& hash) const
+{
+    if (nVersion >= 4)
+        return;
+
+    // only the thread that moves the cache out of the empty state writes it, readers wait for the release below
+    int nState = HASH_CACHE_EMPTY;
+    if (!nHashCacheState.compare_exchange_strong(nState, HASH_CACHE_WRITING, std::memory_order_acquire))
+        return;
+    hashCached = hash;
+    memcpy(vchHashedHeader, BEGIN(nVersion), sizeof(vchHashedHeader));
+    nHashCacheState.store(HASH_CACHE_READY, std::memory_order_release);
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    if (nVersion < 4)
-        return XEVAN(BEGIN(nVersion), END(nNonce));
+    if (nVersion < 4) {
+        // XEVAN is expensive, so the hash is remembered together with the header it was computed from.
+        // Any change to the header fields makes the comparison fail and the hash is computed again.
+        assert(END(nNonce) - BEGIN(nVersion) == sizeof(vchHashedHeader));
+        if (nHashCacheState.load(std::memory_order_acquire) == HASH_CACHE_READY &&
+            memcmp(vchHashedHeader, BEGIN(nVersion), sizeof(vchHashedHeader)) == 0)
+            return hashCached;
+
+        uint256 hash = XEVAN(BEGIN(nVersion), END(nNonce));
+        SetCachedHash(hash);
+        return hash;
+    }
     else
         return Hash(BEGIN(nVersion), END(nAccumulatorCheckpoint));
 }
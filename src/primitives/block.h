@@ -12,6 +12,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+
 /** The maximum allowed size for a serialized block, in bytes (network rule) */
 static const unsigned int MAX_BLOCK_SIZE_CURRENT = 2000000;
 static const unsigned int MAX_BLOCK_SIZE_LEGACY = 1000000;
@@ -36,11 +38,26 @@ public:
     uint32_t nNonce;
     uint256 nAccumulatorCheckpoint;
 
-    CBlockHeader()
+    // memory only: the XEVAN hash of a pre-v4 header and the header bytes it was computed from, see GetHash.
+    // They are written at most once between resets and published through nHashCacheState, so threads sharing
+    // a const header never see them half written.
+    enum { HASH_CACHE_EMPTY, HASH_CACHE_WRITING, HASH_CACHE_READY };
+    mutable uint256 hashCached;
+    mutable unsigned char vchHashedHeader[80];
+    mutable std::atomic<int> nHashCacheState;
+
+    CBlockHeader() : nHashCacheState(HASH_CACHE_EMPTY)
     {
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other) : nHashCacheState(HASH_CACHE_EMPTY)
+    {
+        *this = other;
+    }
+
+    CBlockHeader& operator=(const CBlockHeader& other);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -56,6 +73,9 @@ public:
         //zerocoin active, header changes to include accumulator checksum
         if (nVersion > 3)
             READWRITE(nAccumulatorCheckpoint);
+
+        if (ser_action.ForRead())
+            nHashCacheState = HASH_CACHE_EMPTY;
     }
 
     void SetNull()
@@ -67,6 +87,7 @@ public:
         nBits = 0;
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
+        nHashCacheState = HASH_CACHE_EMPTY;
     }
 
     bool IsNull() const
@@ -76,6 +97,9 @@ public:
 
     uint256 GetHash() const;
 
+    // Remember the hash of a pre-v4 header that was computed elsewhere, e.g. by XEVANBatch
+    void SetCachedHash(const uint256& hash) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -128,15 +152,8 @@ public:
 
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
-        return block;
+        // copies the cached header hash along with the fields
+        return *this;
     }
 
     // ppcoin: two types of block: proof-of-work or proof-of-stake
@@ -9,6 +9,7 @@
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "main.h"
+#include "policyestimator.h"
 #include "rpcserver.h"
 #include "sync.h"
 #include "txdb.h"
@@ -16,8 +17,10 @@
 #include "utilmoneystr.h"
 #include "accumulatormap.h"
 #include "accumulators.h"
+#include "blockcache.h"
 #include "wallet.h"
 #include "zbeetchain.h"
+#include "zbeetspendcache.h"
 
 #include <stdint.h>
 #include <fstream>
@@ -130,7 +133,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     UniValue zbeetObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zbeetObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zbeetObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->GetZcMints(denom) * (denom*COIN))));
     }
     zbeetObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.push_back(Pair("zBEETsupply", zbeetObj));
@@ -195,9 +198,9 @@ UniValue mempoolToJSON(bool fVerbose = false)
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            const uint256& hash = it->first;
+            const CTxMemPoolEntry& e = it->second;
             UniValue info(UniValue::VOBJ);
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -205,12 +208,15 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
             info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
+            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+            BOOST_FOREACH (CTxMemPool::txiter itParent, mempool.GetMemPoolParents(it))
+                setDepends.insert(itParent->first.ToString());
 
             UniValue depends(UniValue::VARR);
             BOOST_FOREACH(const string& dep, setDepends) {
@@ -258,6 +264,12 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) fees of in-mempool descendants in satoshis, including prioritisation (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) fees of in-mempool ancestors in satoshis, including prioritisation (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -572,18 +584,54 @@ UniValue verifychain(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("verifychain", "") + HelpExampleRpc("verifychain", ""));
 
-    LOCK(cs_main);
-
     int nCheckLevel = 4;
     int nCheckDepth = GetArg("-checkblocks", 288);
     if (params.size() > 0)
         nCheckDepth = params[0].get_int();
 
-    fVerifyingBlocks = true;
-    bool fVerified = CVerifyDB().VerifyDB(pcoinsTip, nCheckLevel, nCheckDepth);
-    fVerifyingBlocks = false;
+    // VerifyDB takes cs_main itself, its worker threads need it as well
+    return CVerifyDB().VerifyDB(pcoinsTip, nCheckLevel, nCheckDepth);
+}
 
-    return fVerified;
+UniValue getverifystatus(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getverifystatus\n"
+            "\nReturns the progress of the block database verification that runs in the background after startup\n"
+            "(check levels 0 to 2, the coins are checked before startup completes), or of the last verifychain call.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"state\": \"xxxx\",         (string) One of \"not started\", \"running\", \"passed\" or \"failed\"\n"
+            "  \"checklevel\": n,         (numeric) The check level\n"
+            "  \"checkdepth\": n,         (numeric) The number of blocks to check\n"
+            "  \"checked\": n,            (numeric) The number of blocks read and checked so far\n"
+            "  \"progress\": x.xxx,       (numeric) checked / checkdepth\n"
+            "  \"error\": \"xxxx\"          (string, optional) What failed\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getverifystatus", "") + HelpExampleRpc("getverifystatus", ""));
+
+    CVerifyDBStatus status = GetVerifyDBStatus();
+    const char* pszState = "not started";
+    if (status.state == CVerifyDBStatus::RUNNING)
+        pszState = "running";
+    else if (status.state == CVerifyDBStatus::PASSED)
+        pszState = "passed";
+    else if (status.state == CVerifyDBStatus::FAILED)
+        pszState = "failed";
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("state", pszState));
+    obj.push_back(Pair("checklevel", status.nCheckLevel));
+    obj.push_back(Pair("checkdepth", status.nCheckDepth));
+    obj.push_back(Pair("checked", status.nBlocksChecked));
+    obj.push_back(Pair("progress", status.nCheckDepth > 0 ? (double)status.nBlocksChecked / status.nCheckDepth : 0.0));
+    if (status.state == CVerifyDBStatus::FAILED)
+        obj.push_back(Pair("error", status.strError));
+    return obj;
 }
 
 UniValue getblockchaininfo(const UniValue& params, bool fHelp)
@@ -601,7 +649,13 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"blockcache\": {            (object) cache of recently read or connected blocks\n"
+            "    \"blocks\": xxxxx,          (numeric) number of blocks cached\n"
+            "    \"bytes\": xxxxx,           (numeric) serialized size of the cached blocks\n"
+            "    \"hits\": xxxxx,            (numeric) block reads served from the cache\n"
+            "    \"misses\": xxxxx           (numeric) block reads that went to disk\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -617,6 +671,15 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+
+    uint64_t nBlocks, nBytes, nHits, nMisses;
+    GetBlockCacheStats(nBlocks, nBytes, nHits, nMisses);
+    UniValue blockCache(UniValue::VOBJ);
+    blockCache.push_back(Pair("blocks", (int64_t) nBlocks));
+    blockCache.push_back(Pair("bytes", (int64_t) nBytes));
+    blockCache.push_back(Pair("hits", (int64_t) nHits));
+    blockCache.push_back(Pair("misses", (int64_t) nMisses));
+    obj.push_back(Pair("blockcache", blockCache));
     return obj;
 }
 
@@ -729,6 +792,7 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
         throw runtime_error(
             "getfeeinfo blocks\n"
             "\nReturns details of transaction fees over the last n blocks.\n"
+            "Only the blocks connected by this node are known, up to the last " + std::to_string(MAX_BLOCK_FEE_SUMMARIES) + ".\n"
 
             "\nArguments:\n"
             "1. blocks     (int, required) the number of blocks to get transaction data from\n"
@@ -753,56 +817,21 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
     if (nBlocks < 0 || nStartHeight <= 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid start height");
 
-    CAmount nFees = 0;
-    int64_t nBytes = 0;
-    int64_t nTotal = 0;
-    for (int i = nStartHeight; i <= nBestHeight; i++) {
-        CBlockIndex* pindex = chainActive[i];
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase() || tx.IsCoinStake())
-                continue;
-
-            for (unsigned int j = 0; j < tx.vin.size(); j++) {
-                if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
-                    nValueIn += tx.vin[j].nSequence * COIN;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
-                    throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            for (unsigned int j = 0; j < tx.vout.size(); j++) {
-                nValueOut += tx.vout[j].nValue;
-            }
-
-            nFees += nValueIn - nValueOut;
-            nBytes += tx.GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
-            nTotal++;
-        }
-
-        pindex = chainActive.Next(pindex);
-        if (!pindex)
-            break;
-    }
+    // Answered from the totals the fee estimator keeps for recent blocks, without reading them from disk
+    CBlockFeeSummary summary;
+    if (!mempool.GetBlockFeeSummary(nStartHeight, nBestHeight, summary))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("fee data is only kept for the last %u blocks connected by this node", MAX_BLOCK_FEE_SUMMARIES));
 
     UniValue ret(UniValue::VOBJ);
-    CFeeRate nFeeRate = CFeeRate(nFees, nBytes);
-    ret.push_back(Pair("txcount", (int64_t)nTotal));
-    ret.push_back(Pair("txbytes", (int64_t)nBytes));
-    ret.push_back(Pair("ttlfee", FormatMoney(nFees)));
+    CFeeRate nFeeRate = CFeeRate(summary.nFees, summary.nTxBytes);
+    CFeeRate highPriorityFeeRate = mempool.estimateFee(1);
+    if (highPriorityFeeRate == CFeeRate(0))
+        highPriorityFeeRate = CFeeRate(nFeeRate.GetFeePerK() + 1000);
+    ret.push_back(Pair("txcount", summary.nTxCount));
+    ret.push_back(Pair("txbytes", summary.nTxBytes));
+    ret.push_back(Pair("ttlfee", FormatMoney(summary.nFees)));
     ret.push_back(Pair("feeperkb", FormatMoney(nFeeRate.GetFeePerK())));
-    ret.push_back(Pair("rec_highpriorityfee_perkb", FormatMoney(nFeeRate.GetFeePerK() + 1000)));
+    ret.push_back(Pair("rec_highpriorityfee_perkb", FormatMoney(highPriorityFeeRate.GetFeePerK())));
 
     return ret;
 }
@@ -812,8 +841,18 @@ UniValue mempoolInfoToJSON()
     UniValue ret(UniValue::VOBJ);
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
+    ret.push_back(Pair("maxmempool", (int64_t) GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK())));
     //ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
 
+    uint64_t nEntries, nHits, nMisses;
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    UniValue spendCache(UniValue::VOBJ);
+    spendCache.push_back(Pair("size", (int64_t) nEntries));
+    spendCache.push_back(Pair("hits", (int64_t) nHits));
+    spendCache.push_back(Pair("misses", (int64_t) nMisses));
+    ret.push_back(Pair("zerocoinspendcache", spendCache));
+
     return ret;
 }
 
@@ -828,6 +867,13 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum sum of tx sizes before the lowest fee rate transactions are evicted\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee in BEET/kB for a tx to be accepted, raised after evictions\n"
+            "  \"zerocoinspendcache\": {      (object) Verified zerocoin spend cache\n"
+            "    \"size\": xxxxx              (numeric) Number of verified spends remembered\n"
+            "    \"hits\": xxxxx              (numeric) Spend proofs skipped because they were verified before\n"
+            "    \"misses\": xxxxx            (numeric) Spend proofs that had to be verified\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -412,6 +412,51 @@ public:
     }
 };
 
+/** Read-only stream over memory owned by someone else, such as a memory mapped file,
+ *  to deserialize from it without copying the data into a CDataStream first.
+ */
+class CBufferReader
+{
+private:
+    const char* pcur;
+    const char* pend;
+
+    int nType;
+    int nVersion;
+
+public:
+    CBufferReader(const char* pbegin, const char* pendIn, int nTypeIn, int nVersionIn)
+        : pcur(pbegin), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    //
+    // Stream subset
+    //
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+
+    size_t size() const { return pend - pcur; }
+    bool eof() const { return pcur == pend; }
+
+    CBufferReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CBufferReader::read : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CBufferReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind a given number of bytes.
  *
@@ -369,6 +369,60 @@ Testb_MintAndSpend()
 	return false;
 }
 
+#define TESTS_FIXED_BASE_EXPONENTIATIONS 200
+
+bool
+Testb_FixedBaseExp()
+{
+	try {
+		const IntegerGroupParams* groups[] = {
+			&gg_Params->coinCommitmentGroup,
+			&gg_Params->serialNumberSoKCommitmentGroup,
+			&gg_Params->accumulatorParams.accumulatorPoKCommitmentGroup
+		};
+		const char* names[] = { "COIN COMMITMENT", "SERIAL SOK", "ACCUMULATOR POK" };
+
+		for (uint32_t g = 0; g < 3; g++) {
+			const IntegerGroupParams* group = groups[g];
+			vector<CBigNum> exps;
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_EXPONENTIATIONS; i++) {
+				exps.push_back(CBigNum::randBignum(group->groupOrder));
+			}
+
+			vector<CBigNum> expected(TESTS_FIXED_BASE_EXPONENTIATIONS);
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_EXPONENTIATIONS; i++) {
+				expected[i] = group->h.pow_mod(exps[i], group->modulus);
+			}
+			timer.stop();
+			int nGeneric = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_EXPONENTIATIONS; i++) {
+				if (group->hPowMod(exps[i]) != expected[i]) {
+					cout << "\tFixed-base result mismatch in " << names[g] << " group" << endl;
+					return false;
+				}
+			}
+			timer.stop();
+
+			cout << "\t" << names[g] << " GROUP " << TESTS_FIXED_BASE_EXPONENTIATIONS << " EXPONENTIATIONS:\n\t\tpow_mod: " << nGeneric << " ms\n\t\tfixed-base: " << timer.duration() << " ms" << endl;
+
+			// Negative exponents are reduced modulo the group order
+			CBigNum negExp = CBigNum(0) - exps[0];
+			if (group->hPowMod(negExp) != group->h.pow_mod(negExp, group->modulus)) {
+				cout << "\tFixed-base negative exponent mismatch in " << names[g] << " group" << endl;
+				return false;
+			}
+		}
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return true;
+}
+
 void
 Testb_RunAllTests()
 {
@@ -385,6 +439,7 @@ Testb_RunAllTests()
 	gLogTestResult("parameter sizes are correct", Testb_CalcParamSizes);
 	gLogTestResult("group/field parameters can be generated", Testb_GenerateGroupParams);
 	gLogTestResult("parameter generation is correct", Testb_ParamGen);
+	gLogTestResult("fixed-base exponentiation matches pow_mod", Testb_FixedBaseExp);
 	gLogTestResult("coins can be minted", Testb_MintCoin);
 	gLogTestResult("the accumulator works", Testb_Accumulator);
 	gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
@@ -9,6 +9,13 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/sph_4way.h"
+#include "crypto/sph_aesni.h"
+#include "crypto/sph_echo.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_sha2.h"
+#include "crypto/sph_shavite.h"
 #include "random.h"
 #include "utilstrencodings.h"
 
@@ -248,6 +255,140 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+/** Bytes i * 13 + 7 for i = 0 .. nLen - 1, spanning several blocks of the sph functions for larger nLen */
+std::string SphTestString(size_t nLen)
+{
+    std::string ret;
+    for (size_t i = 0; i < nLen; i++)
+        ret += (unsigned char)(i * 13 + 7);
+    return ret;
+}
+
+/**
+ * Check one of the sph 512 bit hashes against a test vector, once with the AES-NI code paths (where the CPU has
+ * them) and once with the table based ones, writing the input at once and in random pieces.
+ */
+template <void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*), typename Context>
+void TestSph(const std::string& in, const std::string& hexout)
+{
+    std::vector<unsigned char> out = ParseHex(hexout);
+    for (int fAesni = 1; fAesni >= 0; fAesni--) {
+        sph_aesni_set_enabled(fAesni);
+        for (int i = 0; i < 8; i++) {
+            Context ctx;
+            std::vector<unsigned char> hash(64);
+            Init(&ctx);
+            size_t pos = 0;
+            while (pos < in.size()) {
+                size_t len = i == 0 ? in.size() : insecure_rand() % (in.size() - pos + 1);
+                Update(&ctx, in.data() + pos, len);
+                pos += len;
+            }
+            Close(&ctx, &hash[0]);
+            BOOST_CHECK(hash == out);
+        }
+    }
+    sph_aesni_set_enabled(1);
+}
+
+void TestGroestl512(const std::string& in, const std::string& hexout) { TestSph<sph_groestl512_init, sph_groestl512, sph_groestl512_close, sph_groestl512_context>(in, hexout); }
+void TestEcho512(const std::string& in, const std::string& hexout) { TestSph<sph_echo512_init, sph_echo512, sph_echo512_close, sph_echo512_context>(in, hexout); }
+void TestShavite512(const std::string& in, const std::string& hexout) { TestSph<sph_shavite512_init, sph_shavite512, sph_shavite512_close, sph_shavite512_context>(in, hexout); }
+
+BOOST_AUTO_TEST_CASE(groestl512_testvectors) {
+    TestGroestl512(SphTestString(0),
+        "6d3ad29d279110eef3adbd66de2a0345a77baede1557f5d099fce0c03d6dc2ba"
+        "8e6d4a6633dfbd66053c20faa87d1a11f39a7fbe4a6c2f009801370308fc4ad8");
+    TestGroestl512("abc",
+        "70e1c68c60df3b655339d67dc291cc3f1dde4ef343f11b23fdd44957693815a7"
+        "5a8339c682fc28322513fd1f283c18e53cff2b264e06bf83a2f0ac8c1f6fbff6");
+    TestGroestl512(SphTestString(64),
+        "b13557dc5d74d7a038d6eb764abea64311c5fef958d1779c80ad0a95e932b241"
+        "428e1f341b42d5834b7af3f32903533f9425d3398427e6931ea11528cc21bdc0");
+    TestGroestl512(SphTestString(128),
+        "ac4f0c50bc1638c802e35760744201dd5997faee2821d5f715df706b5f47538f"
+        "53dec5d72d6d3de636b41227b1a472840d63445161cad0ef0be91060249048ec");
+    TestGroestl512(SphTestString(300),
+        "522c07e8ac90127cec8c41c3193adbe807eb42213f0c0ab244b668369e639e86"
+        "75b8104b1d1e2a0e9764b6f4f6b25d38bde85af21e670f685e6f39ce19c73674");
+}
+
+BOOST_AUTO_TEST_CASE(echo512_testvectors) {
+    TestEcho512(SphTestString(0),
+        "158f58cc79d300a9aa292515049275d051a28ab931726d0ec44bdd9faef4a702"
+        "c36db9e7922fff077402236465833c5cc76af4efc352b4b44c7fa15aa0ef234e");
+    TestEcho512("abc",
+        "3bf04ec89d67e0dafd1b8ab26b176abaead6b3cdc706ff7198c3c6045e77d4ea"
+        "f64cd90af9c5a7674919b90ff8c9b4a7554d6cfeffb334406ec233fb0b0dd6bc");
+    TestEcho512(SphTestString(64),
+        "bbf3e99c973cd301950b0779e1b8b5b780d1e058d834dd92514c9d91485785b1"
+        "cb2b23cda12e989c8e9bffbbeaa2689442d0a20aeb9180c81d964c221c763e6a");
+    TestEcho512(SphTestString(128),
+        "871c19db94ac313b9103b41837c41c225661b4346eb041eb3e082105e6627637"
+        "dd0d181162f79a071cfeb81a79889840b07056b3ec7ca395b07bc7eed476ea3a");
+    TestEcho512(SphTestString(300),
+        "64a80c482738dd0daac72b98d454199243f69e2c5d85b52b7b286e22b5b6ce6f"
+        "0dca2e15138375c01b90f42e866c41ffb0460a01160fcae0d31927d50be74951");
+}
+
+BOOST_AUTO_TEST_CASE(shavite512_testvectors) {
+    TestShavite512(SphTestString(0),
+        "a485c1b2578459d1efc5dddd840bb0b4a650ac82fe68f58c4442ccda747da006"
+        "b2d1dc6b4a4eb7d84ff91e1f466fef429d259acd995dddcad16fa545c7a6e5ba");
+    TestShavite512("abc",
+        "0fb0b216b377e6d95db1b6d9b6c8b59f08d4e29814071c8c0f827b32e68c1536"
+        "2f24bcc15ad6b1c925a03f00092997f7628cb47f27c9ad7a22e4c00fbb2c16e3");
+    TestShavite512(SphTestString(64),
+        "6c18e69eb619ee167b3c2f112f6d23059e27bfdd990d510388c5015576c41bbc"
+        "4c8a0bc88d37866db14f6528e7a2b5ab43c04a0c21067dd027c9d4e763960465");
+    TestShavite512(SphTestString(128),
+        "1b516836c03a86a39335bbafe4df6a7664bc6697b124372ce64b979903e61c08"
+        "8778af1e64270ca97547fd20b449ce6b9d4cae51630d14e7f38eab0da535e373");
+    TestShavite512(SphTestString(300),
+        "08dfdf23ade9126af1759987e7434992f180ba56ec26f4103bed3fa7b752acec"
+        "f5a61c7392e55855873199e78de682b5cf48ecfa8e32185d386dd2ef2dab364c");
+}
+
+/**
+ * Check a four lane sph function against its scalar version, with the AVX2 code paths (where the CPU has them) and
+ * without, for lengths around the block boundaries and a different message in every lane.
+ */
+template <void (*Hash4Way)(const void* const[SPH_4WAY_LANES], size_t, void* const[SPH_4WAY_LANES]), void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*), typename Context>
+void TestSph4Way()
+{
+    std::vector<std::string> vMessages;
+    for (int j = 0; j < SPH_4WAY_LANES; j++)
+        vMessages.push_back(SphTestString(300 + j).substr(j));
+    for (int fAvx2 = 1; fAvx2 >= 0; fAvx2--) {
+        sph_avx2_set_enabled(fAvx2);
+        for (size_t len = 0; len <= 300; len++) {
+            const void* data[SPH_4WAY_LANES];
+            void* dst[SPH_4WAY_LANES];
+            std::vector<unsigned char> out[SPH_4WAY_LANES];
+            for (int j = 0; j < SPH_4WAY_LANES; j++) {
+                data[j] = vMessages[j].data();
+                out[j].resize(64);
+                dst[j] = &out[j][0];
+            }
+            Hash4Way(data, len, dst);
+            for (int j = 0; j < SPH_4WAY_LANES; j++) {
+                Context ctx;
+                std::vector<unsigned char> hash(64);
+                Init(&ctx);
+                Update(&ctx, vMessages[j].data(), len);
+                Close(&ctx, &hash[0]);
+                BOOST_CHECK(out[j] == hash);
+            }
+        }
+    }
+    sph_avx2_set_enabled(1);
+}
+
+BOOST_AUTO_TEST_CASE(sph_4way) {
+    TestSph4Way<sph_sha512_4way, sph_sha512_init, sph_sha512, sph_sha512_close, sph_sha512_context>();
+    TestSph4Way<sph_keccak512_4way, sph_keccak512_init, sph_keccak512, sph_keccak512_close, sph_keccak512_context>();
+}
+
 void TestRFC6979(const std::string& hexkey, const std::string& hexmsg, const std::vector<std::string>& hexout)
 {
     std::vector<unsigned char> key = ParseHex(hexkey);
@@ -2,12 +2,15 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/sph_4way.h"
 #include "hash.h"
 #include "utilstrencodings.h"
+#include "xevanbatch.h"
 
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -46,4 +49,56 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(xevan_batch)
+{
+    // a mix of header sized messages, an empty one and a batch that doesn't fill its last group of lanes
+    vector<vector<unsigned char> > vMessages;
+    for (int i = 0; i < 4 * (int)XEVAN_BATCH_LANES + 3; i++) {
+        vector<unsigned char> vch(80 + i % 3);
+        for (size_t j = 0; j < vch.size(); j++)
+            vch[j] = (unsigned char)(i * 31 + j);
+        vMessages.push_back(vch);
+    }
+    vMessages.push_back(vector<unsigned char>());
+
+    vector<XevanInput> vInputs;
+    for (const vector<unsigned char>& vch : vMessages)
+        vInputs.push_back(XevanInput(vch.data(), vch.data() + vch.size()));
+
+    vector<uint256> vExpected;
+    for (const vector<unsigned char>& vch : vMessages)
+        vExpected.push_back(XEVAN(vch.begin(), vch.end()));
+
+    // without queue threads the caller hashes every group itself, with the four lane stages on AVX2 and without
+    vector<uint256> vHashes;
+    for (int fAvx2 = 1; fAvx2 >= 0; fAvx2--) {
+        sph_avx2_set_enabled(fAvx2);
+        vHashes.clear();
+        XEVANBatch(vInputs, vHashes);
+        BOOST_CHECK_EQUAL(vHashes.size(), vExpected.size());
+        for (size_t i = 0; i < vExpected.size(); i++)
+            BOOST_CHECK(vHashes[i] == vExpected[i]);
+    }
+    sph_avx2_set_enabled(1);
+
+    // the same with groups handed to queue threads, and with a batch too small for the queue
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++)
+        threadGroup.create_thread(&ThreadXEVANBatch);
+    for (int i = 0; i < 3; i++) {
+        vHashes.clear();
+        XEVANBatch(vInputs, vHashes);
+        BOOST_CHECK(vHashes == vExpected);
+    }
+    vector<XevanInput> vSmall(vInputs.begin(), vInputs.begin() + XEVAN_BATCH_LANES + 1);
+    XEVANBatch(vSmall, vHashes);
+    BOOST_CHECK(vector<uint256>(vExpected.begin(), vExpected.begin() + vSmall.size()) == vHashes);
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    vHashes.push_back(uint256(1));
+    XEVANBatch(vector<XevanInput>(), vHashes);
+    BOOST_CHECK(vHashes.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,9 +5,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "blockcache.h"
+#include "blockindexsnapshot.h"
+#include "blockfilemap.h"
+#include "clientversion.h"
+#include "hash.h"
 #include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "timedata.h"
+#include "txdb.h"
+#include "util.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
 
 BOOST_AUTO_TEST_SUITE(main_tests)
 
@@ -37,4 +51,405 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(header_hash_cache_test)
+{
+    CBlockHeader header;
+    header.nVersion = 3;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1500000000;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 1;
+
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(hash == XEVAN(BEGIN(header.nVersion), END(header.nNonce)));
+    BOOST_CHECK(header.GetHash() == hash);
+
+    // copies keep the cached hash, changes to the fields invalidate it
+    CBlockHeader copy = header;
+    BOOST_CHECK(copy.GetHash() == hash);
+    copy.nNonce++;
+    BOOST_CHECK(copy.GetHash() != hash);
+    BOOST_CHECK(copy.GetHash() == XEVAN(BEGIN(copy.nVersion), END(copy.nNonce)));
+    copy.nNonce--;
+    BOOST_CHECK(copy.GetHash() == hash);
+
+    // threads sharing a header that has no hash cached yet all get the right one
+    CBlockHeader shared = header;
+    shared.nTime++;
+    uint256 hashShared = XEVAN(BEGIN(shared.nVersion), END(shared.nNonce));
+    CBlockHeader fresh;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << shared;
+    ss >> fresh;
+    std::atomic<int> nWrong(0);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++) {
+        threadGroup.create_thread([&]() {
+            for (int j = 0; j < 8; j++) {
+                if (static_cast<const CBlockHeader&>(fresh).GetHash() != hashShared)
+                    nWrong++;
+            }
+        });
+    }
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(nWrong.load(), 0);
+
+    // deserializing over a header with a cached hash gives the hash of the new fields
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << header;
+    ssHeader >> fresh;
+    BOOST_CHECK(fresh.GetHash() == hash);
+}
+
+BOOST_AUTO_TEST_CASE(check_block_headers_test)
+{
+    // a chain of pre-v4 headers, the last of them far in the future, which AcceptBlockHeader rejects later
+    std::vector<CBlock> vHeaders(5);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = 3;
+        vHeaders[i].hashPrevBlock = i > 0 ? XEVAN(BEGIN(vHeaders[i - 1].nVersion), END(vHeaders[i - 1].nNonce)) : GetRandHash();
+        vHeaders[i].hashMerkleRoot = GetRandHash();
+        vHeaders[i].nTime = i + 1 < vHeaders.size() ? 1500000000 + i : GetAdjustedTime() + 100000;
+        vHeaders[i].nBits = 0x1e0ffff0;
+    }
+
+    CValidationState state;
+    size_t nContinuous = 0;
+    BOOST_CHECK(CheckBlockHeaders(vHeaders, state, nContinuous));
+    BOOST_CHECK_EQUAL(nContinuous, vHeaders.size());
+    for (const CBlock& header : vHeaders)
+        BOOST_CHECK(header.GetHash() == XEVAN(BEGIN(header.nVersion), END(header.nNonce)));
+
+    // a break in the sequence keeps the headers before it
+    vHeaders[3].hashPrevBlock = GetRandHash();
+    int nDoS = 0;
+    BOOST_CHECK(!CheckBlockHeaders(vHeaders, state, nContinuous));
+    BOOST_CHECK_EQUAL(nContinuous, 3U);
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 20);
+}
+
+BOOST_AUTO_TEST_CASE(block_cache_test)
+{
+    SetBlockCacheSize(1 << 20);
+
+    // four blocks of a bit over 300kB, only three of them fit in 1MiB
+    std::vector<CBlock> vBlocks(4);
+    std::vector<uint256> vHashes;
+    for (CBlock& block : vBlocks) {
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(300000, 0x01);
+        block.vtx.push_back(tx);
+        vHashes.push_back(GetRandHash());
+    }
+
+    uint64_t nBlocks, nBytes, nHitsStart, nMissesStart, nHits, nMisses;
+    GetBlockCacheStats(nBlocks, nBytes, nHitsStart, nMissesStart);
+
+    CBlock block;
+    BOOST_CHECK(!GetCachedBlock(vHashes[0], block));
+    for (unsigned int i = 0; i < vBlocks.size(); i++)
+        CacheBlock(vBlocks[i], vHashes[i]);
+
+    // the least recently used block was evicted
+    BOOST_CHECK(!GetCachedBlock(vHashes[0], block));
+    for (unsigned int i = 1; i < vBlocks.size(); i++) {
+        BOOST_CHECK(GetCachedBlock(vHashes[i], block));
+        BOOST_CHECK(block.vtx[0] == vBlocks[i].vtx[0]);
+    }
+
+    GetBlockCacheStats(nBlocks, nBytes, nHits, nMisses);
+    BOOST_CHECK(nBytes <= (1 << 20));
+    BOOST_CHECK_EQUAL(nHits - nHitsStart, 3U);
+    BOOST_CHECK_EQUAL(nMisses - nMissesStart, 2U);
+
+    // verification reads bypass the cache, here an index entry whose hash doesn't match the block on disk
+    BOOST_REQUIRE(chainActive.Genesis() != NULL);
+    CBlockIndex indexFake = *chainActive.Genesis();
+    uint256 hashFake = GetRandHash();
+    indexFake.phashBlock = &hashFake;
+    CacheBlock(vBlocks[3], hashFake);
+    BOOST_CHECK(ReadBlockFromDisk(block, &indexFake));
+    BOOST_CHECK(block.vtx[0] == vBlocks[3].vtx[0]);
+    GetBlockCacheStats(nBlocks, nBytes, nHitsStart, nMissesStart);
+    BOOST_CHECK(!ReadBlockFromDisk(block, &indexFake, false));
+    BOOST_CHECK(ReadBlockFromDisk(block, chainActive.Genesis(), false));
+    BOOST_CHECK(block.GetHash() == chainActive.Genesis()->GetBlockHash());
+    GetBlockCacheStats(nBlocks, nBytes, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, nHitsStart);
+    BOOST_CHECK_EQUAL(nMisses, nMissesStart);
+
+    // shrinking the cache evicts right away, blocks are counted at their size in memory
+    SetBlockCacheSize(700000);
+    GetBlockCacheStats(nBlocks, nBytes, nHits, nMisses);
+    BOOST_CHECK(nBytes > 600000 && nBytes <= 700000);
+    BOOST_CHECK(!GetCachedBlock(vHashes[2], block));
+    BOOST_CHECK(GetCachedBlock(vHashes[3], block));
+
+    SetBlockCacheSize(0);
+    CacheBlock(vBlocks[0], vHashes[0]);
+    BOOST_CHECK(!GetCachedBlock(vHashes[0], block));
+
+    SetBlockCacheSize(DEFAULT_BLOCK_CACHE_SIZE << 20);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_block_file_test)
+{
+    // a file far from the ones blocks are written to
+    CDiskBlockPos pos(90000, 0);
+    std::vector<char> vData(5000);
+    for (unsigned int i = 0; i < vData.size(); i++)
+        vData[i] = (char)(i * 7);
+
+    FILE* file = OpenBlockFile(pos);
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE_EQUAL(fwrite(vData.data(), 1, 3000, file), 3000U);
+    fflush(file);
+
+    pos.nPos = 1;
+    std::shared_ptr<const CMappedBlockFile> mapped = GetMappedBlockFile(pos, "blk", 3000);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), 3000U);
+    BOOST_CHECK(memcmp(mapped->data(), vData.data(), 3000) == 0);
+    BOOST_CHECK(GetMappedBlockFile(pos, "blk", 1000) == mapped);
+    BOOST_CHECK(!GetMappedBlockFile(pos, "blk", 3001));
+
+    // the file grew, the old mapping stays valid for whoever still holds it
+    BOOST_REQUIRE_EQUAL(fwrite(vData.data() + 3000, 1, 2000, file), 2000U);
+    fclose(file);
+    std::shared_ptr<const CMappedBlockFile> remapped = GetMappedBlockFile(pos, "blk", 5000);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    BOOST_CHECK(memcmp(remapped->data(), vData.data(), 5000) == 0);
+    BOOST_CHECK(memcmp(mapped->data(), vData.data(), 3000) == 0);
+
+    // a block in the file being written to reads through fread and matches the one in the index
+    CBlock block;
+    BOOST_REQUIRE(chainActive.Genesis() != NULL);
+    BOOST_CHECK(ReadBlockFromDisk(block, chainActive.Genesis()->GetBlockPos()));
+    BOOST_CHECK(block.GetHash() == chainActive.Genesis()->GetBlockHash());
+
+    mapped.reset();
+    remapped.reset();
+    boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(external_block_file_test)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    CBlock genesis;
+    BOOST_REQUIRE(chainActive.Genesis() != NULL);
+    BOOST_REQUIRE(ReadBlockFromDisk(genesis, chainActive.Genesis()));
+
+    // a duplicated transaction keeps the header valid but mutates the merkle tree
+    CBlock mutated = genesis;
+    mutated.vtx.push_back(mutated.vtx.back());
+
+    // the blocks framed as in a blk file, with junk and a record of impossible size in between
+    CAutoFile fileout(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    std::vector<const CBlock*> vExpected;
+    std::vector<uint64_t> vExpectedPos;
+    const CBlock* vBlocks[] = {&genesis, &mutated, &genesis};
+    for (const CBlock* pblock : vBlocks) {
+        fileout << std::string("junk");
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)10;
+        unsigned int nSize = fileout.GetSerializeSize(*pblock);
+        fileout << FLATDATA(Params().MessageStart()) << nSize;
+        vExpectedPos.push_back(ftell(fileout.Get()));
+        fileout << *pblock;
+        vExpected.push_back(pblock);
+    }
+    FILE* file = fileout.release();
+    rewind(file);
+
+    // every block comes back in file order at the position a serial scan finds it at
+    std::vector<uint256> vHashes;
+    std::vector<uint64_t> vPos;
+    std::vector<bool> vPreChecked;
+    std::string strError;
+    BOOST_CHECK(ReadExternalBlockFile(file, [&](CBlock& block, uint64_t nBlockPos, bool fPreChecked) {
+        vHashes.push_back(block.GetHash());
+        vPos.push_back(nBlockPos);
+        vPreChecked.push_back(fPreChecked);
+        return true;
+    }, strError));
+    BOOST_CHECK(strError.empty());
+    BOOST_REQUIRE_EQUAL(vHashes.size(), vExpected.size());
+    for (unsigned int i = 0; i < vExpected.size(); i++) {
+        BOOST_CHECK(vHashes[i] == vExpected[i]->GetHash());
+        BOOST_CHECK_EQUAL(vPos[i], vExpectedPos[i]);
+    }
+    BOOST_CHECK(vPreChecked[0] && !vPreChecked[1] && vPreChecked[2]);
+
+    // stopping early leaves the rest of the file unread
+    file = tmpfile();
+    CAutoFile fileout2(file, SER_DISK, CLIENT_VERSION);
+    for (const CBlock* pblock : vBlocks)
+        fileout2 << FLATDATA(Params().MessageStart()) << fileout2.GetSerializeSize(*pblock) << *pblock;
+    file = fileout2.release();
+    rewind(file);
+    unsigned int nCalls = 0;
+    BOOST_CHECK(ReadExternalBlockFile(file, [&](CBlock& block, uint64_t nBlockPos, bool fPreChecked) {
+        return ++nCalls < 2;
+    }, strError));
+    BOOST_CHECK_EQUAL(nCalls, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(verify_db_test)
+{
+    BOOST_REQUIRE(chainActive.Genesis() != NULL);
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    CBlock genesis;
+    BOOST_REQUIRE(ReadBlockFromDisk(genesis, pindexGenesis));
+
+    // the spend proofs are handed to the caller rather than verified under cs_main
+    CValidationState state;
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks(1);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(CheckBlock(genesis, state, true, true, true, false, &vZerocoinChecks));
+    }
+    BOOST_CHECK(vZerocoinChecks.empty());
+
+    // a second block on the chain, stored where the genesis block is
+    uint256 hashGenesis = pindexGenesis->GetBlockHash();
+    CBlockIndex indexNext(*pindexGenesis);
+    indexNext.phashBlock = &hashGenesis;
+    indexNext.pprev = pindexGenesis;
+    indexNext.nHeight = 1;
+    indexNext.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA;
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&indexNext);
+    }
+
+    // the background run checks the blocks without entering the verifying blocks state
+    BOOST_CHECK(CVerifyDB(false).VerifyDB(pcoinsTip, 2, 10));
+    BOOST_CHECK(!fVerifyingBlocks);
+    CVerifyDBStatus status = GetVerifyDBStatus();
+    BOOST_CHECK(status.state == CVerifyDBStatus::PASSED);
+    BOOST_CHECK_EQUAL(status.nCheckLevel, 2);
+    BOOST_CHECK_EQUAL(status.nBlocksChecked, 1);
+
+    // levels 3 and 4 are left to VerifyCoins, which does nothing below level 3
+    std::string strError;
+    BOOST_CHECK(CVerifyDB(false).VerifyCoins(pcoinsTip, 2, 10, strError));
+    BOOST_CHECK(strError.empty());
+
+    // level 3 runs in the background too, on its own view: the second block has no undo data to disconnect
+    // with, which fails the run and leaves the coins tip where it was
+    BOOST_CHECK(!CVerifyDB(false).VerifyDB(pcoinsTip, 3, 10));
+    status = GetVerifyDBStatus();
+    BOOST_CHECK(status.state == CVerifyDBStatus::FAILED);
+    BOOST_CHECK_EQUAL(status.nCheckLevel, 3);
+    BOOST_CHECK(status.strError.find("irrecoverable inconsistency in block data at 1") == 0);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == hashGenesis);
+    BOOST_CHECK(!fVerifyingBlocks);
+
+    // data that doesn't match the index fails the run
+    indexNext.nDataPos += 1;
+    BOOST_CHECK(!CVerifyDB(false).VerifyDB(pcoinsTip, 2, 10));
+    status = GetVerifyDBStatus();
+    BOOST_CHECK(status.state == CVerifyDBStatus::FAILED);
+    BOOST_CHECK(status.strError.find("ReadBlockFromDisk failed at 1") == 0);
+    BOOST_CHECK(!fVerifyingBlocks);
+
+    LOCK(cs_main);
+    chainActive.SetTip(pindexGenesis);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot_test)
+{
+    LOCK(cs_main);
+    BOOST_REQUIRE(chainActive.Genesis() != NULL);
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    uint256 hashBest = pindexGenesis->GetBlockHash();
+
+    // a child of the genesis block, so the snapshot has a parent to resolve
+    CBlockIndex indexChild(*pindexGenesis);
+    uint256 hashChild = GetRandHash();
+    indexChild.pprev = pindexGenesis;
+    indexChild.nHeight = 1;
+    indexChild.nTime = pindexGenesis->nTime + 60;
+    indexChild.nStatus = BLOCK_VALID_TREE;
+    indexChild.phashBlock = &mapBlockIndex.insert(std::make_pair(hashChild, &indexChild)).first->first;
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    mapBlockIndex.erase(hashChild);
+
+    // loads into an empty mapBlockIndex, leaving the real one alone
+    boost::filesystem::path path = GetDataDir() / BLOCKINDEX_SNAPSHOT_FILENAME;
+    BlockMap mapLoaded;
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    auto load = [&](const uint256& hashBestBlock) {
+        mapLoaded.clear();
+        vSortedByHeight.clear();
+        mapBlockIndex.swap(mapLoaded);
+        bool fLoaded = LoadBlockIndexSnapshot(hashBestBlock, vSortedByHeight);
+        mapBlockIndex.swap(mapLoaded);
+        return fLoaded;
+    };
+
+    BOOST_REQUIRE(load(hashBest));
+    BOOST_CHECK(!boost::filesystem::exists(path));
+    BOOST_REQUIRE_EQUAL(mapLoaded.size(), 2U);
+    BOOST_REQUIRE_EQUAL(vSortedByHeight.size(), 2U);
+    const CBlockIndex* pindexGenesisLoaded = vSortedByHeight[0].second;
+    const CBlockIndex* pindexChildLoaded = vSortedByHeight[1].second;
+    BOOST_CHECK(pindexGenesisLoaded->GetBlockHash() == hashBest);
+    BOOST_CHECK(pindexGenesisLoaded->pprev == NULL);
+    BOOST_CHECK(pindexGenesisLoaded->nFile == pindexGenesis->nFile && pindexGenesisLoaded->nDataPos == pindexGenesis->nDataPos);
+    BOOST_CHECK(pindexGenesisLoaded->nStatus == pindexGenesis->nStatus);
+    BOOST_CHECK(pindexChildLoaded->GetBlockHash() == hashChild);
+    BOOST_CHECK(pindexChildLoaded->pprev == pindexGenesisLoaded);
+    BOOST_CHECK_EQUAL(pindexChildLoaded->nHeight, 1);
+    BOOST_CHECK_EQUAL(pindexChildLoaded->nTime, indexChild.nTime);
+    BOOST_CHECK(mapLoaded[hashChild] == pindexChildLoaded);
+
+    // written for another best block
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    BOOST_CHECK(!load(hashChild));
+    BOOST_CHECK(mapLoaded.empty() && vSortedByHeight.empty());
+    BOOST_CHECK(!boost::filesystem::exists(path));
+
+    // the block tree was loaded, and so possibly written to, by another session since
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    uint64_t nGeneration = 0;
+    pblocktree->ReadGeneration(nGeneration);
+    BOOST_CHECK(pblocktree->WriteGeneration(nGeneration + 1));
+    BOOST_CHECK(!load(hashBest));
+    BOOST_CHECK(mapLoaded.empty());
+
+    // blocks were added to the last block file
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    int nLastBlockFile = 0;
+    pblocktree->ReadLastBlockFile(nLastBlockFile);
+    CBlockFileInfo info;
+    pblocktree->ReadBlockFileInfo(nLastBlockFile, info);
+    info.AddBlock(1, GetTime());
+    BOOST_CHECK(pblocktree->WriteBlockFileInfo(nLastBlockFile, info));
+    BOOST_CHECK(!load(hashBest));
+    BOOST_CHECK(mapLoaded.empty());
+
+    // a damaged snapshot fails its checksum
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE_EQUAL(fseek(file, 60, SEEK_SET), 0);
+    int ch = fgetc(file);
+    BOOST_REQUIRE(ch != EOF);
+    BOOST_REQUIRE_EQUAL(fseek(file, 60, SEEK_SET), 0);
+    fputc(ch ^ 0x5a, file);
+    fclose(file);
+    BOOST_CHECK(!load(hashBest));
+    BOOST_CHECK(mapLoaded.empty());
+    BOOST_CHECK(!boost::filesystem::exists(path));
+
+    // the same state as when it was written loads again
+    BOOST_CHECK(WriteBlockIndexSnapshot(hashBest));
+    BOOST_CHECK(load(hashBest));
+    BOOST_CHECK_EQUAL(mapLoaded.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
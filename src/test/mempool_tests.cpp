@@ -3,11 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "main.h"
+#include "mempoolpersist.h"
+#include "miner.h"
+#include "primitives/zerocoin.h"
+#include "random.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
+#include "utiltime.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 #include <list>
+#include <memory>
 
 BOOST_AUTO_TEST_SUITE(mempool_tests)
 
@@ -99,4 +107,579 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexTest)
+{
+    // Test the ancestor state and the indexes CreateNewBlock reads
+
+    // A chain of three transactions and one unrelated transaction:
+    CMutableTransaction txChain[3];
+    for (int i = 0; i < 3; i++)
+    {
+        txChain[i].vin.resize(1);
+        txChain[i].vin[0].scriptSig = CScript() << OP_11;
+        txChain[i].vin[0].prevout.hash = i == 0 ? uint256(1) : txChain[i - 1].GetHash();
+        txChain[i].vin[0].prevout.n = 0;
+        txChain[i].vout.resize(1);
+        txChain[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChain[i].vout[0].nValue = 33000LL - i * 1000LL;
+    }
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_11;
+    txOther.vin[0].prevout.hash = uint256(2);
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 11000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+    const CAmount nFees[3] = {1000, 30000, 0};
+    for (int i = 0; i < 3; i++)
+        testPool.addUnchecked(txChain[i].GetHash(), CTxMemPoolEntry(txChain[i], nFees[i], 0, 0.0, 1));
+    testPool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 2000, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& entry0 = testPool.mapTx[txChain[0].GetHash()];
+    const CTxMemPoolEntry& entry1 = testPool.mapTx[txChain[1].GetHash()];
+    const CTxMemPoolEntry& entry2 = testPool.mapTx[txChain[2].GetHash()];
+    BOOST_CHECK_EQUAL(entry0.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(entry2.GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 31000);
+    BOOST_CHECK_EQUAL(entry2.GetSizeWithAncestors(), entry0.GetTxSize() + entry1.GetTxSize() + entry2.GetTxSize());
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolParents(testPool.mapTx.find(txChain[2].GetHash())).size(), 1);
+
+    // The child pays for its parent, so it sorts ahead of the unrelated transaction:
+    std::vector<uint256> vOrder;
+    BOOST_FOREACH (CTxMemPool::txiter it, testPool.GetAncestorFeeIndex())
+        vOrder.push_back(it->first);
+    BOOST_CHECK_EQUAL(vOrder.size(), 4);
+    BOOST_CHECK(vOrder[0] == txChain[1].GetHash());
+    BOOST_CHECK(vOrder[1] == txChain[2].GetHash());
+    BOOST_CHECK(vOrder[2] == txOther.GetHash());
+    BOOST_CHECK(vOrder[3] == txChain[0].GetHash());
+
+    // Fee deltas reach the descendants:
+    testPool.PrioritiseTransaction(txChain[0].GetHash(), txChain[0].GetHash().ToString(), 0.0, 5000);
+    BOOST_CHECK_EQUAL(entry0.GetModFeesWithAncestors(), 6000);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 36000);
+
+    // The head of the chain is mined:
+    testPool.remove(txChain[0], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(entry1.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(entry2.GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 30000);
+    removed.clear();
+
+    // ... and disconnected again, so it comes back after its descendants:
+    testPool.addUnchecked(txChain[0].GetHash(), CTxMemPoolEntry(txChain[0], nFees[0], 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(entry1.GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(entry2.GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 36000);
+
+    // Priority order is refreshed per height:
+    const CTxMemPool::indexed_priority& byPriority = testPool.GetPriorityIndex(10);
+    BOOST_CHECK_EQUAL(byPriority.size(), 4);
+    BOOST_CHECK((*byPriority.begin())->first == txChain[1].GetHash());
+
+    testPool.remove(txChain[1], removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(testPool.GetAncestorFeeIndex().size(), 2);
+    BOOST_CHECK(testPool.GetMemPoolParents(testPool.mapTx.find(txChain[0].GetHash())).empty());
+    testPool.clear();
+    BOOST_CHECK(testPool.GetAncestorFeeIndex().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    // Test TrimToSize and Expire
+
+    CMutableTransaction tx[4];
+    for (int i = 0; i < 4; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.hash = uint256(i + 1);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+    }
+    // tx[3] spends tx[2] and pays enough to lift the package above tx[1]
+    tx[3].vin[0].prevout.hash = tx[2].GetHash();
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+    testPool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 10000, 100, 0.0, 1));
+    testPool.addUnchecked(tx[1].GetHash(), CTxMemPoolEntry(tx[1], 5000, 200, 0.0, 1));
+    testPool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 1000, 300, 0.0, 1));
+    testPool.addUnchecked(tx[3].GetHash(), CTxMemPoolEntry(tx[3], 20000, 400, 0.0, 1));
+
+    const CTxMemPoolEntry& entry2 = testPool.mapTx[tx[2].GetHash()];
+    BOOST_CHECK_EQUAL(entry2.GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithDescendants(), 21000);
+    BOOST_CHECK_EQUAL(entry2.GetSizeWithDescendants(), entry2.GetTxSize() + testPool.mapTx[tx[3].GetHash()].GetTxSize());
+
+    // Nothing to do while within the limit
+    uint64_t nTxSize = entry2.GetTxSize();
+    testPool.TrimToSize(4 * nTxSize, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 0);
+
+    // tx[1] has the lowest fee rate once tx[2] is scored with its child
+    testPool.TrimToSize(3 * nTxSize, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(!testPool.exists(tx[1].GetHash()));
+    removed.clear();
+
+    // Next is the tx[2] package, which goes as a whole
+    testPool.PrioritiseTransaction(tx[0].GetHash(), tx[0].GetHash().ToString(), 0.0, 20000);
+    testPool.TrimToSize(2 * nTxSize, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK(removed.front().GetHash() == tx[3].GetHash());
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+    removed.clear();
+    testPool.ClearPrioritisation(tx[0].GetHash());
+
+    // Expire removes by entry time, with descendants
+    testPool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 1000, 300, 0.0, 1));
+    testPool.addUnchecked(tx[3].GetHash(), CTxMemPoolEntry(tx[3], 20000, 500, 0.0, 1));
+    BOOST_CHECK_EQUAL(testPool.Expire(100), 0);
+    BOOST_CHECK_EQUAL(testPool.Expire(301), 3);
+    BOOST_CHECK_EQUAL(testPool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRollingMinFeeTest)
+{
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.hash = uint256(i + 1);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+    }
+
+    int64_t nStartTime = 1500000000;
+    SetMockTime(nStartTime);
+    CTxMemPool testPool(CFeeRate(1000));
+    std::list<CTransaction> removed;
+    testPool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 10000, nStartTime, 0.0, 1));
+    testPool.addUnchecked(tx[1].GetHash(), CTxMemPoolEntry(tx[1], 5000, nStartTime, 0.0, 1));
+    testPool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 1000, nStartTime, 0.0, 1));
+    uint64_t nTxSize = testPool.mapTx[tx[2].GetHash()].GetTxSize();
+    uint64_t nLimit = 2 * nTxSize;
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(0));
+
+    // Evicting tx[2] asks the next transaction for its fee rate plus the minimum relay fee
+    testPool.TrimToSize(nLimit, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    double dMinFee = CFeeRate(1000, nTxSize).GetFeePerK() + 1000;
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(dMinFee));
+
+    // A cheaper eviction leaves it alone
+    testPool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 500, nStartTime, 0.0, 1));
+    testPool.TrimToSize(nLimit, removed);
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(dMinFee));
+
+    // No decay until a block came in
+    SetMockTime(nStartTime + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(dMinFee));
+
+    std::vector<CTransaction> vtx;
+    std::list<CTransaction> conflicts;
+    testPool.removeForBlock(vtx, 1, 0, conflicts);
+    SetMockTime(nStartTime + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    dMinFee /= 2;
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(llround(dMinFee)));
+
+    // Four times faster while the pool is less than a quarter full
+    SetMockTime(nStartTime + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE / 4);
+    dMinFee /= 2;
+    BOOST_CHECK(testPool.GetMinFee(8 * nLimit) == CFeeRate(llround(dMinFee)));
+
+    // Below half the minimum relay fee it drops to zero for good
+    SetMockTime(nStartTime + 10 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(0));
+    SetMockTime(nStartTime + 11 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(testPool.GetMinFee(nLimit) == CFeeRate(0));
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChainLimitTest)
+{
+    // Test the ancestor and descendant limits of CalculateMemPoolAncestors
+
+    // A chain of five, each spending the one before
+    CMutableTransaction tx[6];
+    for (int i = 0; i < 6; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.hash = i ? tx[i - 1].GetHash() : uint256(1);
+        tx[i].vout.resize(2);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+        tx[i].vout[1].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[1].nValue = 10 * COIN;
+    }
+    CTxMemPool testPool(CFeeRate(0));
+    for (int i = 0; i < 5; i++)
+        testPool.addUnchecked(tx[i].GetHash(), CTxMemPoolEntry(tx[i], 1000, 100, 0.0, 1));
+
+    CTxMemPoolEntry entry(tx[5], 1000, 100, 0.0, 1);
+    uint64_t nTxSize = entry.GetTxSize();
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+    BOOST_CHECK(testPool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nTxSize, 6, 6 * nTxSize, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 5);
+    BOOST_CHECK(errString.empty());
+
+    // Each limit on its own turns the sixth link down
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(entry, setAncestors, 5, 6 * nTxSize, 6, 6 * nTxSize, errString));
+    BOOST_CHECK(errString.find("too many unconfirmed ancestors") == 0);
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nTxSize - 1, 6, 6 * nTxSize, errString));
+    BOOST_CHECK(errString.find("exceeds ancestor size limit") == 0);
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nTxSize, 5, 6 * nTxSize, errString));
+    BOOST_CHECK(errString.find("too many descendants for tx " + tx[0].GetHash().ToString()) == 0);
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nTxSize, 6, 6 * nTxSize - 1, errString));
+    BOOST_CHECK(errString.find("exceeds descendant size limit for tx " + tx[0].GetHash().ToString()) == 0);
+
+    // A second child of the head counts against the head's descendants only
+    CMutableTransaction txSibling = tx[1];
+    txSibling.vin[0].prevout.n = 1;
+    CTxMemPoolEntry entrySibling(txSibling, 1000, 100, 0.0, 1);
+    setAncestors.clear();
+    BOOST_CHECK(testPool.CalculateMemPoolAncestors(entrySibling, setAncestors, 2, 2 * nTxSize, 6, 6 * nTxSize, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 1);
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(entrySibling, setAncestors, 2, 2 * nTxSize, 5, 6 * nTxSize, errString));
+
+    // Transactions without in-pool parents pass any limit
+    setAncestors.clear();
+    BOOST_CHECK(testPool.CalculateMemPoolAncestors(CTxMemPoolEntry(tx[0], 1000, 100, 0.0, 1), setAncestors, 1, nTxSize, 1, nTxSize, errString));
+    BOOST_CHECK(setAncestors.empty());
+}
+
+/** A zerocoin spend of bnSerial. Its proofs are left empty, the pool never verifies them. */
+static CMutableTransaction ZerocoinSpendTx(const CBigNum& bnSerial, CAmount nValue)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << libzerocoin::ZQ_ONE << uint256() << (uint32_t)0 << CBigNum(0) << CBigNum(0) << bnSerial;
+    std::vector<unsigned char> data(ss.begin(), ss.end());
+    data.resize(data.size() + 1000, 0);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_ZEROCOINSPEND << data.size();
+    tx.vin[0].scriptSig.insert(tx.vin[0].scriptSig.end(), data.begin(), data.end());
+    tx.vin[0].prevout.SetNull();
+    tx.vin[0].nSequence = libzerocoin::ZQ_ONE;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolZerocoinSerialTest)
+{
+    // Zerocoin spends are tracked, and conflict, by their serials
+    CMutableTransaction txSpend1 = ZerocoinSpendTx(CBigNum(1), 1 * COIN);
+    CMutableTransaction txSpend1b = ZerocoinSpendTx(CBigNum(1), COIN / 2);
+    CMutableTransaction txSpend2 = ZerocoinSpendTx(CBigNum(2), 1 * COIN);
+    uint256 hashSerial1 = GetSerialHash(CBigNum(1));
+    uint256 hashSerial2 = GetSerialHash(CBigNum(2));
+
+    CTxMemPool testPool(CFeeRate(0));
+    uint256 txid;
+    BOOST_CHECK(!testPool.lookupZerocoinSerial(hashSerial1, txid));
+    BOOST_CHECK(testPool.addUnchecked(txSpend1.GetHash(), CTxMemPoolEntry(txSpend1, 0, 100, 0.0, 1)));
+    BOOST_CHECK(testPool.lookupZerocoinSerial(hashSerial1, txid));
+    BOOST_CHECK(txid == txSpend1.GetHash());
+    BOOST_CHECK(!testPool.lookupZerocoinSerial(hashSerial2, txid));
+
+    // A second spender of the serial is refused and leaves the first in place
+    BOOST_CHECK(!testPool.addUnchecked(txSpend1b.GetHash(), CTxMemPoolEntry(txSpend1b, 0, 100, 0.0, 1)));
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+    BOOST_CHECK(!testPool.exists(txSpend1b.GetHash()));
+    BOOST_CHECK(testPool.lookupZerocoinSerial(hashSerial1, txid));
+    BOOST_CHECK(txid == txSpend1.GetHash());
+
+    BOOST_CHECK(testPool.addUnchecked(txSpend2.GetHash(), CTxMemPoolEntry(txSpend2, 0, 100, 0.0, 1)));
+    BOOST_CHECK(testPool.lookupZerocoinSerial(hashSerial2, txid));
+    BOOST_CHECK(txid == txSpend2.GetHash());
+
+    // A transaction does not conflict with itself
+    std::list<CTransaction> removed;
+    testPool.removeConflicts(txSpend1, removed);
+    BOOST_CHECK(removed.empty());
+    BOOST_CHECK_EQUAL(testPool.size(), 2);
+
+    // A block spending serial 1 differently removes the pool's spender, and only that
+    testPool.removeConflicts(txSpend1b, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(removed.front().GetHash() == txSpend1.GetHash());
+    BOOST_CHECK(!testPool.lookupZerocoinSerial(hashSerial1, txid));
+    BOOST_CHECK(testPool.lookupZerocoinSerial(hashSerial2, txid));
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+
+    // With the serial free again the other spender gets in
+    BOOST_CHECK(testPool.addUnchecked(txSpend1b.GetHash(), CTxMemPoolEntry(txSpend1b, 0, 100, 0.0, 1)));
+    BOOST_CHECK(testPool.lookupZerocoinSerial(hashSerial1, txid));
+    BOOST_CHECK(txid == txSpend1b.GetHash());
+
+    removed.clear();
+    testPool.remove(txSpend2, removed);
+    BOOST_CHECK(!testPool.lookupZerocoinSerial(hashSerial2, txid));
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+}
+
+/** A transaction spending prevout to a P2SH(OP_TRUE) output, with a scriptSig that fails verification unless fValid */
+static CMutableTransaction AnyoneCanSpendTx(const COutPoint& prevout, CAmount nValue, bool fValid = true)
+{
+    CScript scriptRedeem = CScript() << OP_TRUE;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << ToByteVector(fValid ? scriptRedeem : CScript() << OP_FALSE);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = GetScriptForDestination(CScriptID(scriptRedeem));
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+/** A transaction funding nOutputs P2SH(OP_TRUE) outputs of 10 coins */
+static CMutableTransaction AnyoneCanSpendFunding(int nOutputs)
+{
+    CMutableTransaction txFund = AnyoneCanSpendTx(COutPoint(GetRandHash(), 0), 10 * COIN);
+    txFund.vout.resize(nOutputs, txFund.vout[0]);
+    return txFund;
+}
+
+static std::vector<uint256> TemplateHashes(const CBlockTemplate& tmpl)
+{
+    std::vector<uint256> vHashes;
+    for (const CTransaction& tx : tmpl.block.vtx)
+        vHashes.push_back(tx.GetHash());
+    return vHashes;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolCreateNewBlockTest)
+{
+    // CreateNewBlock on a block at height 1 over a pool of parent/child packages. Below the last checkpoint
+    // the block's scripts are not verified, only the miner's own CheckInputs call looks at them.
+    CMutableTransaction txFund = AnyoneCanSpendFunding(4);
+    CCoinsViewCache* pcoinsTipSaved = pcoinsTip;
+    CCoinsViewCache viewTest(pcoinsTipSaved);
+    pcoinsTip = &viewTest;
+    viewTest.ModifyCoins(txFund.GetHash())->FromTx(txFund, chainActive.Height());
+    const unsigned int nPoolHeight = chainActive.Height();
+    const int64_t nNow = GetTime();
+    const CScript scriptPayout = CScript() << OP_TRUE;
+
+    // Free but high priority, it goes in with the priority pass
+    CMutableTransaction txPriority = AnyoneCanSpendTx(COutPoint(txFund.GetHash(), 0), 10 * COIN);
+    mempool.addUnchecked(txPriority.GetHash(), CTxMemPoolEntry(txPriority, 0, nNow, 1e12, nPoolHeight));
+
+    // A low fee parent with a high priority, high fee child. The priority pass skips the child because its
+    // parent is not in the block yet; the fee pass adds both as a package, parent first.
+    CMutableTransaction txParent = AnyoneCanSpendTx(COutPoint(txFund.GetHash(), 1), 10 * COIN - 10000);
+    CMutableTransaction txChild = AnyoneCanSpendTx(COutPoint(txParent.GetHash(), 0), 9 * COIN - 10000);
+    mempool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 10000, nNow, 0.0, nPoolHeight));
+    mempool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, COIN, nNow, 1e13, nPoolHeight));
+
+    // A parent failing CheckInputs takes its descendants with it: the child fails with it in the package,
+    // the grandchild is dropped for its failed ancestor
+    CMutableTransaction txBad = AnyoneCanSpendTx(COutPoint(txFund.GetHash(), 2), 9 * COIN, false);
+    CMutableTransaction txBadChild = AnyoneCanSpendTx(COutPoint(txBad.GetHash(), 0), 8 * COIN);
+    CMutableTransaction txBadGrandchild = AnyoneCanSpendTx(COutPoint(txBadChild.GetHash(), 0), 7 * COIN);
+    mempool.addUnchecked(txBad.GetHash(), CTxMemPoolEntry(txBad, COIN, nNow, 0.0, nPoolHeight));
+    mempool.addUnchecked(txBadChild.GetHash(), CTxMemPoolEntry(txBadChild, COIN, nNow, 0.0, nPoolHeight));
+    mempool.addUnchecked(txBadGrandchild.GetHash(), CTxMemPoolEntry(txBadGrandchild, COIN, nNow, 0.0, nPoolHeight));
+
+    // The same failing script gets in when the pool has already checked the inputs, CheckInputs is skipped
+    CMutableTransaction txChecked = AnyoneCanSpendTx(COutPoint(txFund.GetHash(), 3), 10 * COIN - COIN / 5, false);
+    mempool.addUnchecked(txChecked.GetHash(), CTxMemPoolEntry(txChecked, COIN / 5, nNow, 0.0, nPoolHeight));
+    mempool.mapTx[txChecked.GetHash()].SetInputsChecked();
+
+    // Zerocoin spends are not active at height 1 and stay out of the block
+    CMutableTransaction txSpendOld = ZerocoinSpendTx(CBigNum(1), 1 * COIN);
+    CMutableTransaction txSpendNew = ZerocoinSpendTx(CBigNum(2), 1 * COIN);
+    BOOST_CHECK(mempool.addUnchecked(txSpendNew.GetHash(), CTxMemPoolEntry(txSpendNew, 0, nNow - 10, 0.0, nPoolHeight)));
+    BOOST_CHECK(mempool.addUnchecked(txSpendOld.GetHash(), CTxMemPoolEntry(txSpendOld, 0, nNow - 100, 0.0, nPoolHeight)));
+    BOOST_CHECK_EQUAL(mempool.size(), 9);
+
+    std::vector<uint256> vExpected;
+    vExpected.push_back(txPriority.GetHash());
+    vExpected.push_back(txParent.GetHash());
+    vExpected.push_back(txChild.GetHash());
+    vExpected.push_back(txChecked.GetHash());
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(scriptPayout, NULL, false));
+    BOOST_REQUIRE(pblocktemplate);
+    std::vector<uint256> vHashes = TemplateHashes(*pblocktemplate);
+    BOOST_REQUIRE_EQUAL(vHashes.size(), vExpected.size() + 1);
+    BOOST_CHECK(pblocktemplate->block.vtx[0].IsCoinBase());
+    BOOST_CHECK(std::vector<uint256>(vHashes.begin() + 1, vHashes.end()) == vExpected);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[3], COIN);
+
+    // The passes are remembered, and the next template skips CheckInputs for the same result
+    BOOST_CHECK(mempool.mapTx[txParent.GetHash()].InputsChecked());
+    BOOST_CHECK(mempool.mapTx[txChild.GetHash()].InputsChecked());
+    BOOST_CHECK(!mempool.mapTx[txBad.GetHash()].InputsChecked());
+    pblocktemplate.reset(CreateNewBlock(scriptPayout, NULL, false));
+    BOOST_REQUIRE(pblocktemplate);
+    BOOST_CHECK(TemplateHashes(*pblocktemplate) == vHashes);
+    BOOST_CHECK_EQUAL(mempool.size(), 9);
+
+    // Once zerocoin is active its spends go first, the longest waiting one ahead. CreateNewBlock can't get
+    // there on this chain, the spends' proofs are empty, so this runs the selection it calls directly.
+    {
+        LOCK2(cs_main, mempool.cs);
+        CBlockTemplate tmpl;
+        tmpl.block.vtx.push_back(pblocktemplate->block.vtx[0]);
+        tmpl.vTxFees.push_back(-1);
+        tmpl.vTxSigOps.push_back(-1);
+        uint64_t nBlockSize;
+        AddMempoolTransactions(&tmpl, Params().Zerocoin_StartHeight(), nBlockSize);
+        std::vector<uint256> vZerocoinHashes = TemplateHashes(tmpl);
+        BOOST_REQUIRE_EQUAL(vZerocoinHashes.size(), vExpected.size() + 3);
+        BOOST_CHECK(vZerocoinHashes[1] == txSpendOld.GetHash());
+        BOOST_CHECK(vZerocoinHashes[2] == txSpendNew.GetHash());
+        BOOST_CHECK(std::vector<uint256>(vZerocoinHashes.begin() + 3, vZerocoinHashes.end()) == vExpected);
+    }
+    mempool.clear();
+
+    // Time CreateNewBlock on a pool of chains of 1 to 4 transactions with random fees, and again with the
+    // inputs checked by the first run
+    const int nChains = 3000;
+    CMutableTransaction txFundMany = AnyoneCanSpendFunding(nChains);
+    viewTest.ModifyCoins(txFundMany.GetHash())->FromTx(txFundMany, chainActive.Height());
+    for (int i = 0; i < nChains; i++) {
+        CMutableTransaction tx = AnyoneCanSpendTx(COutPoint(txFundMany.GetHash(), i), 10 * COIN);
+        int nChainLength = 1 + insecure_rand() % 4;
+        for (int j = 0; j < nChainLength; j++) {
+            CAmount nFee = 1000 + insecure_rand() % 100000;
+            tx.vout[0].nValue -= nFee;
+            mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, nNow, 0.0, nPoolHeight));
+            tx = AnyoneCanSpendTx(COutPoint(tx.GetHash(), 0), tx.vout[0].nValue);
+        }
+    }
+
+    int64_t nStart = GetTimeMicros();
+    pblocktemplate.reset(CreateNewBlock(scriptPayout, NULL, false));
+    int64_t nFirstTime = GetTimeMicros() - nStart;
+    BOOST_REQUIRE(pblocktemplate);
+    vHashes = TemplateHashes(*pblocktemplate);
+    nStart = GetTimeMicros();
+    pblocktemplate.reset(CreateNewBlock(scriptPayout, NULL, false));
+    int64_t nSecondTime = GetTimeMicros() - nStart;
+    BOOST_REQUIRE(pblocktemplate);
+    BOOST_CHECK(TemplateHashes(*pblocktemplate) == vHashes);
+    BOOST_TEST_MESSAGE(strprintf("MempoolCreateNewBlockTest: %u pool transactions, template of %u in %d us, %d us with the inputs checked",
+        mempool.size(), vHashes.size() - 1, nFirstTime, nSecondTime));
+
+    // Every transaction follows its in-pool parent
+    std::set<uint256> setSeen;
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size(); i++) {
+        const CTransaction& tx = pblocktemplate->block.vtx[i];
+        BOOST_CHECK(!mempool.exists(tx.vin[0].prevout.hash) || setSeen.count(tx.vin[0].prevout.hash));
+        setSeen.insert(tx.GetHash());
+    }
+
+    mempool.clear();
+    pcoinsTip = pcoinsTipSaved;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPersistTest)
+{
+    // Test DumpMempool and LoadMempool, which re-validates through AcceptToMemoryPool
+
+    // Outputs anyone can spend with a standard P2SH input
+    CScript scriptRedeem = CScript() << OP_TRUE;
+    CScript scriptPubKey = GetScriptForDestination(CScriptID(scriptRedeem));
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout.hash = GetRandHash();
+    txFund.vout.resize(3);
+    for (CTxOut& txout : txFund.vout) {
+        txout.scriptPubKey = scriptPubKey;
+        txout.nValue = 10 * COIN;
+    }
+
+    // tx[0] and tx[1] spend the funding transaction, tx[2] spends tx[0], tx[3] is too old to be loaded
+    CMutableTransaction tx[4];
+    for (int i = 0; i < 4; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].prevout = i == 2 ? COutPoint(tx[0].GetHash(), 0) : COutPoint(txFund.GetHash(), i == 3 ? 2 : i);
+        tx[i].vin[0].scriptSig = CScript() << ToByteVector(scriptRedeem);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = scriptPubKey;
+        tx[i].vout[0].nValue = (i == 2 ? 8 : 9) * COIN;
+    }
+
+    CCoinsViewCache* pcoinsTipSaved = pcoinsTip;
+    CCoinsViewCache viewTest(pcoinsTipSaved);
+    pcoinsTip = &viewTest;
+    viewTest.ModifyCoins(txFund.GetHash())->FromTx(txFund, chainActive.Height());
+
+    int64_t nNow = GetTime();
+    CTxMemPool poolDump(::minRelayTxFee);
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < 3; i++) {
+            CValidationState state;
+            BOOST_CHECK(AcceptToMemoryPoolWithTime(poolDump, state, tx[i], false, NULL, nNow - i));
+        }
+    }
+    int64_t nExpiredTime = nNow - DEFAULT_MEMPOOL_EXPIRY * 60 * 60 - 60;
+    poolDump.addUnchecked(tx[3].GetHash(), CTxMemPoolEntry(tx[3], COIN, nExpiredTime, 0.0, chainActive.Height()));
+    poolDump.PrioritiseTransaction(tx[1].GetHash(), tx[1].GetHash().ToString(), 0.0, 1000);
+    BOOST_CHECK_EQUAL(poolDump.size(), 4);
+
+    // Nothing is written before LoadMempool had its turn, so a dump it did not get to is kept
+    boost::filesystem::path path = GetDataDir() / MEMPOOL_DUMP_FILENAME;
+    BOOST_CHECK(!DumpMempool(poolDump));
+    BOOST_CHECK(!boost::filesystem::exists(path));
+    CTxMemPool poolLoad(::minRelayTxFee);
+    BOOST_CHECK(!LoadMempool(poolLoad));
+    BOOST_CHECK(DumpMempool(poolDump));
+    BOOST_CHECK(boost::filesystem::exists(path));
+
+    // Entries keep their entry time and prioritisation, the expired one is dropped
+    BOOST_CHECK(LoadMempool(poolLoad));
+    BOOST_CHECK_EQUAL(poolLoad.size(), 3);
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(poolLoad.exists(tx[i].GetHash()));
+        BOOST_CHECK_EQUAL(poolLoad.mapTx[tx[i].GetHash()].GetTime(), nNow - i);
+    }
+    BOOST_CHECK(!poolLoad.exists(tx[3].GetHash()));
+    BOOST_CHECK_EQUAL(poolLoad.mapTx[tx[1].GetHash()].GetModifiedFee(), COIN + 1000);
+    BOOST_CHECK_EQUAL(poolLoad.mapTx[tx[2].GetHash()].GetCountWithAncestors(), 2);
+
+    // A damaged dump loads nothing
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, 20, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, 20, SEEK_SET);
+    fputc(ch ^ 0xff, file);
+    fclose(file);
+    CTxMemPool poolCorrupt(::minRelayTxFee);
+    BOOST_CHECK(!LoadMempool(poolCorrupt));
+    BOOST_CHECK_EQUAL(poolCorrupt.size(), 0);
+
+    // and is overwritten by the next dump
+    BOOST_CHECK(DumpMempool(poolLoad));
+    BOOST_CHECK(LoadMempool(poolCorrupt));
+    BOOST_CHECK_EQUAL(poolCorrupt.size(), 3);
+
+    boost::filesystem::remove(path);
+    pcoinsTip = pcoinsTipSaved;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+// Copyright (c) 2011-2015 The Bitcoin Core developers
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "policyestimator.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(policyestimator_tests)
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
+{
+    CTxMemPool mpool(CFeeRate(1000));
+    CAmount basefee(20000);
+
+    // Ten fee levels, the transactions paying fee level j take 11 - j blocks to confirm
+    std::vector<CAmount> feeV;
+    for (int j = 1; j <= 10; j++)
+        feeV.push_back(basefee * j);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 0LL;
+    unsigned int nTxSize = ::GetSerializeSize(CTransaction(tx), SER_NETWORK, PROTOCOL_VERSION);
+
+    std::map<uint256, std::pair<int, int> > mapPending; // txid -> fee level, entry height
+    const int nBlocks = 200;
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        for (int j = 0; j < 10; j++) {
+            for (int k = 0; k < 4; k++) {
+                tx.vin[0].prevout.n = 10000 * nHeight + 100 * j + k;
+                uint256 hash = tx.GetHash();
+                mpool.addUnchecked(hash, CTxMemPoolEntry(tx, feeV[j], GetTime(), 0.0, nHeight - 1));
+                mapPending[hash] = std::make_pair(j, nHeight - 1);
+            }
+        }
+
+        std::vector<CTransaction> vtx;
+        CAmount nBlockFees = 0;
+        for (std::map<uint256, std::pair<int, int> >::iterator it = mapPending.begin(); it != mapPending.end();) {
+            if (nHeight - it->second.second >= 10 - it->second.first) {
+                CTransaction txConfirmed;
+                BOOST_CHECK(mpool.lookup(it->first, txConfirmed));
+                vtx.push_back(txConfirmed);
+                nBlockFees += feeV[it->second.first];
+                mapPending.erase(it++);
+            } else {
+                it++;
+            }
+        }
+        std::list<CTransaction> dummyConflicted;
+        mpool.removeForBlock(vtx, nHeight, nBlockFees, dummyConflicted);
+    }
+
+    // Waiting i blocks is enough for fee level 10 - i and everything above it
+    for (int i = 1; i <= 10; i++) {
+        CFeeRate expected(feeV[10 - i], nTxSize);
+        CAmount nEstimate = mpool.estimateFee(i).GetFeePerK();
+        BOOST_CHECK(nEstimate >= expected.GetFeePerK() - 1 && nEstimate <= expected.GetFeePerK() + 1);
+        if (i > 1)
+            BOOST_CHECK(mpool.estimateFee(i) <= mpool.estimateFee(i - 1));
+    }
+    BOOST_CHECK(mpool.estimateFee(0) == CFeeRate(0));
+    BOOST_CHECK(mpool.estimateFee(MAX_BLOCK_CONFIRMS + 1) == CFeeRate(0));
+    BOOST_CHECK(mpool.estimatePriority(1) == -1);
+
+    // From the tenth block on, every block confirms four transactions of each level
+    CBlockFeeSummary summary;
+    BOOST_CHECK(mpool.GetBlockFeeSummary(nBlocks - 4, nBlocks, summary));
+    BOOST_CHECK_EQUAL(summary.nTxCount, 5 * 40);
+    BOOST_CHECK_EQUAL(summary.nTxBytes, 5 * 40 * (int64_t)nTxSize);
+    CAmount nLevelFees = 0;
+    for (CAmount nFee : feeV)
+        nLevelFees += 4 * nFee;
+    BOOST_CHECK_EQUAL(summary.nFees, 5 * nLevelFees);
+    BOOST_CHECK(!mpool.GetBlockFeeSummary(0, nBlocks, summary));
+    BOOST_CHECK(!mpool.GetBlockFeeSummary(nBlocks, nBlocks + 1, summary));
+
+    // The estimates survive a round trip through fee_estimates.dat
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(mpool.WriteFeeEstimates(file));
+    rewind(file.Get());
+    CTxMemPool mpoolRead(CFeeRate(1000));
+    BOOST_CHECK(mpoolRead.ReadFeeEstimates(file));
+    for (int i = 1; i <= 10; i++)
+        BOOST_CHECK(mpoolRead.estimateFee(i) == mpool.estimateFee(i));
+    BOOST_CHECK(mpoolRead.GetBlockFeeSummary(nBlocks - 4, nBlocks, summary));
+    BOOST_CHECK_EQUAL(summary.nTxCount, 5 * 40);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
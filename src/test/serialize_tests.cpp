@@ -161,4 +161,34 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(buffer_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    std::vector<unsigned char> vch(300, 0x5a);
+    ss << (uint32_t)0xdeadbeef << VARINT(1234567) << vch << std::string("beetle");
+
+    // reads the same values as the stream they were written to, without copying the buffer
+    std::vector<char> vData(ss.begin(), ss.end());
+    CBufferReader reader(vData.data(), vData.data() + vData.size(), SER_DISK, 0);
+    BOOST_CHECK_EQUAL(reader.size(), vData.size());
+    uint32_t n;
+    int nVarInt;
+    std::vector<unsigned char> vchRead;
+    std::string str;
+    reader >> n >> VARINT(nVarInt) >> vchRead;
+    BOOST_CHECK_EQUAL(n, 0xdeadbeef);
+    BOOST_CHECK_EQUAL(nVarInt, 1234567);
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK(!reader.eof());
+    reader >> str;
+    BOOST_CHECK_EQUAL(str, "beetle");
+    BOOST_CHECK(reader.eof());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    // a truncated buffer fails instead of reading past its end
+    CBufferReader truncated(vData.data(), vData.data() + 100, SER_DISK, 0);
+    truncated >> n >> VARINT(nVarInt);
+    BOOST_CHECK_THROW(truncated >> vchRead, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
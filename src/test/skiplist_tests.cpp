@@ -3,6 +3,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "main.h"
 #include "random.h"
 #include "util.h"
@@ -100,4 +101,70 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+
+    // Span a few chunks and check the entries of a chunk are contiguous
+    size_t nEntries = CBlockIndexArena::CHUNK_ENTRIES * 2 + 10;
+    std::vector<CBlockIndex*> vIndex;
+    for (size_t i = 0; i < nEntries; i++) {
+        CBlockIndex* pindex = arena.New();
+        pindex->nHeight = i;
+        pindex->pprev = vIndex.empty() ? NULL : vIndex.back();
+        pindex->BuildSkip();
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), nEntries);
+    BOOST_CHECK(vIndex[1] == vIndex[0] + 1);
+    BOOST_CHECK(vIndex[CBlockIndexArena::CHUNK_ENTRIES - 1] == vIndex[0] + CBlockIndexArena::CHUNK_ENTRIES - 1);
+
+    for (size_t i = 0; i < 1000; i++) {
+        int from = insecure_rand() % nEntries;
+        int to = insecure_rand() % (from + 1);
+        BOOST_CHECK(vIndex[from]->GetAncestor(to) == vIndex[to]);
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoin_supply_intern_test)
+{
+    CBlockIndex index;
+    BOOST_CHECK(index.pZerocoinSupply == CZerocoinSupply::Zero());
+    for (auto denom : libzerocoin::zerocoinDenomList)
+        BOOST_CHECK_EQUAL(index.GetZcMints(denom), 0);
+
+    CZerocoinSupply supply;
+    supply.Add(libzerocoin::ZQ_FIVE, 3);
+    supply.Add(libzerocoin::ZQ_FIVE_THOUSAND, 2);
+    supply.Add(libzerocoin::ZQ_FIVE_THOUSAND, -1);
+    index.SetZcSupply(supply);
+    BOOST_CHECK_EQUAL(index.GetZcMints(libzerocoin::ZQ_FIVE), 3);
+    BOOST_CHECK_EQUAL(index.GetZcMints(libzerocoin::ZQ_FIVE_THOUSAND), 1);
+    BOOST_CHECK_EQUAL(index.GetZcMints(libzerocoin::ZQ_ONE), 0);
+
+    // Blocks with the same supply share one entry
+    CBlockIndex indexNext;
+    indexNext.SetZcSupply(index.GetZcSupply());
+    BOOST_CHECK(indexNext.pZerocoinSupply == index.pZerocoinSupply);
+    BOOST_CHECK(CZerocoinSupply::Intern(supply) == index.pZerocoinSupply);
+
+    // Round trip through the map used on disk
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply = supply.ToMap();
+    BOOST_CHECK_EQUAL(mapSupply.size(), libzerocoin::zerocoinDenomList.size());
+    BOOST_CHECK_EQUAL(mapSupply.at(libzerocoin::ZQ_FIVE), 3);
+    BOOST_CHECK(CZerocoinSupply(mapSupply) == supply);
+
+    CDiskBlockIndex diskindex(&index);
+    diskindex.nVersion = 4;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << diskindex;
+    CDiskBlockIndex diskindexRead;
+    ss >> diskindexRead;
+    BOOST_CHECK(diskindexRead.pZerocoinSupply == index.pZerocoinSupply);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
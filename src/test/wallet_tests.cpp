@@ -2,7 +2,9 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "accumulators.h"
 #include "wallet.h"
+#include "walletdb.h"
 
 #include <set>
 #include <stdint.h>
@@ -21,6 +23,8 @@
 
 using namespace std;
 
+extern CWallet* pwalletMain;
+
 typedef set<pair<const CWalletTx*,unsigned int> > CoinSet;
 
 BOOST_AUTO_TEST_SUITE(wallet_tests)
@@ -305,4 +309,51 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(mint_witness_update_due)
+{
+    // Only once the tip passed a new accumulator checkpoint
+    BOOST_CHECK(!IsMintWitnessUpdateDue(20, 20));
+    BOOST_CHECK(!IsMintWitnessUpdateDue(20, 29));
+    BOOST_CHECK(IsMintWitnessUpdateDue(20, 30));
+    BOOST_CHECK(IsMintWitnessUpdateDue(25, 30));
+
+    // Several blocks connected at once, skipping over the checkpoint height
+    BOOST_CHECK(IsMintWitnessUpdateDue(28, 31));
+    BOOST_CHECK(IsMintWitnessUpdateDue(19, 45));
+
+    // A reorg to a shorter chain
+    BOOST_CHECK(IsMintWitnessUpdateDue(31, 29));
+    BOOST_CHECK(IsMintWitnessUpdateDue(31, 30));
+}
+
+BOOST_AUTO_TEST_CASE(mint_witness_state_db)
+{
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    uint256 hashPubcoin = GetRandHash();
+
+    CMintWitnessState state;
+    state.bnPubcoin = CBigNum(12345);
+    state.denom = libzerocoin::CoinDenomination::ZQ_ONE;
+    state.nHeightMint = 100;
+    state.nHeightNext = 180;
+    state.hashBlockLast = GetRandHash();
+    state.bnWitness = CBigNum(67890);
+    state.nMintsAdded = 3;
+    BOOST_CHECK(walletdb.WriteMintWitnessState(hashPubcoin, state));
+
+    CMintWitnessState stateRead;
+    BOOST_CHECK(walletdb.ReadMintWitnessState(hashPubcoin, stateRead));
+    BOOST_CHECK(stateRead.bnPubcoin == state.bnPubcoin);
+    BOOST_CHECK(stateRead.denom == state.denom);
+    BOOST_CHECK_EQUAL(stateRead.nHeightMint, state.nHeightMint);
+    BOOST_CHECK_EQUAL(stateRead.nHeightNext, state.nHeightNext);
+    BOOST_CHECK(stateRead.hashBlockLast == state.hashBlockLast);
+    BOOST_CHECK(stateRead.bnWitness == state.bnWitness);
+    BOOST_CHECK_EQUAL(stateRead.nMintsAdded, state.nMintsAdded);
+
+    // Spent and archived mints drop their record
+    BOOST_CHECK(walletdb.EraseMintWitnessState(hashPubcoin));
+    BOOST_CHECK(!walletdb.ReadMintWitnessState(hashPubcoin, stateRead));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
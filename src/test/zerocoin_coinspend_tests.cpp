@@ -16,6 +16,9 @@
 #include "wallet.h"
 #include "walletdb.h"
 #include "txdb.h"
+#include "zbeetspendcache.h"
+#include "checkqueue.h"
+#include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -89,4 +92,179 @@ BOOST_AUTO_TEST_CASE(zerocoin_wrapped_serial_spend_test)
 
 }
 
+/**
+ * Create a V2 spend of a fresh coin accumulated together with a few others.
+ */
+static CoinSpend CreateTestSpend(ZerocoinParams* ZCParams, Accumulator& acc, uint256& ptxHash)
+{
+    CoinDenomination denom = CoinDenomination::ZQ_ONE;
+    PrivateCoin coinToSpend(ZCParams, denom);
+    AccumulatorWitness accWitness(ZCParams, acc, coinToSpend.getPublicCoin());
+    for (int i = 0; i < 3; i++) {
+        PrivateCoin coin(ZCParams, denom);
+        acc += coin.getPublicCoin();
+        accWitness += coin.getPublicCoin();
+    }
+    acc += coinToSpend.getPublicCoin();
+
+    ptxHash = CBigNum::RandKBitBigum(256).getuint256();
+    return CoinSpend(ZCParams, ZCParams, coinToSpend, acc, 0, accWitness, ptxHash, SpendType::SPEND);
+}
+
+/**
+ * Check that spend proofs queued as CZerocoinSpendCheck are verified by the check queue workers.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_spend_check_queue_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams *ZCParams = Params().Zerocoin_Params(false);
+
+    Accumulator acc(ZCParams, CoinDenomination::ZQ_ONE);
+    uint256 ptxHash;
+    CoinSpend spend = CreateTestSpend(ZCParams, acc, ptxHash);
+
+    CCheckQueue<CZerocoinSpendCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CZerocoinSpendCheck>::Thread, &queue));
+
+    {
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        std::vector<CZerocoinSpendCheck> vChecks;
+        for (int i = 0; i < 4; i++) {
+            vChecks.emplace_back(ZCParams, acc.getValue());
+            vChecks.back().AddSpend(spend, ptxHash);
+        }
+        control.Add(vChecks);
+        BOOST_CHECK_MESSAGE(control.Wait(), "valid zerocoin spends failed in the check queue");
+    }
+
+    {
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        std::vector<CZerocoinSpendCheck> vChecks;
+        vChecks.emplace_back(ZCParams, acc.getValue());
+        vChecks.back().AddSpend(spend, ptxHash);
+        vChecks.emplace_back(ZCParams, acc.getValue() + 1);
+        vChecks.back().AddSpend(spend, ptxHash);
+        control.Add(vChecks);
+        BOOST_CHECK_MESSAGE(!control.Wait(), "spend against the wrong accumulator passed in the check queue");
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+/**
+ * Check that a verified spend is remembered only when asked to, and only for its own accumulator.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_spend_cache_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams *ZCParams = Params().Zerocoin_Params(false);
+
+    Accumulator acc(ZCParams, CoinDenomination::ZQ_ONE);
+    uint256 ptxHash;
+    CoinSpend spend = CreateTestSpend(ZCParams, acc, ptxHash);
+
+    uint64_t nEntries, nHits, nMisses;
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    uint64_t nHitsStart = nHits, nMissesStart = nMisses;
+
+    BOOST_CHECK(VerifyZerocoinSpendCached(spend, ZCParams, acc.getValue(), false));
+    BOOST_CHECK(VerifyZerocoinSpendCached(spend, ZCParams, acc.getValue(), true));
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, nHitsStart);
+    BOOST_CHECK_EQUAL(nMisses, nMissesStart + 2);
+
+    BOOST_CHECK(VerifyZerocoinSpendCached(spend, ZCParams, acc.getValue(), false));
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, nHitsStart + 1);
+
+    BOOST_CHECK(!VerifyZerocoinSpendCached(spend, ZCParams, acc.getValue() + 1, true));
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nMisses, nMissesStart + 3);
+}
+
+/**
+ * Check that BatchVerify accepts spends against their accumulator and rejects the batch otherwise.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_batch_verify_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams *ZCParams = Params().Zerocoin_Params(false);
+
+    Accumulator acc(ZCParams, CoinDenomination::ZQ_ONE);
+    uint256 ptxHash;
+    CoinSpend spend = CreateTestSpend(ZCParams, acc, ptxHash);
+
+    BOOST_CHECK(BatchVerify(acc, std::vector<const CoinSpend*>()));
+    BOOST_CHECK(BatchVerify(acc, {&spend}));
+    BOOST_CHECK(BatchVerify(acc, {&spend, &spend}));
+
+    Accumulator accWrongValue(ZCParams, CoinDenomination::ZQ_ONE, acc.getValue() + 1);
+    BOOST_CHECK(!BatchVerify(accWrongValue, {&spend, &spend}));
+
+    Accumulator accWrongDenom(ZCParams, CoinDenomination::ZQ_FIVE, acc.getValue());
+    BOOST_CHECK(!BatchVerify(accWrongDenom, {&spend}));
+
+    BOOST_CHECK(VerifyZerocoinSpendsCached({&spend, &spend}, ZCParams, acc.getValue(), false));
+    BOOST_CHECK(!VerifyZerocoinSpendsCached({&spend}, ZCParams, acc.getValue() + 1, false));
+
+    // The batch path takes the g_n and h_n powers from the fixed-base tables, it must agree with Verify
+    BOOST_CHECK_EQUAL(BatchVerify(acc, {&spend}), spend.Verify(acc));
+    BOOST_CHECK_EQUAL(BatchVerify(accWrongValue, {&spend}), spend.Verify(accWrongValue));
+}
+
+/**
+ * Check that the QRN group tables give the same powers as pow_mod, for negative exponents and
+ * for exponents larger than the tables cover.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_qrn_fixed_base_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const AccumulatorAndProofParams& params = Params().Zerocoin_Params(false)->accumulatorParams;
+    const CBigNum& N = params.accumulatorModulus;
+    const CBigNum& g_n = params.accumulatorQRNCommitmentGroup.g;
+    const CBigNum& h_n = params.accumulatorQRNCommitmentGroup.h;
+
+    std::vector<CBigNum> vExps = {CBigNum(0), CBigNum(1), CBigNum::RandKBitBigum(256), CBigNum::RandKBitBigum(3000),
+                                  CBigNum(0) - CBigNum::RandKBitBigum(3000), CBigNum::RandKBitBigum(8000)};
+    for (const CBigNum& e : vExps) {
+        BOOST_CHECK(params.qrnGPowMod(e) == g_n.pow_mod(e, N));
+        BOOST_CHECK(params.qrnHPowMod(e) == h_n.pow_mod(e, N));
+    }
+}
+
+/**
+ * Check that the spends of a block are grouped into one check per accumulator.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_spend_check_merge_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams *ZCParams = Params().Zerocoin_Params(false);
+
+    Accumulator acc(ZCParams, CoinDenomination::ZQ_ONE);
+    uint256 ptxHash;
+    CoinSpend spend = CreateTestSpend(ZCParams, acc, ptxHash);
+
+    CZerocoinSpendCheck check(ZCParams, acc.getValue());
+    BOOST_CHECK(check.GetAccumulatorKey().first == CoinDenomination::ZQ_ERROR);
+    check.AddSpend(spend, ptxHash);
+    BOOST_CHECK(check.GetAccumulatorKey() == std::make_pair(spend.getDenomination(), spend.getAccumulatorChecksum()));
+
+    CZerocoinSpendCheck checkOther(ZCParams, acc.getValue());
+    checkOther.AddSpend(spend, ptxHash);
+    checkOther.AddSpend(spend, ptxHash);
+    check.Merge(checkOther);
+    BOOST_CHECK(checkOther.GetAccumulatorKey().first == CoinDenomination::ZQ_ERROR);
+    BOOST_CHECK(check());
+
+    // One bad proof fails the whole group: the first spend is not against the accumulator with the new coins
+    CoinSpend spendOther = CreateTestSpend(ZCParams, acc, ptxHash);
+    CZerocoinSpendCheck checkBad(ZCParams, acc.getValue());
+    checkBad.AddSpend(spend, ptxHash);
+    checkBad.AddSpend(spendOther, ptxHash);
+    BOOST_CHECK(!checkBad());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,8 +10,11 @@
 #include "primitives/deterministicmint.h"
 #include "key.h"
 #include "accumulatorcheckpoints.h"
+#include "accumulatormap.h"
 #include "libzerocoin/bignum.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
 #include <iostream>
 #include <accumulators.h>
 #include "wallet.h"
@@ -88,6 +91,87 @@ BOOST_AUTO_TEST_CASE(bignum_basic_tests)
     BOOST_CHECK_MESSAGE(bn2 == bn, "CBigNum.setvch() or CBigNum.getvch() does not work correctly");
 }
 
+BOOST_AUTO_TEST_CASE(bignum_multi_pow_mod)
+{
+    CBigNum bnModulus;
+    bnModulus.SetHex(strHexModulus);
+
+    for (int i = 0; i < 4; i++) {
+        std::vector<CBigNum> vBases, vExps;
+        CBigNum bnExpected = 1;
+        for (int j = 0; j < i; j++) {
+            CBigNum bnBase = CBigNum::randBignum(bnModulus);
+            CBigNum bnExp = CBigNum::randBignum(bnModulus * bnModulus);
+            if (j % 2)
+                bnExp = -bnExp;
+            vBases.push_back(bnBase);
+            vExps.push_back(bnExp);
+            bnExpected = bnExpected.mul_mod(bnBase.pow_mod(bnExp, bnModulus), bnModulus);
+        }
+        BOOST_CHECK_MESSAGE(CBigNum::multi_pow_mod(vBases, vExps, bnModulus) == bnExpected, "CBigNum::multi_pow_mod() does not match pow_mod");
+    }
+
+    // Zero exponents
+    CBigNum bnBase = CBigNum::randBignum(bnModulus);
+    BOOST_CHECK(CBigNum::multi_pow_mod({bnBase, bnBase}, {0, 0}, bnModulus) == CBigNum(1));
+}
+
+//! base^exp mod m by square and multiply with mul_mod, without the thread's Montgomery contexts
+static CBigNum PowModReference(const CBigNum& base, const CBigNum& exp, const CBigNum& m)
+{
+    CBigNum ret = CBigNum(1) % m;
+    for (int i = exp.bitSize() - 1; i >= 0; i--) {
+        ret = ret.mul_mod(ret, m);
+        CBigNum bnBit = exp;
+        bnBit >>= i;
+        if (bnBit.isOdd())
+            ret = ret.mul_mod(base, m);
+    }
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(bignum_thread_state)
+{
+    // More odd moduli than the per-thread Montgomery cache holds, plus an even one that bypasses it
+    std::vector<CBigNum> vModuli;
+    for (int i = 0; i < 11; i++) {
+        CBigNum bnModulus = CBigNum::RandKBitBigum(512);
+        if (!bnModulus.isOdd())
+            bnModulus += 1;
+        vModuli.push_back(bnModulus);
+    }
+    CBigNum bnEven = CBigNum::RandKBitBigum(512);
+    if (bnEven.isOdd())
+        bnEven += 1;
+    vModuli.push_back(bnEven);
+
+    std::vector<CBigNum> vBases, vExps, vExpected;
+    for (int i = 0; i < 3 * (int)vModuli.size(); i++) {
+        const CBigNum& bnModulus = vModuli[i % vModuli.size()];
+        vBases.push_back(CBigNum::randBignum(bnModulus));
+        vExps.push_back(CBigNum::RandKBitBigum(160));
+        vExpected.push_back(PowModReference(vBases.back(), vExps.back(), bnModulus));
+    }
+
+    // The cached contexts are evicted and rebuilt in turn, from several threads at once
+    std::atomic<int> nMismatches(0);
+    boost::thread_group threadGroup;
+    for (int t = 0; t < 4; t++) {
+        threadGroup.create_thread([&]() {
+            for (int n = 0; n < 2; n++) {
+                for (size_t i = 0; i < vExpected.size(); i++) {
+                    const CBigNum& bnModulus = vModuli[i % vModuli.size()];
+                    if (vBases[i].pow_mod(vExps[i], bnModulus) != vExpected[i] ||
+                        CBigNum::multi_pow_mod({vBases[i]}, {vExps[i]}, bnModulus) != vExpected[i])
+                        nMismatches++;
+                }
+            }
+        });
+    }
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(nMismatches.load(), 0);
+}
+
 //ZQ_ONE mints
 std::string rawTx1 = "0100000001983d5fd91685bb726c0ebc3676f89101b16e663fd896fea53e19972b95054c49000000006a473044022010fbec3e78f9c46e58193d481caff715ceb984df44671d30a2c0bde95c54055f0220446a97d9340da690eaf2658e5b2bf6a0add06f1ae3f1b40f37614c7079ce450d012103cb666bd0f32b71cbf4f32e95fa58e05cd83869ac101435fcb8acee99123ccd1dffffffff0200e1f5050000000086c10280004c80c3a01f94e71662f2ae8bfcd88dfc5b5e717136facd6538829db0c7f01e5fd793cccae7aa1958564518e0223d6d9ce15b1e38e757583546e3b9a3f85bd14408120cd5192a901bb52152e8759fdd194df230d78477706d0e412a66398f330be38a23540d12ab147e9fb19224913f3fe552ae6a587fb30a68743e52577150ff73042c0f0d8f000000001976a914d6042025bd1fff4da5da5c432d85d82b3f26a01688ac00000000";
 std::string rawTxpub1 = "473ff507157523e74680ab37f586aae52e53f3f912492b19f7e14ab120d54238ae30b338f39662a410e6d707784d730f24d19dd9f75e85221b51b902a19d50c120844d15bf8a3b9e346355857e7381e5be19c6d3d22e01845565819aae7cacc93d75f1ef0c7b09d823865cdfa3671715e5bfc8dd8fc8baef26216e7941fa0c3";
@@ -495,6 +579,98 @@ BOOST_AUTO_TEST_CASE(checksum_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(accumulatormap_list_accumulate)
+{
+    cout << "Running accumulatormap_list_accumulate\n";
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+
+    std::list<PublicCoin> listPubcoins;
+    for (int i = 0; i < 24; i++) {
+        CoinDenomination denom = zerocoinDenomList[i % zerocoinDenomList.size()];
+        listPubcoins.emplace_back(params, CBigNum::randBignum(params->coinCommitmentGroup.groupOrder), denom);
+    }
+
+    AccumulatorMap mapSerial(params);
+    for (const PublicCoin& pubcoin : listPubcoins)
+        BOOST_CHECK(mapSerial.Accumulate(pubcoin, true));
+
+    AccumulatorMap mapList(params);
+    BOOST_CHECK(mapList.Accumulate(listPubcoins, true));
+    BOOST_CHECK_MESSAGE(mapList.GetCheckpoint() == mapSerial.GetCheckpoint(), "per-denomination accumulation changed the checkpoint");
+    for (auto denom : zerocoinDenomList)
+        BOOST_CHECK(mapList.GetValue(denom) == mapSerial.GetValue(denom));
+
+    // an empty list leaves the accumulators untouched
+    BOOST_CHECK(mapList.Accumulate(std::list<PublicCoin>(), true));
+    BOOST_CHECK(mapList.GetCheckpoint() == mapSerial.GetCheckpoint());
+}
+
+BOOST_AUTO_TEST_CASE(accumulate_checkpoint_run)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+
+    // four checkpoints on top of the initial accumulators, the third one without new mints
+    std::vector<std::list<PublicCoin> > vPubcoins(4);
+    for (int i = 0; i < 30; i++) {
+        CoinDenomination denom = zerocoinDenomList[i % zerocoinDenomList.size()];
+        vPubcoins[i % 2 == 0 ? 0 : (i % 3 == 0 ? 1 : 3)].emplace_back(params, CBigNum::randBignum(params->coinCommitmentGroup.groupOrder), denom);
+    }
+
+    AccumulatorMap mapSerial(params);
+    AccumulatorCheckpoints::Checkpoint checkpointStart;
+    for (auto denom : zerocoinDenomList)
+        checkpointStart[denom] = mapSerial.GetValue(denom);
+
+    std::vector<AccumulatorCheckpoints::Checkpoint> vCheckpoints;
+    BOOST_CHECK(AccumulateCheckpointRun(params, checkpointStart, vPubcoins, vCheckpoints));
+    BOOST_CHECK_EQUAL(vCheckpoints.size(), vPubcoins.size());
+
+    // the same as accumulating each checkpoint's mints one after the other
+    AccumulatorMap mapRun(params);
+    for (size_t i = 0; i < vPubcoins.size(); i++) {
+        for (const PublicCoin& pubcoin : vPubcoins[i])
+            BOOST_CHECK(mapSerial.Accumulate(pubcoin, true));
+        for (auto denom : zerocoinDenomList)
+            BOOST_CHECK(vCheckpoints[i].at(denom) == mapSerial.GetValue(denom));
+        mapRun.Load(vCheckpoints[i]);
+        BOOST_CHECK(mapRun.GetCheckpoint() == mapSerial.GetCheckpoint());
+    }
+    BOOST_CHECK(vCheckpoints[2] == vCheckpoints[1]);
+
+    // a pubcoin without a valid denomination fails the whole run
+    vPubcoins[1].emplace_back(params, CBigNum::randBignum(params->coinCommitmentGroup.groupOrder), CoinDenomination::ZQ_ERROR);
+    BOOST_CHECK(!AccumulateCheckpointRun(params, checkpointStart, vPubcoins, vCheckpoints));
+}
+
+BOOST_AUTO_TEST_CASE(read_blocks_parallel)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    BOOST_REQUIRE(pindexGenesis != NULL);
+
+    // enough entries for several worker ranges, each has to see the block a serial read returns
+    CBlock blockSerial;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockSerial, pindexGenesis));
+    std::vector<CBlockIndex*> vIndex(100, pindexGenesis);
+    std::vector<uint256> vHashes(vIndex.size());
+    BOOST_CHECK(ReadBlocksParallel(vIndex, [&](size_t i, const CBlock& block) {
+        vHashes[i] = block.GetHash();
+        return block.vtx.size() == blockSerial.vtx.size();
+    }));
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(hash == blockSerial.GetHash());
+
+    // a failing callback fails the read
+    BOOST_CHECK(!ReadBlocksParallel(vIndex, [&](size_t i, const CBlock& block) {
+        return i != 42;
+    }));
+    BOOST_CHECK(ReadBlocksParallel(std::vector<CBlockIndex*>(), [&](size_t i, const CBlock& block) {
+        return false;
+    }));
+}
+
 BOOST_AUTO_TEST_CASE(test_checkpoints)
 {
     BOOST_CHECK_MESSAGE(AccumulatorCheckpoints::LoadCheckpoints("regtest"), "failed to load checkpoints");
@@ -57,6 +57,9 @@ public:
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool WriteBlockFileInfo(int nFile, const CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
+    /** Counter bumped by every session that loads the block index, block index snapshots are tied to it */
+    bool WriteGeneration(uint64_t nGeneration);
+    bool ReadGeneration(uint64_t& nGeneration);
     bool WriteLastBlockFile(int nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
@@ -8,25 +8,40 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "policyestimator.h"
+#include "primitives/zerocoin.h"
 #include "streams.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "version.h"
-
-#include <boost/circular_buffer.hpp>
+#include "zbeetchain.h"
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nSigOps(0), fInputsChecked(false),
+                                     nFeeDelta(0), dPriorityDelta(0.0), dCachedPriority(0.0), nCountWithAncestors(1),
+                                     nSizeWithAncestors(0), nModFeesWithAncestors(0), nSigOpsWithAncestors(0),
+                                     nCountWithDescendants(1), nSizeWithDescendants(0), nModFeesWithDescendants(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight),
+                                                                                                                                                fInputsChecked(false), nFeeDelta(0), dPriorityDelta(0.0), dCachedPriority(0.0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+    nSigOps = GetLegacySigOpCount(tx);
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nSigOpsWithAncestors = nSigOps;
+
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nModFeesWithDescendants = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -43,332 +58,20 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
-/**
- * Keep track of fee/priority for transactions confirmed within N blocks
- */
-class CBlockAverage
-{
-private:
-    boost::circular_buffer<CFeeRate> feeSamples;
-    boost::circular_buffer<double> prioritySamples;
-
-    template <typename T>
-    std::vector<T> buf2vec(boost::circular_buffer<T> buf) const
-    {
-        std::vector<T> vec(buf.begin(), buf.end());
-        return vec;
-    }
-
-public:
-    CBlockAverage() : feeSamples(100), prioritySamples(100) {}
-
-    void RecordFee(const CFeeRate& feeRate)
-    {
-        feeSamples.push_back(feeRate);
-    }
-
-    void RecordPriority(double priority)
-    {
-        prioritySamples.push_back(priority);
-    }
-
-    size_t FeeSamples() const { return feeSamples.size(); }
-    size_t GetFeeSamples(std::vector<CFeeRate>& insertInto) const
-    {
-        BOOST_FOREACH (const CFeeRate& f, feeSamples)
-            insertInto.push_back(f);
-        return feeSamples.size();
-    }
-    size_t PrioritySamples() const { return prioritySamples.size(); }
-    size_t GetPrioritySamples(std::vector<double>& insertInto) const
-    {
-        BOOST_FOREACH (double d, prioritySamples)
-            insertInto.push_back(d);
-        return prioritySamples.size();
-    }
-
-    /**
-     * Used as belt-and-suspenders check when reading to detect
-     * file corruption
-     */
-    static bool AreSane(const CFeeRate fee, const CFeeRate& minRelayFee)
-    {
-        if (fee < CFeeRate(0))
-            return false;
-        if (fee.GetFeePerK() > minRelayFee.GetFeePerK() * 10000)
-            return false;
-        return true;
-    }
-    static bool AreSane(const std::vector<CFeeRate>& vecFee, const CFeeRate& minRelayFee)
-    {
-        BOOST_FOREACH (CFeeRate fee, vecFee) {
-            if (!AreSane(fee, minRelayFee))
-                return false;
-        }
-        return true;
-    }
-    static bool AreSane(const double priority)
-    {
-        return priority >= 0;
-    }
-    static bool AreSane(const std::vector<double> vecPriority)
-    {
-        BOOST_FOREACH (double priority, vecPriority) {
-            if (!AreSane(priority))
-                return false;
-        }
-        return true;
-    }
-
-    void Write(CAutoFile& fileout) const
-    {
-        std::vector<CFeeRate> vecFee = buf2vec(feeSamples);
-        fileout << vecFee;
-        std::vector<double> vecPriority = buf2vec(prioritySamples);
-        fileout << vecPriority;
-    }
-
-    void Read(CAutoFile& filein, const CFeeRate& minRelayFee)
-    {
-        std::vector<CFeeRate> vecFee;
-        filein >> vecFee;
-        if (AreSane(vecFee, minRelayFee))
-            feeSamples.insert(feeSamples.end(), vecFee.begin(), vecFee.end());
-        else
-            throw runtime_error("Corrupt fee value in estimates file.");
-        std::vector<double> vecPriority;
-        filein >> vecPriority;
-        if (AreSane(vecPriority))
-            prioritySamples.insert(prioritySamples.end(), vecPriority.begin(), vecPriority.end());
-        else
-            throw runtime_error("Corrupt priority value in estimates file.");
-        if (feeSamples.size() + prioritySamples.size() > 0)
-            LogPrint("estimatefee", "Read %d fee samples and %d priority samples\n",
-                feeSamples.size(), prioritySamples.size());
-    }
-};
-
-class CMinerPolicyEstimator
-{
-private:
-    /**
-     * Records observed averages transactions that confirmed within one block, two blocks,
-     * three blocks etc.
-     */
-    std::vector<CBlockAverage> history;
-    std::vector<CFeeRate> sortedFeeSamples;
-    std::vector<double> sortedPrioritySamples;
-
-    int nBestSeenHeight;
-
-    /**
-     * nBlocksAgo is 0 based, i.e. transactions that confirmed in the highest seen block are
-     * nBlocksAgo == 0, transactions in the block before that are nBlocksAgo == 1 etc.
-     */
-    void seenTxConfirm(const CFeeRate& feeRate, const CFeeRate& minRelayFee, double dPriority, int nBlocksAgo)
-    {
-        // Last entry records "everything else".
-        int nBlocksTruncated = min(nBlocksAgo, (int)history.size() - 1);
-        assert(nBlocksTruncated >= 0);
-
-        // We need to guess why the transaction was included in a block-- either
-        // because it is high-priority or because it has sufficient fees.
-        bool sufficientFee = (feeRate > minRelayFee);
-        bool sufficientPriority = AllowFree(dPriority);
-        const char* assignedTo = "unassigned";
-        if (sufficientFee && !sufficientPriority && CBlockAverage::AreSane(feeRate, minRelayFee)) {
-            history[nBlocksTruncated].RecordFee(feeRate);
-            assignedTo = "fee";
-        } else if (sufficientPriority && !sufficientFee && CBlockAverage::AreSane(dPriority)) {
-            history[nBlocksTruncated].RecordPriority(dPriority);
-            assignedTo = "priority";
-        } else {
-            // Neither or both fee and priority sufficient to get confirmed:
-            // don't know why they got confirmed.
-        }
-        LogPrint("estimatefee", "Seen TX confirm: %s : %s fee/%g priority, took %d blocks\n",
-            assignedTo, feeRate.ToString(), dPriority, nBlocksAgo);
-    }
-
-public:
-    CMinerPolicyEstimator(int nEntries) : nBestSeenHeight(0)
-    {
-        history.resize(nEntries);
-    }
-
-    void seenBlock(const std::vector<CTxMemPoolEntry>& entries, int nBlockHeight, const CFeeRate minRelayFee)
-    {
-        if (nBlockHeight <= nBestSeenHeight) {
-            // Ignore side chains and re-orgs; assuming they are random
-            // they don't affect the estimate.
-            // And if an attacker can re-org the chain at will, then
-            // you've got much bigger problems than "attacker can influence
-            // transaction fees."
-            return;
-        }
-        nBestSeenHeight = nBlockHeight;
-
-        // Fill up the history buckets based on how long transactions took
-        // to confirm.
-        std::vector<std::vector<const CTxMemPoolEntry*> > entriesByConfirmations;
-        entriesByConfirmations.resize(history.size());
-        BOOST_FOREACH (const CTxMemPoolEntry& entry, entries) {
-            // How many blocks did it take for miners to include this transaction?
-            int delta = nBlockHeight - entry.GetHeight();
-            if (delta <= 0) {
-                // Re-org made us lose height, this should only happen if we happen
-                // to re-org on a difficulty transition point: very rare!
-                continue;
-            }
-            if ((delta - 1) >= (int)history.size())
-                delta = history.size(); // Last bucket is catch-all
-            entriesByConfirmations.at(delta - 1).push_back(&entry);
-        }
-        for (size_t i = 0; i < entriesByConfirmations.size(); i++) {
-            std::vector<const CTxMemPoolEntry*>& e = entriesByConfirmations.at(i);
-            // Insert at most 10 random entries per bucket, otherwise a single block
-            // can dominate an estimate:
-            if (e.size() > 10) {
-                std::random_shuffle(e.begin(), e.end());
-                e.resize(10);
-            }
-            BOOST_FOREACH (const CTxMemPoolEntry* entry, e) {
-                // Fees are stored and reported as BTC-per-kb:
-                CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-                double dPriority = entry->GetPriority(entry->GetHeight()); // Want priority when it went IN
-                seenTxConfirm(feeRate, minRelayFee, dPriority, i);
-            }
-        }
-
-        //After new samples are added, we have to clear the sorted lists,
-        //so they'll be resorted the next time someone asks for an estimate
-        sortedFeeSamples.clear();
-        sortedPrioritySamples.clear();
-
-        for (size_t i = 0; i < history.size(); i++) {
-            if (history[i].FeeSamples() + history[i].PrioritySamples() > 0)
-                LogPrint("estimatefee", "estimates: for confirming within %d blocks based on %d/%d samples, fee=%s, prio=%g\n",
-                    i,
-                    history[i].FeeSamples(), history[i].PrioritySamples(),
-                    estimateFee(i + 1).ToString(), estimatePriority(i + 1));
-        }
-    }
-
-    /**
-     * Can return CFeeRate(0) if we don't have any data for that many blocks back. nBlocksToConfirm is 1 based.
-     */
-    CFeeRate estimateFee(int nBlocksToConfirm)
-    {
-        nBlocksToConfirm--;
-
-        if (nBlocksToConfirm < 0 || nBlocksToConfirm >= (int)history.size())
-            return CFeeRate(0);
-
-        if (sortedFeeSamples.size() == 0) {
-            for (size_t i = 0; i < history.size(); i++)
-                history.at(i).GetFeeSamples(sortedFeeSamples);
-            std::sort(sortedFeeSamples.begin(), sortedFeeSamples.end(),
-                std::greater<CFeeRate>());
-        }
-        if (sortedFeeSamples.size() < 11) {
-            // Eleven is Gavin's Favorite Number
-            // ... but we also take a maximum of 10 samples per block so eleven means
-            // we're getting samples from at least two different blocks
-            return CFeeRate(0);
-        }
-
-        int nBucketSize = history.at(nBlocksToConfirm).FeeSamples();
-
-        // Estimates should not increase as number of confirmations goes up,
-        // but the estimates are noisy because confirmations happen discretely
-        // in blocks. To smooth out the estimates, use all samples in the history
-        // and use the nth highest where n is (number of samples in previous bucket +
-        // half the samples in nBlocksToConfirm bucket):
-        size_t nPrevSize = 0;
-        for (int i = 0; i < nBlocksToConfirm; i++)
-            nPrevSize += history.at(i).FeeSamples();
-        size_t index = min(nPrevSize + nBucketSize / 2, sortedFeeSamples.size() - 1);
-        return sortedFeeSamples[index];
-    }
-    double estimatePriority(int nBlocksToConfirm)
-    {
-        nBlocksToConfirm--;
-
-        if (nBlocksToConfirm < 0 || nBlocksToConfirm >= (int)history.size())
-            return -1;
-
-        if (sortedPrioritySamples.size() == 0) {
-            for (size_t i = 0; i < history.size(); i++)
-                history.at(i).GetPrioritySamples(sortedPrioritySamples);
-            std::sort(sortedPrioritySamples.begin(), sortedPrioritySamples.end(),
-                std::greater<double>());
-        }
-        if (sortedPrioritySamples.size() < 11)
-            return -1.0;
-
-        int nBucketSize = history.at(nBlocksToConfirm).PrioritySamples();
-
-        // Estimates should not increase as number of confirmations needed goes up,
-        // but the estimates are noisy because confirmations happen discretely
-        // in blocks. To smooth out the estimates, use all samples in the history
-        // and use the nth highest where n is (number of samples in previous buckets +
-        // half the samples in nBlocksToConfirm bucket).
-        size_t nPrevSize = 0;
-        for (int i = 0; i < nBlocksToConfirm; i++)
-            nPrevSize += history.at(i).PrioritySamples();
-        size_t index = min(nPrevSize + nBucketSize / 2, sortedPrioritySamples.size() - 1);
-        return sortedPrioritySamples[index];
-    }
-
-    void Write(CAutoFile& fileout) const
-    {
-        fileout << nBestSeenHeight;
-        fileout << history.size();
-        BOOST_FOREACH (const CBlockAverage& entry, history) {
-            entry.Write(fileout);
-        }
-    }
-
-    void Read(CAutoFile& filein, const CFeeRate& minRelayFee)
-    {
-        int nFileBestSeenHeight;
-        filein >> nFileBestSeenHeight;
-        size_t numEntries;
-        filein >> numEntries;
-        if (numEntries <= 0 || numEntries > 10000)
-            throw runtime_error("Corrupt estimates file. Must have between 1 and 10k entries.");
-
-        std::vector<CBlockAverage> fileHistory;
-
-        for (size_t i = 0; i < numEntries; i++) {
-            CBlockAverage entry;
-            entry.Read(filein, minRelayFee);
-            fileHistory.push_back(entry);
-        }
-
-        // Now that we've processed the entire fee estimate data file and not
-        // thrown any errors, we can copy it to our history
-        nBestSeenHeight = nFileBestSeenHeight;
-        history = fileHistory;
-        assert(history.size() > 0);
-    }
-};
-
-
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       totalTxSize(0),
+                                                       lastRollingFeeUpdate(GetTime()),
+                                                       blockSinceLastRollingFeeBump(false),
+                                                       rollingMinimumFeeRate(0),
+                                                       nPriorityHeight(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
     fSanityCheck = false;
 
-    // 25 blocks is a compromise between using a lot of disk/memory and
-    // trying to give accurate estimates to people who might be willing
-    // to wait a day or two to save a fraction of a penny in fees.
-    // Confirmation times for very-low-fee transactions that take more
-    // than an hour or three to confirm are highly variable.
-    minerPolicyEstimator = new CMinerPolicyEstimator(25);
+    minerPolicyEstimator = new CBlockPolicyEstimator(_minRelayFee);
 }
 
 CTxMemPool::~CTxMemPool()
@@ -409,11 +112,95 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        if(!tx.IsZerocoinSpend()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+        if (mapTx.count(hash))
+            return true;
+
+        // Refuse a second spender of a serial, the pool can only track one per serial
+        std::vector<uint256> vSerialHashes;
+        if (entry.GetTx().IsZerocoinSpend()) {
+            for (const CTxIn& txin : entry.GetTx().vin) {
+                if (!txin.scriptSig.IsZerocoinSpend())
+                    continue;
+                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
+                uint256 hashSerial = GetSerialHash(spend.getCoinSerialNumber());
+                std::map<uint256, txiter>::const_iterator itSerial = mapZerocoinSerials.find(hashSerial);
+                if (itSerial != mapZerocoinSerials.end())
+                    return error("%s : zerocoin spend %s spends serial hash %s of mempool tx %s", __func__,
+                        hash.ToString(), hashSerial.ToString(), itSerial->second->first.ToString());
+                vSerialHashes.push_back(hashSerial);
+            }
+        }
+
+        txiter newit = mapTx.insert(std::make_pair(hash, entry)).first;
+        CTxMemPoolEntry& newEntry = newit->second;
+        const CTransaction& tx = newEntry.GetTx();
+        ApplyDeltas(hash, newEntry.dPriorityDelta, newEntry.nFeeDelta);
+        newEntry.nModFeesWithAncestors = newEntry.GetModifiedFee();
+        newEntry.nCountWithAncestors = 1;
+        newEntry.nSizeWithAncestors = newEntry.GetTxSize();
+        newEntry.nSigOpsWithAncestors = newEntry.GetSigOpCount();
+        newEntry.nCountWithDescendants = 1;
+        newEntry.nSizeWithDescendants = newEntry.GetTxSize();
+        newEntry.nModFeesWithDescendants = newEntry.GetModifiedFee();
+        setEntryTime.insert(newit);
+
+        TxLinks& links = mapLinks[newit];
+        if (tx.IsZerocoinSpend()) {
+            setZerocoinSpends.insert(newit);
+            newEntry.vZerocoinSerialHashes = vSerialHashes;
+            BOOST_FOREACH (const uint256& hashSerial, vSerialHashes)
+                mapZerocoinSerials[hashSerial] = newit;
+        } else {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+                txiter itParent = mapTx.find(tx.vin[i].prevout.hash);
+                if (itParent != mapTx.end()) {
+                    links.parents.insert(itParent);
+                    mapLinks[itParent].children.insert(newit);
+                }
+            }
+
+            // When a block is disconnected its transactions are re-added after
+            // in-pool transactions that already spend them, so pick those up too.
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.find(COutPoint(hash, i));
+                if (itNext == mapNextTx.end())
+                    continue;
+                txiter itChild = mapTx.find(itNext->second.ptx->GetHash());
+                if (itChild == mapTx.end() || itChild == newit)
+                    continue;
+                links.children.insert(itChild);
+                mapLinks[itChild].parents.insert(newit);
+            }
+
+            newEntry.dCachedPriority = newEntry.GetModifiedPriority(std::max(nPriorityHeight, newEntry.GetHeight()));
+            setPriority.insert(newit);
+
+            setEntries setAncestors;
+            CalculateMemPoolAncestors(newit, setAncestors);
+            if (links.children.empty()) {
+                BOOST_FOREACH (txiter itAncestor, setAncestors) {
+                    const CTxMemPoolEntry& ancestor = itAncestor->second;
+                    newEntry.nCountWithAncestors++;
+                    newEntry.nSizeWithAncestors += ancestor.GetTxSize();
+                    newEntry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+                    newEntry.nSigOpsWithAncestors += ancestor.GetSigOpCount();
+                    UpdateDescendantState(itAncestor, 1, newEntry.GetTxSize(), newEntry.GetModifiedFee());
+                }
+                setAncestorFee.insert(newit);
+            } else {
+                // The new entry and its ancestors may overlap with what its
+                // descendants already count, so recompute both sides from scratch.
+                setAncestorFee.insert(newit);
+                setEntries setDescendants;
+                CalculateDescendants(newit, setDescendants);
+                BOOST_FOREACH (txiter itDescendant, setDescendants)
+                    CalculateAncestorState(itDescendant);
+                CalculateDescendantState(newit);
+                BOOST_FOREACH (txiter itAncestor, setAncestors)
+                    CalculateDescendantState(itAncestor);
+            }
+            setDescendantScore.insert(newit);
         }
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
@@ -421,6 +208,212 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     return true;
 }
 
+void CTxMemPool::CalculateMemPoolAncestors(txiter it, setEntries& setAncestors) const
+{
+    std::vector<txiter> vToVisit(1, it);
+    while (!vToVisit.empty()) {
+        txiter itNext = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH (txiter itParent, GetMemPoolParents(itNext)) {
+            if (setAncestors.insert(itParent).second)
+                vToVisit.push_back(itParent);
+        }
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount,
+    uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString)
+{
+    LOCK(cs);
+    const CTransaction& tx = entry.GetTx();
+    if (tx.IsZerocoinSpend())
+        return true;
+
+    std::vector<txiter> vToVisit;
+    for (const CTxIn& txin : tx.vin) {
+        txiter itParent = mapTx.find(txin.prevout.hash);
+        if (itParent != mapTx.end() && setAncestors.insert(itParent).second)
+            vToVisit.push_back(itParent);
+    }
+
+    uint64_t nSizeWithAncestors = entry.GetTxSize();
+    while (!vToVisit.empty()) {
+        if (setAncestors.size() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
+
+        txiter it = vToVisit.back();
+        vToVisit.pop_back();
+        const CTxMemPoolEntry& ancestor = it->second;
+        nSizeWithAncestors += ancestor.GetTxSize();
+        if (nSizeWithAncestors > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+        if (ancestor.GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", it->first.ToString(), limitDescendantCount);
+            return false;
+        }
+        if (ancestor.GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", it->first.ToString(), limitDescendantSize);
+            return false;
+        }
+
+        BOOST_FOREACH (txiter itParent, GetMemPoolParents(it)) {
+            if (setAncestors.insert(itParent).second)
+                vToVisit.push_back(itParent);
+        }
+    }
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(txiter it, setEntries& setDescendants)
+{
+    std::vector<txiter> vToVisit(1, it);
+    setDescendants.insert(it);
+    while (!vToVisit.empty()) {
+        txiter itNext = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH (txiter itChild, mapLinks[itNext].children) {
+            if (setDescendants.insert(itChild).second)
+                vToVisit.push_back(itChild);
+        }
+    }
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter it) const
+{
+    std::map<txiter, TxLinks, CompareIteratorByHash>::const_iterator itLinks = mapLinks.find(it);
+    assert(itLinks != mapLinks.end());
+    return itLinks->second.parents;
+}
+
+void CTxMemPool::CalculateAncestorState(txiter it)
+{
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(it, setAncestors);
+    const CTxMemPoolEntry& entry = it->second;
+    int64_t nSize = entry.GetTxSize();
+    CAmount nModFees = entry.GetModifiedFee();
+    int64_t nSigOps = entry.GetSigOpCount();
+    BOOST_FOREACH (txiter itAncestor, setAncestors) {
+        nSize += itAncestor->second.GetTxSize();
+        nModFees += itAncestor->second.GetModifiedFee();
+        nSigOps += itAncestor->second.GetSigOpCount();
+    }
+    UpdateAncestorState(it, (int64_t)setAncestors.size() + 1 - (int64_t)entry.nCountWithAncestors, nSize - (int64_t)entry.nSizeWithAncestors,
+        nModFees - entry.nModFeesWithAncestors, nSigOps - entry.nSigOpsWithAncestors);
+}
+
+void CTxMemPool::CalculateDescendantState(txiter it)
+{
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    const CTxMemPoolEntry& entry = it->second;
+    int64_t nSize = 0;
+    CAmount nModFees = 0;
+    BOOST_FOREACH (txiter itDescendant, setDescendants) {
+        nSize += itDescendant->second.GetTxSize();
+        nModFees += itDescendant->second.GetModifiedFee();
+    }
+    UpdateDescendantState(it, (int64_t)setDescendants.size() - (int64_t)entry.nCountWithDescendants, nSize - (int64_t)entry.nSizeWithDescendants,
+        nModFees - entry.nModFeesWithDescendants);
+}
+
+void CTxMemPool::UpdateDescendantState(txiter it, int64_t nCount, int64_t nSize, CAmount nModFees)
+{
+    bool fIndexed = setDescendantScore.erase(it) > 0;
+    CTxMemPoolEntry& entry = it->second;
+    entry.nCountWithDescendants += nCount;
+    entry.nSizeWithDescendants += nSize;
+    entry.nModFeesWithDescendants += nModFees;
+    if (fIndexed)
+        setDescendantScore.insert(it);
+}
+
+void CTxMemPool::UpdateAncestorState(txiter it, int64_t nCount, int64_t nSize, CAmount nModFees, int64_t nSigOps)
+{
+    // The ancestor fee index is keyed on these values, so take the entry out while they change
+    bool fIndexed = setAncestorFee.erase(it) > 0;
+    CTxMemPoolEntry& entry = it->second;
+    entry.nCountWithAncestors += nCount;
+    entry.nSizeWithAncestors += nSize;
+    entry.nModFeesWithAncestors += nModFees;
+    entry.nSigOpsWithAncestors += nSigOps;
+    if (fIndexed)
+        setAncestorFee.insert(it);
+}
+
+const CTxMemPool::indexed_priority& CTxMemPool::GetPriorityIndex(unsigned int nHeight)
+{
+    // Priorities grow with the chain at a per-transaction rate, so the order
+    // only holds for one height. Re-sort once per height instead of per template.
+    if (nHeight != nPriorityHeight) {
+        setPriority.clear();
+        for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+            if (it->second.GetTx().IsZerocoinSpend())
+                continue;
+            it->second.dCachedPriority = it->second.GetModifiedPriority(std::max(nHeight, it->second.GetHeight()));
+            setPriority.insert(it);
+        }
+        nPriorityHeight = nHeight;
+    }
+    return setPriority;
+}
+
+void CTxMemPool::removeUnchecked(txiter it)
+{
+    const CTxMemPoolEntry& entry = it->second;
+
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    setDescendants.erase(it);
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(it, setAncestors);
+
+    const TxLinks& links = mapLinks[it];
+    bool fHasParents = !links.parents.empty();
+    BOOST_FOREACH (txiter itParent, links.parents)
+        mapLinks[itParent].children.erase(it);
+    BOOST_FOREACH (txiter itChild, links.children)
+        mapLinks[itChild].parents.erase(it);
+    mapLinks.erase(it);
+
+    // Transactions confirmed in a block have no in-pool parents, so the
+    // descendants simply stop counting this entry. Taking one out of the
+    // middle of a chain also cuts them off from its ancestors.
+    BOOST_FOREACH (txiter itDescendant, setDescendants) {
+        if (fHasParents)
+            CalculateAncestorState(itDescendant);
+        else
+            UpdateAncestorState(itDescendant, -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee(), -(int64_t)entry.GetSigOpCount());
+    }
+    BOOST_FOREACH (txiter itAncestor, setAncestors) {
+        if (setDescendants.empty())
+            UpdateDescendantState(itAncestor, -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+        else
+            CalculateDescendantState(itAncestor);
+    }
+
+    setAncestorFee.erase(it);
+    setPriority.erase(it);
+    setDescendantScore.erase(it);
+    setEntryTime.erase(it);
+    setZerocoinSpends.erase(it);
+    BOOST_FOREACH (const uint256& hashSerial, entry.GetZerocoinSerialHashes()) {
+        std::map<uint256, txiter>::iterator itSerial = mapZerocoinSerials.find(hashSerial);
+        if (itSerial != mapZerocoinSerials.end() && itSerial->second == it)
+            mapZerocoinSerials.erase(itSerial);
+    }
+
+    BOOST_FOREACH (const CTxIn& txin, entry.GetTx().vin)
+        mapNextTx.erase(txin.prevout);
+
+    totalTxSize -= entry.GetTxSize();
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
@@ -444,9 +437,10 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
         while (!txToRemove.empty()) {
             uint256 hash = txToRemove.front();
             txToRemove.pop_front();
-            if (!mapTx.count(hash))
+            txiter itRemove = mapTx.find(hash);
+            if (itRemove == mapTx.end())
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
+            const CTransaction& tx = itRemove->second.GetTx();
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
                     std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
@@ -455,13 +449,9 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
-            BOOST_FOREACH (const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
 
             removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+            removeUnchecked(itRemove);
         }
     }
 }
@@ -505,39 +495,158 @@ void CTxMemPool::removeConflicts(const CTransaction& tx, std::list<CTransaction>
             }
         }
     }
+
+    // Zerocoin spends conflict through their serials instead
+    if (tx.IsZerocoinSpend() && !mapZerocoinSerials.empty()) {
+        for (const CTxIn& txin : tx.vin) {
+            if (!txin.scriptSig.IsZerocoinSpend())
+                continue;
+            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
+            std::map<uint256, txiter>::iterator it = mapZerocoinSerials.find(GetSerialHash(spend.getCoinSerialNumber()));
+            if (it != mapZerocoinSerials.end() && it->second->first != tx.GetHash()) {
+                const CTransaction txConflict = it->second->second.GetTx();
+                remove(txConflict, removed, true);
+            }
+        }
+    }
 }
 
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts)
+void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, CAmount nBlockFees, std::list<CTransaction>& conflicts)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
+    CBlockFeeSummary summary;
+    summary.nHeight = nBlockHeight;
+    summary.nFees = nBlockFees;
     BOOST_FOREACH (const CTransaction& tx, vtx) {
         uint256 hash = tx.GetHash();
         if (mapTx.count(hash))
             entries.push_back(mapTx[hash]);
+        if (!tx.IsCoinBase() && !tx.IsCoinStake()) {
+            summary.nTxCount++;
+            summary.nTxBytes += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        }
     }
-    minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
+    minerPolicyEstimator->processBlock(nBlockHeight, entries, summary);
     BOOST_FOREACH (const CTransaction& tx, vtx) {
         std::list<CTransaction> dummy;
         remove(tx, dummy, false);
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    mapLinks.clear();
+    setAncestorFee.clear();
+    setPriority.clear();
+    setDescendantScore.clear();
+    setEntryTime.clear();
+    setZerocoinSpends.clear();
+    mapZerocoinSerials.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
+void CTxMemPool::RemoveStaged(const setEntries& stage, std::list<CTransaction>& removed)
+{
+    // A child always has more in-pool ancestors than its parents. Removing
+    // the deepest entries first keeps every removal cheap: there are no
+    // descendants left whose ancestor state would need recomputing.
+    std::vector<txiter> vRemove(stage.begin(), stage.end());
+    std::sort(vRemove.begin(), vRemove.end(), [](const txiter& a, const txiter& b) {
+        return a->second.GetCountWithAncestors() > b->second.GetCountWithAncestors();
+    });
+    BOOST_FOREACH (txiter it, vRemove) {
+        removed.push_back(it->second.GetTx());
+        removeUnchecked(it);
+    }
+}
+
+void CTxMemPool::TrimToSize(uint64_t nSizeLimit, std::list<CTransaction>& removed)
+{
+    LOCK(cs);
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (totalTxSize > nSizeLimit && !setDescendantScore.empty()) {
+        txiter it = *setDescendantScore.begin();
+        double dFees, dSize;
+        CompareByDescendantScore::GetScore(it->second, dFees, dSize);
+        CFeeRate feeRateRemoved((CAmount)dFees, (size_t)dSize);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, feeRateRemoved);
+
+        // Whatever enters next has to pay more than this package did, and for the relay of its own bytes
+        trackPackageRemoved(CFeeRate(feeRateRemoved.GetFeePerK() + minRelayFee.GetFeePerK()));
+
+        setEntries stage;
+        CalculateDescendants(it, stage);
+        nTxnRemoved += stage.size();
+        RemoveStaged(stage, removed);
+    }
+
+    if (nTxnRemoved > 0)
+        LogPrint("mempool", "TrimToSize: removed %u txn paying up to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+CFeeRate CTxMemPool::GetMinFee(uint64_t nSizeLimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(llround(rollingMinimumFeeRate));
+
+    int64_t nTime = GetTime();
+    if (nTime > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (totalTxSize < nSizeLimit / 4)
+            halflife /= 4;
+        else if (totalTxSize < nSizeLimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (nTime - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = nTime;
+
+        if (rollingMinimumFeeRate < (double)minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), minRelayFee);
+}
+
+int CTxMemPool::Expire(int64_t nTime)
+{
+    LOCK(cs);
+    setEntries stage;
+    for (indexed_entry_time::const_iterator it = setEntryTime.begin(); it != setEntryTime.end() && (*it)->second.GetTime() < nTime; ++it)
+        CalculateDescendants(*it, stage);
+
+    std::list<CTransaction> removed;
+    RemoveStaged(stage, removed);
+    return stage.size();
+}
+
 void CTxMemPool::check(const CCoinsViewCache* pcoins) const
 {
     if (!fSanityCheck)
@@ -574,6 +683,49 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        // Check the parent links and the cached ancestor state.
+        txiter itThis = const_cast<CTxMemPool*>(this)->mapTx.find(it->first);
+        setEntries setParentCheck;
+        if (!tx.IsZerocoinSpend()) {
+            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+                txiter itParent = const_cast<CTxMemPool*>(this)->mapTx.find(txin.prevout.hash);
+                if (itParent != mapTx.end())
+                    setParentCheck.insert(itParent);
+            }
+        }
+        assert(setParentCheck == GetMemPoolParents(itThis));
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(itThis, setAncestors);
+        uint64_t nSizeCheck = it->second.GetTxSize();
+        CAmount nFeesCheck = it->second.GetModifiedFee();
+        unsigned int nSigOpsCheck = it->second.GetSigOpCount();
+        BOOST_FOREACH (txiter itAncestor, setAncestors) {
+            nSizeCheck += itAncestor->second.GetTxSize();
+            nFeesCheck += itAncestor->second.GetModifiedFee();
+            nSigOpsCheck += itAncestor->second.GetSigOpCount();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeCheck);
+        assert(it->second.GetModFeesWithAncestors() == nFeesCheck);
+        assert(it->second.GetSigOpCountWithAncestors() == nSigOpsCheck);
+        assert(setAncestorFee.count(itThis) == (tx.IsZerocoinSpend() ? 0 : 1));
+        BOOST_FOREACH (const uint256& hashSerial, it->second.GetZerocoinSerialHashes()) {
+            std::map<uint256, txiter>::const_iterator itSerial = mapZerocoinSerials.find(hashSerial);
+            assert(itSerial != mapZerocoinSerials.end() && itSerial->second == itThis);
+        }
+
+        setEntries setDescendants;
+        const_cast<CTxMemPool*>(this)->CalculateDescendants(itThis, setDescendants);
+        nSizeCheck = 0;
+        nFeesCheck = 0;
+        BOOST_FOREACH (txiter itDescendant, setDescendants) {
+            nSizeCheck += itDescendant->second.GetTxSize();
+            nFeesCheck += itDescendant->second.GetModifiedFee();
+        }
+        assert(it->second.GetCountWithDescendants() == setDescendants.size());
+        assert(it->second.GetSizeWithDescendants() == nSizeCheck);
+        assert(it->second.GetModFeesWithDescendants() == nFeesCheck);
+
         if (fDependsWait)
             waitingOnDependants.push_back(&it->second);
         else {
@@ -610,6 +762,12 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+    assert(mapLinks.size() == mapTx.size());
+    assert(setAncestorFee.size() + setZerocoinSpends.size() == mapTx.size());
+    assert(setDescendantScore.size() == setAncestorFee.size());
+    assert(setEntryTime.size() == mapTx.size());
+    for (std::map<uint256, txiter>::const_iterator it = mapZerocoinSerials.begin(); it != mapZerocoinSerials.end(); it++)
+        assert(setZerocoinSpends.count(it->second));
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -640,6 +798,16 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+bool CTxMemPool::lookupZerocoinSerial(const uint256& hashSerial, uint256& txid) const
+{
+    LOCK(cs);
+    std::map<uint256, txiter>::const_iterator it = mapZerocoinSerials.find(hashSerial);
+    if (it == mapZerocoinSerials.end())
+        return false;
+    txid = it->second->first;
+    return true;
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -651,6 +819,12 @@ double CTxMemPool::estimatePriority(int nBlocks) const
     return minerPolicyEstimator->estimatePriority(nBlocks);
 }
 
+bool CTxMemPool::GetBlockFeeSummary(int nStartHeight, int nEndHeight, CBlockFeeSummary& total) const
+{
+    LOCK(cs);
+    return minerPolicyEstimator->GetBlockFeeSummary(nStartHeight, nEndHeight, total);
+}
+
 bool CTxMemPool::WriteFeeEstimates(CAutoFile& fileout) const
 {
     try {
@@ -674,7 +848,7 @@ bool CTxMemPool::ReadFeeEstimates(CAutoFile& filein)
             return error("CTxMemPool::ReadFeeEstimates() : up-version (%d) fee estimate file", nVersionRequired);
 
         LOCK(cs);
-        minerPolicyEstimator->Read(filein, minRelayFee);
+        minerPolicyEstimator->Read(filein);
     } catch (const std::exception&) {
         LogPrintf("CTxMemPool::ReadFeeEstimates() : unable to read policy estimator data (non-fatal)");
         return false;
@@ -689,6 +863,31 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end()) {
+            bool fIndexed = setPriority.erase(it) > 0;
+            it->second.dPriorityDelta += dPriorityDelta;
+            it->second.dCachedPriority += dPriorityDelta;
+            if (fIndexed)
+                setPriority.insert(it);
+
+            // The descendant score index reads the entry's own fee as well
+            fIndexed = setDescendantScore.erase(it) > 0;
+            it->second.nFeeDelta += nFeeDelta;
+            it->second.nModFeesWithDescendants += nFeeDelta;
+            if (fIndexed)
+                setDescendantScore.insert(it);
+
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            BOOST_FOREACH (txiter itDescendant, setDescendants)
+                UpdateAncestorState(itDescendant, 0, 0, nFeeDelta, 0);
+            setEntries setAncestors;
+            CalculateMemPoolAncestors(it, setAncestors);
+            BOOST_FOREACH (txiter itAncestor, setAncestors)
+                UpdateDescendantState(itAncestor, 0, 0, nFeeDelta);
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
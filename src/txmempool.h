@@ -8,6 +8,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -45,6 +46,23 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    unsigned int nSigOps; //! Legacy sigop count
+    bool fInputsChecked;  //! Scripts were verified against MANDATORY_SCRIPT_VERIFY_FLAGS
+    std::vector<uint256> vZerocoinSerialHashes; //! Serials spent by a zerocoin spend, set by CTxMemPool
+
+    // Maintained by CTxMemPool
+    CAmount nFeeDelta;                //! Fee delta from PrioritiseTransaction
+    double dPriorityDelta;            //! Priority delta from PrioritiseTransaction
+    double dCachedPriority;           //! Priority at the height of the last priority index rebuild
+    uint64_t nCountWithAncestors;     //! Number of in-pool ancestors, including this one
+    uint64_t nSizeWithAncestors;      //! ... their total size
+    CAmount nModFeesWithAncestors;    //! ... their total fee, including deltas
+    unsigned int nSigOpsWithAncestors; //! ... and their total legacy sigops
+    uint64_t nCountWithDescendants;   //! Number of in-pool descendants, including this one
+    uint64_t nSizeWithDescendants;    //! ... their total size
+    CAmount nModFeesWithDescendants;  //! ... and their total fee, including deltas
+
+    friend class CTxMemPool;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -57,9 +75,26 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    unsigned int GetSigOpCount() const { return nSigOps; }
+    const std::vector<uint256>& GetZerocoinSerialHashes() const { return vZerocoinSerialHashes; }
+
+    bool InputsChecked() const { return fInputsChecked; }
+    void SetInputsChecked() { fInputsChecked = true; }
+
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+    double GetModifiedPriority(unsigned int currentHeight) const { return GetPriority(currentHeight) + dPriorityDelta; }
+    double GetCachedPriority() const { return dCachedPriority; }
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    unsigned int GetSigOpCountWithAncestors() const { return nSigOpsWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
 };
 
-class CMinerPolicyEstimator;
+class CBlockFeeSummary;
+class CBlockPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
@@ -94,15 +129,125 @@ public:
  */
 class CTxMemPool
 {
+public:
+    typedef std::map<uint256, CTxMemPoolEntry>::iterator txiter;
+
+    struct CompareIteratorByHash {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            return a->first < b->first;
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
+    /** Highest ancestor fee rate first; smaller packages and then txid break ties */
+    struct CompareByAncestorFee {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            double f1 = (double)a->second.GetModFeesWithAncestors() * b->second.GetSizeWithAncestors();
+            double f2 = (double)b->second.GetModFeesWithAncestors() * a->second.GetSizeWithAncestors();
+            if (f1 != f2)
+                return f1 > f2;
+            if (a->second.GetCountWithAncestors() != b->second.GetCountWithAncestors())
+                return a->second.GetCountWithAncestors() < b->second.GetCountWithAncestors();
+            return a->first < b->first;
+        }
+    };
+    typedef std::set<txiter, CompareByAncestorFee> indexed_ancestor_fee;
+
+    /** Highest cached priority first, txid breaks ties */
+    struct CompareByPriority {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            if (a->second.dCachedPriority != b->second.dCachedPriority)
+                return a->second.dCachedPriority > b->second.dCachedPriority;
+            return a->first < b->first;
+        }
+    };
+    typedef std::set<txiter, CompareByPriority> indexed_priority;
+
+    /**
+     * Lowest fee rate first, taking the larger of the entry's own fee rate and
+     * that of the entry together with its descendants. Newer entries go first
+     * among equals.
+     */
+    struct CompareByDescendantScore {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            double f1, s1, f2, s2;
+            GetScore(a->second, f1, s1);
+            GetScore(b->second, f2, s2);
+            if (f1 * s2 != f2 * s1)
+                return f1 * s2 < f2 * s1;
+            if (a->second.GetTime() != b->second.GetTime())
+                return a->second.GetTime() > b->second.GetTime();
+            return a->first < b->first;
+        }
+
+        static void GetScore(const CTxMemPoolEntry& entry, double& dFees, double& dSize)
+        {
+            dFees = (double)entry.GetModFeesWithDescendants();
+            dSize = (double)entry.GetSizeWithDescendants();
+            if ((double)entry.GetModifiedFee() * dSize > dFees * entry.GetTxSize()) {
+                dFees = (double)entry.GetModifiedFee();
+                dSize = (double)entry.GetTxSize();
+            }
+        }
+    };
+    typedef std::set<txiter, CompareByDescendantScore> indexed_descendant_score;
+
+    /** Oldest entry first */
+    struct CompareByEntryTime {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            if (a->second.GetTime() != b->second.GetTime())
+                return a->second.GetTime() < b->second.GetTime();
+            return a->first < b->first;
+        }
+    };
+    typedef std::set<txiter, CompareByEntryTime> indexed_entry_time;
+
 private:
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+
     bool fSanityCheck; //! Normally false, true if -checkmempool or -regtest
     unsigned int nTransactionsUpdated;
-    CMinerPolicyEstimator* minerPolicyEstimator;
+    CBlockPolicyEstimator* minerPolicyEstimator;
 
-    CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
+    CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main, also the increment for the rolling minimum fee
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    mutable int64_t lastRollingFeeUpdate;      //! Time rollingMinimumFeeRate last decayed
+    mutable bool blockSinceLastRollingFeeBump; //! Decay only starts with the first block after an eviction
+    mutable double rollingMinimumFeeRate;      //! Fee rate per kB an entry must pay since the last eviction, decaying
+
+    std::map<txiter, TxLinks, CompareIteratorByHash> mapLinks; //! In-pool parents and children of every entry
+    indexed_ancestor_fee setAncestorFee;                       //! Entries (except zerocoin spends) by ancestor fee rate
+    indexed_priority setPriority;                              //! Entries (except zerocoin spends) by priority
+    indexed_descendant_score setDescendantScore;               //! Entries (except zerocoin spends) by descendant score
+    indexed_entry_time setEntryTime;                           //! All entries by entry time
+    setEntries setZerocoinSpends;                              //! Zerocoin spends, which have no in-pool ancestors
+    std::map<uint256, txiter> mapZerocoinSerials;              //! Spender of every zerocoin serial hash in the pool
+    unsigned int nPriorityHeight;                              //! Height setPriority was last sorted for
+
+    void CalculateDescendants(txiter it, setEntries& setDescendants);
+    void CalculateAncestorState(txiter it);
+    void UpdateAncestorState(txiter it, int64_t nCount, int64_t nSize, CAmount nModFees, int64_t nSigOps);
+    void CalculateDescendantState(txiter it);
+    void UpdateDescendantState(txiter it, int64_t nCount, int64_t nSize, CAmount nModFees);
+    void removeUnchecked(txiter it);
+    /** Remove a set of entries closed under descendants, children before parents */
+    void RemoveStaged(const setEntries& stage, std::list<CTransaction>& removed);
+    /** Raise the rolling minimum fee to rate if that is higher */
+    void trackPackageRemoved(const CFeeRate& rate);
+
 public:
+    /** Time in seconds in which the rolling minimum fee halves once blocks come in again */
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
@@ -120,12 +265,30 @@ public:
     void check(const CCoinsViewCache* pcoins) const;
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
+    /** Returns false, adding nothing, for a zerocoin spend of a serial another pool entry spends already */
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
+    /** nBlockFees are the fees paid by all transactions of the block, for its fee summary */
+    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, CAmount nBlockFees, std::list<CTransaction>& conflicts);
     void clear();
+
+    /**
+     * Evict the lowest fee rate transactions, each with its descendants, until
+     * the pool holds at most nSizeLimit bytes of transactions. The rolling minimum
+     * fee is raised above the fee rate of every evicted package by minRelayFee.
+     */
+    void TrimToSize(uint64_t nSizeLimit, std::list<CTransaction>& removed);
+    /**
+     * Fee rate a new transaction must pay to enter a pool limited to nSizeLimit bytes,
+     * CFeeRate(0) unless transactions were evicted recently. After an eviction it decays
+     * with a half life of ROLLING_FEE_HALFLIFE, faster while the pool is less than half
+     * full, and drops to zero once it is below half of minRelayFee.
+     */
+    CFeeRate GetMinFee(uint64_t nSizeLimit) const;
+    /** Remove transactions that entered the pool before nTime, with their descendants. Returns the number removed. */
+    int Expire(int64_t nTime);
     void queryHashes(std::vector<uint256>& vtxid);
     void getTransactions(std::set<uint256>& setTxid);
     void pruneSpent(const uint256& hash, CCoins& coins);
@@ -137,6 +300,25 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /**
+     * Indexes used by CreateNewBlock to assemble a template without scanning
+     * the whole pool. All require cs to be held.
+     */
+    const indexed_ancestor_fee& GetAncestorFeeIndex() const { return setAncestorFee; }
+    const indexed_priority& GetPriorityIndex(unsigned int nHeight);
+    const setEntries& GetZerocoinSpends() const { return setZerocoinSpends; }
+    const setEntries& GetMemPoolParents(txiter it) const;
+    /** Add the in-pool ancestors of it (not it itself) to setAncestors */
+    void CalculateMemPoolAncestors(txiter it, setEntries& setAncestors) const;
+    /**
+     * Collect the in-pool ancestors of entry, which is not in the pool yet, into setAncestors. Fails,
+     * explaining why in errString, if the entry together with its ancestors would exceed the ancestor
+     * count or size limits, or give one of those ancestors more descendants (counting itself) than
+     * the descendant limits allow. The walk stops at the first limit hit, so its cost stays bounded.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount,
+        uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString);
+
     unsigned long size()
     {
         LOCK(cs);
@@ -156,12 +338,18 @@ public:
 
     bool lookup(uint256 hash, CTransaction& result) const;
 
+    /** Find the pool transaction spending the zerocoin serial with this hash */
+    bool lookupZerocoinSerial(const uint256& hashSerial, uint256& txid) const;
+
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
     /** Estimate priority needed to get into the next nBlocks */
     double estimatePriority(int nBlocks) const;
 
+    /** Totals of the blocks nStartHeight to nEndHeight, false unless all of them were seen by the estimator */
+    bool GetBlockFeeSummary(int nStartHeight, int nEndHeight, CBlockFeeSummary& total) const;
+
     /** Write/Read estimates to disk */
     bool WriteFeeEstimates(CAutoFile& fileout) const;
     bool ReadFeeEstimates(CAutoFile& filein);
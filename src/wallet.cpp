@@ -735,6 +735,18 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    //Advance the cached zBEET witnesses once a new accumulator checkpoint was reached since the last
+    //update. The tip can move by several blocks at once, so don't look for the checkpoint height itself.
+    if (!fFileBacked || !IsMintWitnessUpdateDue(nLastMintWitnessUpdateHeight, pindex->nHeight))
+        return;
+
+    nLastMintWitnessUpdateHeight = pindex->nHeight;
+    if (!zbeetTracker->IsEmpty())
+        fMintWitnessUpdatePending = true;
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
@@ -4600,15 +4612,21 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
         return false;
     }
 
-    // 3. Compute Accumulator and Witness
+    // 3. Compute Accumulator and Witness, resuming from the witness state cached in the wallet
     libzerocoin::Accumulator accumulator(paramsAccumulator, pubCoinSelected.getDenomination());
     libzerocoin::AccumulatorWitness witness(paramsAccumulator, accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, pindexCheckpoint)) {
+    CWalletDB walletdb(strWalletFile);
+    uint256 hashPubcoin = GetPubCoinHash(pubCoinSelected.getValue());
+    CMintWitnessState witnessState;
+    walletdb.ReadMintWitnessState(hashPubcoin, witnessState);
+    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, pindexCheckpoint, &witnessState)) {
         receipt.SetStatus(_("Try to spend with a higher security level to include more coins"), ZBEET_FAILED_ACCUMULATOR_INITIALIZATION);
         return error("%s : %s", __func__, receipt.GetStatusMessage());
     }
+    if (!witnessState.IsNull())
+        walletdb.WriteMintWitnessState(hashPubcoin, witnessState);
 
     // Construct the CoinSpend object. This acts like a signature on the transaction.
     libzerocoin::PrivateCoin privateCoin(paramsCoin, denomination);
@@ -5313,6 +5331,64 @@ bool CWallet::GetMint(const uint256& hashSerial, CZerocoinMint& mint)
 }
 
 
+void CWallet::UpdateMintWitnessStates()
+{
+    std::set<CMintMeta> setMints;
+    {
+        LOCK(cs_wallet);
+        setMints = zbeetTracker->ListMints(true, true, false);
+    }
+
+    CWalletDB walletdb(strWalletFile);
+    for (const CMintMeta& meta : setMints) {
+        CMintWitnessState state;
+        walletdb.ReadMintWitnessState(meta.hashPubcoin, state);
+        bool fRebuilt = false;
+        while (true) {
+            if (ShutdownRequested())
+                return;
+            boost::this_thread::interruption_point();
+
+            //Accumulate a limited number of blocks per lock, so that block connection isn't held up
+            LOCK2(cs_main, cs_wallet);
+            if (!zbeetTracker->HasSerialHash(meta.hashSerial) || zbeetTracker->Get(meta.hashSerial).isUsed)
+                break;
+
+            int nHeightStop = GetMintWitnessStopHeight();
+            if (state.IsNull() || !AdvanceMintWitnessState(state, std::min(nHeightStop, state.nHeightNext + MINT_WITNESS_UPDATE_BLOCKS))) {
+                //No state yet, or it was built on blocks that are no longer in the active chain
+                CZerocoinMint mint;
+                if (fRebuilt || !GetMint(meta.hashSerial, mint))
+                    break;
+
+                bool isV1Coin = libzerocoin::ExtractVersionFromSerial(mint.GetSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params(isV1Coin), mint.GetValue(), mint.GetDenomination());
+                state.SetNull();
+                if (!InitMintWitnessState(pubcoin, state))
+                    break;
+                fRebuilt = true;
+                continue;
+            }
+
+            walletdb.WriteMintWitnessState(meta.hashPubcoin, state);
+            if (state.nHeightNext >= nHeightStop)
+                break;
+        }
+    }
+}
+
+void ThreadUpdateMintWitnessStates(CWallet* pwallet)
+{
+    RenameThread("beetlecoin-zwitness");
+
+    while (true) {
+        MilliSleep(1000);
+
+        if (pwallet->fMintWitnessUpdatePending.exchange(false))
+            pwallet->UpdateMintWitnessStates();
+    }
+}
+
 bool CWallet::IsMyMint(const CBigNum& bnValue) const
 {
     if (zbeetTracker->HasPubcoin(bnValue))
@@ -27,6 +27,7 @@
 #include "zbeettracker.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -58,6 +59,8 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! Blocks accumulated into a zBEET witness per cs_main acquisition by the background update
+static const int MINT_WITNESS_UPDATE_BLOCKS = 500;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -221,6 +224,7 @@ public:
     bool DatabaseMint(CDeterministicMint& dMint);
     bool SetMintUnspent(const CBigNum& bnSerial);
     bool UpdateMint(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom);
+    void UpdateMintWitnessStates();
     string GetUniqueWalletBackupName(bool fzbeetAuto) const;
 
 
@@ -267,6 +271,10 @@ public:
     int nLastMultiSendHeight;
     std::vector<std::string> vDisabledAddresses;
 
+    //zBEET witness updates, done by ThreadUpdateMintWitnessStates
+    std::atomic<int> nLastMintWitnessUpdateHeight;
+    std::atomic<bool> fMintWitnessUpdatePending;
+
     //Auto Combine Inputs
     bool fCombineDust;
     CAmount nAutoCombineThreshold;
@@ -318,6 +326,9 @@ public:
         nLastMultiSendHeight = 0;
         vDisabledAddresses.clear();
 
+        nLastMintWitnessUpdateHeight = 0;
+        fMintWitnessUpdatePending = false;
+
         //Auto Combine Dust
         fCombineDust = false;
         nAutoCombineThreshold = 0;
@@ -465,6 +476,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex* pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
@@ -678,6 +690,9 @@ public:
     boost::signals2::signal<void (const bool& fSuccess, const std::string& filename)> NotifyWalletBacked;
 };
 
+/** Advance the cached zBEET witnesses of the wallet whenever UpdatedBlockTip asks for it */
+void ThreadUpdateMintWitnessStates(CWallet* pwallet);
+
 
 /** A key allocated from the key pool. */
 class CReserveKey
@@ -7,6 +7,7 @@
 
 #include "walletdb.h"
 
+#include "accumulators.h"
 #include "base58.h"
 #include "protocol.h"
 #include "serialize.h"
@@ -1163,6 +1164,21 @@ bool CWalletDB::EraseDeterministicMint(const uint256& hashPubcoin)
     return Erase(make_pair(string("dzbeet"), hashPubcoin));
 }
 
+bool CWalletDB::WriteMintWitnessState(const uint256& hashPubcoin, const CMintWitnessState& state)
+{
+    return Write(make_pair(string("zwitness"), hashPubcoin), state, true);
+}
+
+bool CWalletDB::ReadMintWitnessState(const uint256& hashPubcoin, CMintWitnessState& state)
+{
+    return Read(make_pair(string("zwitness"), hashPubcoin), state);
+}
+
+bool CWalletDB::EraseMintWitnessState(const uint256& hashPubcoin)
+{
+    return Erase(make_pair(string("zwitness"), hashPubcoin));
+}
+
 bool CWalletDB::WriteZerocoinMint(const CZerocoinMint& zerocoinMint)
 {
     CDataStream ss(SER_GETHASH, 0);
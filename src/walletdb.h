@@ -31,6 +31,7 @@ class CScript;
 class CWallet;
 class CWalletTx;
 class CDeterministicMint;
+class CMintWitnessState;
 class CZerocoinMint;
 class CZerocoinSpend;
 class uint160;
@@ -156,6 +157,9 @@ public:
     bool WriteDeterministicMint(const CDeterministicMint& dMint);
     bool ReadDeterministicMint(const uint256& hashPubcoin, CDeterministicMint& dMint);
     bool EraseDeterministicMint(const uint256& hashPubcoin);
+    bool WriteMintWitnessState(const uint256& hashPubcoin, const CMintWitnessState& state);
+    bool ReadMintWitnessState(const uint256& hashPubcoin, CMintWitnessState& state);
+    bool EraseMintWitnessState(const uint256& hashPubcoin);
     bool WriteZerocoinMint(const CZerocoinMint& zerocoinMint);
     bool EraseZerocoinMint(const CZerocoinMint& zerocoinMint);
     bool ReadZerocoinMint(const CBigNum &bnPubcoinValue, CZerocoinMint& zerocoinMint);
@@ -0,0 +1,174 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "xevanbatch.h"
+
+#include "checkqueue.h"
+#include "crypto/sph_4way.h"
+#include "hash.h"
+#include "sync.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+// XEVAN feeds every stage after the first 128 bytes: the previous 512 bit digest followed by 64 zero bytes
+static const size_t XEVAN_WORK_SIZE = 128;
+static const size_t XEVAN_DIGEST_SIZE = 64;
+
+// Below this many groups the caller hashes them itself, handing them to the queue costs more than it saves
+static const size_t MIN_GROUPS_PER_BATCH_QUEUE = 4;
+
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+struct XevanStage {
+    // Run this stage over the current buffer of every lane. The context is reused from lane to lane.
+    static void Run(unsigned char (*vchIn)[XEVAN_WORK_SIZE], unsigned char (*vchOut)[XEVAN_WORK_SIZE], size_t nLanes)
+    {
+        Context ctx;
+        for (size_t i = 0; i < nLanes; i++) {
+            // haval only writes 256 bits, the rest of the digest must read as zero
+            memset(vchOut[i], 0, XEVAN_DIGEST_SIZE);
+            Init(&ctx);
+            Update(&ctx, vchIn[i], XEVAN_WORK_SIZE);
+            Close(&ctx, vchOut[i]);
+        }
+    }
+};
+
+template <void (*Hash4Way)(const void* const[SPH_4WAY_LANES], size_t, void* const[SPH_4WAY_LANES])>
+struct XevanStage4Way {
+    // Run this stage over the current buffer of every lane, SPH_4WAY_LANES lanes per call
+    static void Run(unsigned char (*vchIn)[XEVAN_WORK_SIZE], unsigned char (*vchOut)[XEVAN_WORK_SIZE], size_t nLanes)
+    {
+        unsigned char vchSpare[XEVAN_DIGEST_SIZE];
+        for (size_t i = 0; i < nLanes; i += SPH_4WAY_LANES) {
+            const void* vpIn[SPH_4WAY_LANES];
+            void* vpOut[SPH_4WAY_LANES];
+            for (size_t j = 0; j < SPH_4WAY_LANES; j++) {
+                // a short last call fills its missing lanes with the last input and throws their digests away
+                bool fLane = i + j < nLanes;
+                vpIn[j] = vchIn[fLane ? i + j : nLanes - 1];
+                vpOut[j] = fLane ? vchOut[i + j] : vchSpare;
+            }
+            Hash4Way(vpIn, XEVAN_WORK_SIZE, vpOut);
+        }
+    }
+};
+
+typedef void (*XevanStageFunc)(unsigned char (*)[XEVAN_WORK_SIZE], unsigned char (*)[XEVAN_WORK_SIZE], size_t);
+
+// Stages 2 to 17 of the chain; stage 1 hashes the message itself and is followed by these, then all 17 run again
+static const XevanStageFunc vStages[] = {
+    &XevanStage<sph_bmw512_context, sph_bmw512_init, sph_bmw512, sph_bmw512_close>::Run,
+    &XevanStage<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>::Run,
+    &XevanStage<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>::Run,
+    &XevanStage<sph_jh512_context, sph_jh512_init, sph_jh512, sph_jh512_close>::Run,
+    &XevanStage4Way<sph_keccak512_4way>::Run,
+    &XevanStage<sph_luffa512_context, sph_luffa512_init, sph_luffa512, sph_luffa512_close>::Run,
+    &XevanStage<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>::Run,
+    &XevanStage<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>::Run,
+    &XevanStage<sph_simd512_context, sph_simd512_init, sph_simd512, sph_simd512_close>::Run,
+    &XevanStage<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>::Run,
+    &XevanStage<sph_hamsi512_context, sph_hamsi512_init, sph_hamsi512, sph_hamsi512_close>::Run,
+    &XevanStage<sph_fugue512_context, sph_fugue512_init, sph_fugue512, sph_fugue512_close>::Run,
+    &XevanStage<sph_shabal512_context, sph_shabal512_init, sph_shabal512, sph_shabal512_close>::Run,
+    &XevanStage<sph_whirlpool_context, sph_whirlpool_init, sph_whirlpool, sph_whirlpool_close>::Run,
+    &XevanStage4Way<sph_sha512_4way>::Run,
+    &XevanStage<sph_haval256_5_context, sph_haval256_5_init, sph_haval256_5, sph_haval256_5_close>::Run,
+};
+
+static void HashGroup(const XevanInput* pInputs, uint256* pHashes, size_t nLanes)
+{
+    // two buffers per lane, each stage reads one and writes the other; the upper halves stay zero throughout
+    unsigned char vchBuf[2][XEVAN_BATCH_LANES][XEVAN_WORK_SIZE];
+    memset(vchBuf, 0, sizeof(vchBuf));
+
+    static unsigned char pblank[1];
+    sph_blake512_context ctx_blake;
+    for (size_t i = 0; i < nLanes; i++) {
+        const unsigned char* pbegin = pInputs[i].first;
+        const unsigned char* pend = pInputs[i].second;
+        sph_blake512_init(&ctx_blake);
+        sph_blake512(&ctx_blake, pbegin == pend ? pblank : pbegin, pend - pbegin);
+        sph_blake512_close(&ctx_blake, vchBuf[0][i]);
+    }
+
+    int nCur = 0;
+    for (int nRound = 0; nRound < 2; nRound++) {
+        if (nRound > 0) {
+            XevanStage<sph_blake512_context, sph_blake512_init, sph_blake512, sph_blake512_close>::Run(vchBuf[nCur], vchBuf[1 - nCur], nLanes);
+            nCur = 1 - nCur;
+        }
+        for (XevanStageFunc stage : vStages) {
+            stage(vchBuf[nCur], vchBuf[1 - nCur], nLanes);
+            nCur = 1 - nCur;
+        }
+    }
+
+    for (size_t i = 0; i < nLanes; i++)
+        memcpy(pHashes[i].begin(), vchBuf[nCur][i], pHashes[i].size());
+}
+
+/** One group of a batch, hashed by whichever queue thread picks it up */
+class CXevanGroupCheck
+{
+private:
+    const XevanInput* pInputs;
+    uint256* pHashes;
+    size_t nLanes;
+
+public:
+    CXevanGroupCheck() : pInputs(NULL), pHashes(NULL), nLanes(0) {}
+    CXevanGroupCheck(const XevanInput* pInputsIn, uint256* pHashesIn, size_t nLanesIn) : pInputs(pInputsIn), pHashes(pHashesIn), nLanes(nLanesIn) {}
+
+    bool operator()()
+    {
+        HashGroup(pInputs, pHashes, nLanes);
+        return true;
+    }
+
+    void swap(CXevanGroupCheck& check)
+    {
+        std::swap(pInputs, check.pInputs);
+        std::swap(pHashes, check.pHashes);
+        std::swap(nLanes, check.nLanes);
+    }
+};
+
+CCheckQueue<CXevanGroupCheck> xevanbatchqueue(1);
+//! Only one XEVANBatch may drive the queue at a time
+CCriticalSection cs_xevanbatchqueue;
+}
+
+void XEVANBatch(const std::vector<XevanInput>& vInputs, std::vector<uint256>& vHashes)
+{
+    vHashes.resize(vInputs.size());
+    if (vInputs.empty())
+        return;
+
+    std::vector<CXevanGroupCheck> vChecks;
+    for (size_t nStart = 0; nStart < vInputs.size(); nStart += XEVAN_BATCH_LANES)
+        vChecks.push_back(CXevanGroupCheck(&vInputs[nStart], &vHashes[nStart], std::min(XEVAN_BATCH_LANES, vInputs.size() - nStart)));
+
+    // If another batch is using the queue, hash this one in place rather than waiting for it
+    if (vChecks.size() >= MIN_GROUPS_PER_BATCH_QUEUE) {
+        TRY_LOCK(cs_xevanbatchqueue, lockQueue);
+        if (lockQueue) {
+            CCheckQueueControl<CXevanGroupCheck> control(&xevanbatchqueue);
+            control.Add(vChecks);
+            control.Wait();
+            return;
+        }
+    }
+    for (CXevanGroupCheck& check : vChecks)
+        check();
+}
+
+void ThreadXEVANBatch()
+{
+    RenameThread("beetlecoin-xevan");
+    xevanbatchqueue.Thread();
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_XEVANBATCH_H
+#define BEETLECOIN_XEVANBATCH_H
+
+#include "uint256.h"
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+/** Number of messages XEVANBatch carries through each stage of the XEVAN chain together */
+static const size_t XEVAN_BATCH_LANES = 8;
+
+/** A message to hash, as a [begin, end) byte range */
+typedef std::pair<const unsigned char*, const unsigned char*> XevanInput;
+
+/**
+ * Compute vHashes[i] = XEVAN(vInputs[i]) for many independent messages at once. The messages are split into groups
+ * of XEVAN_BATCH_LANES that run through the 34 stages of the chain stage by stage. The Keccak-512 and SHA-512 stages
+ * hash four lanes at a time with the sph_4way functions, which use AVX2 where the CPU has it; the other stages hash
+ * the lanes one after the other. When there are enough groups and no other batch is running, they are shared with
+ * the XEVAN threads (-par); otherwise the caller hashes them all itself.
+ */
+void XEVANBatch(const std::vector<XevanInput>& vInputs, std::vector<uint256>& vHashes);
+
+/** Run an instance of the XEVAN batch hashing thread */
+void ThreadXEVANBatch();
+
+#endif // BEETLECOIN_XEVANBATCH_H
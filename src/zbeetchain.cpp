@@ -8,6 +8,10 @@
 #include "txdb.h"
 #include "ui_interface.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 // 6 comes from OPCODE (1) + vch.size() (1) + BIGNUM size (4)
 #define SCRIPT_OFFSET 6
 // For Script size (BIGNUM/Uint256 size)
@@ -253,6 +257,46 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
     return IsTransactionInChain(txidSpend, nHeightTx, tx);
 }
 
+bool ReadBlocksParallel(const std::vector<CBlockIndex*>& vIndex, const std::function<bool(size_t, const CBlock&)>& func)
+{
+    // Workers claim contiguous height ranges so that each one reads its blk file mostly sequentially
+    static const size_t BLOCK_RANGE_SIZE = 16;
+
+    std::atomic<size_t> nNext(0);
+    std::atomic<bool> fFailed(false);
+    auto worker = [&]() {
+        while (!fFailed) {
+            size_t nStart = nNext.fetch_add(BLOCK_RANGE_SIZE);
+            if (nStart >= vIndex.size())
+                return;
+
+            size_t nEnd = std::min(nStart + BLOCK_RANGE_SIZE, vIndex.size());
+            for (size_t i = nStart; i < nEnd && !fFailed; i++) {
+                try {
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, vIndex[i]) || !func(i, block)) {
+                        LogPrintf("%s : failed to process block %d\n", __func__, vIndex[i]->nHeight);
+                        fFailed = true;
+                    }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : exception processing block %d: %s\n", __func__, vIndex[i]->nHeight, e.what());
+                    fFailed = true;
+                }
+            }
+        }
+    };
+
+    size_t nRanges = (vIndex.size() + BLOCK_RANGE_SIZE - 1) / BLOCK_RANGE_SIZE;
+    size_t nThreads = std::max<size_t>(1, std::min<size_t>(boost::thread::hardware_concurrency(), nRanges));
+    boost::thread_group threadGroup;
+    for (size_t i = 1; i < nThreads; i++)
+        threadGroup.create_thread(worker);
+    worker();
+    threadGroup.join_all();
+
+    return !fFailed;
+}
+
 std::string ReindexZerocoinDB()
 {
     if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints")) {
@@ -261,69 +305,67 @@ std::string ReindexZerocoinDB()
 
     uiInterface.ShowProgress(_("Reindexing zerocoin database..."), 0);
 
-    CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
-    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
-    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
-    while (pindex) {
-        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - Params().Zerocoin_StartHeight()) / (double)(chainActive.Height() - Params().Zerocoin_StartHeight()) * 100))));
+    // Blocks are read and parsed on worker threads a window at a time, then written to the zerocoinDB in chain order
+    static const int REINDEX_WINDOW_SIZE = 1000;
 
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
+    const int nStartHeight = Params().Zerocoin_StartHeight();
+    const int nEndHeight = chainActive.Height();
+    for (int nWindowStart = nStartHeight; nWindowStart <= nEndHeight; nWindowStart += REINDEX_WINDOW_SIZE) {
+        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(nWindowStart - nStartHeight) / (double)(nEndHeight - nStartHeight) * 100))));
+        LogPrintf("Reindexing zerocoin : block %d...\n", nWindowStart);
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            return _("Reindexing zerocoin failed");
-        }
+        std::vector<CBlockIndex*> vIndex;
+        for (int nHeight = nWindowStart; nHeight <= std::min(nEndHeight, nWindowStart + REINDEX_WINDOW_SIZE - 1); nHeight++)
+            vIndex.push_back(chainActive[nHeight]);
 
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
+        std::vector<std::vector<std::pair<libzerocoin::CoinSpend, uint256> > > vBlockSpends(vIndex.size());
+        std::vector<std::vector<std::pair<libzerocoin::PublicCoin, uint256> > > vBlockMints(vIndex.size());
+        bool fSuccess = ReadBlocksParallel(vIndex, [&](size_t i, const CBlock& block) {
+            for (const CTransaction& tx : block.vtx) {
+                if (tx.IsCoinBase() || !tx.ContainsZerocoins())
+                    continue;
+
+                uint256 txid = tx.GetHash();
+                //Record Serials
+                if (tx.IsZerocoinSpend()) {
+                    for (auto& in : tx.vin) {
+                        if (!in.scriptSig.IsZerocoinSpend())
+                            continue;
 
-                if (tx.ContainsZerocoins()) {
-                    uint256 txid = tx.GetHash();
-                    //Record Serials
-                    if (tx.IsZerocoinSpend()) {
-                        for (auto& in : tx.vin) {
-                            if (!in.scriptSig.IsZerocoinSpend())
-                                continue;
-
-                            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                            vSpendInfo.push_back(make_pair(spend, txid));
-                        }
+                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
+                        vBlockSpends[i].push_back(make_pair(spend, txid));
                     }
+                }
 
-                    //Record mints
-                    if (tx.IsZerocoinMint()) {
-                        for (auto& out : tx.vout) {
-                            if (!out.IsZerocoinMint())
-                                continue;
-
-                            CValidationState state;
-                            libzerocoin::PublicCoin coin(Params().Zerocoin_Params(pindex->nHeight < Params().Zerocoin_Block_V2_Start()));
-                            TxOutToPublicCoin(out, coin, state);
-                            vMintInfo.push_back(make_pair(coin, txid));
-                        }
+                //Record mints
+                if (tx.IsZerocoinMint()) {
+                    for (auto& out : tx.vout) {
+                        if (!out.IsZerocoinMint())
+                            continue;
+
+                        CValidationState state;
+                        libzerocoin::PublicCoin coin(Params().Zerocoin_Params(vIndex[i]->nHeight < Params().Zerocoin_Block_V2_Start()));
+                        TxOutToPublicCoin(out, coin, state);
+                        vBlockMints[i].push_back(make_pair(coin, txid));
                     }
                 }
             }
-        }
+            return true;
+        });
+        if (!fSuccess)
+            return _("Reindexing zerocoin failed");
 
-        // Flush the zerocoinDB to disk every 100 blocks
-        if (pindex->nHeight % 100 == 0) {
-            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
-                return _("Error writing zerocoinDB to disk");
-            vSpendInfo.clear();
-            vMintInfo.clear();
+        std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
+        std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            vSpendInfo.insert(vSpendInfo.end(), vBlockSpends[i].begin(), vBlockSpends[i].end());
+            vMintInfo.insert(vMintInfo.end(), vBlockMints[i].begin(), vBlockMints[i].end());
         }
 
-        pindex = chainActive.Next(pindex);
+        // Flush the zerocoinDB to disk once per window
+        if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
+            return _("Error writing zerocoinDB to disk");
     }
-    uiInterface.ShowProgress("", 100);
-
-    // Final flush to disk in case any remaining information exists
-    if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
-        return _("Error writing zerocoinDB to disk");
 
     uiInterface.ShowProgress("", 100);
 
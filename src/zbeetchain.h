@@ -8,10 +8,13 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/CoinSpend.h"
+#include <functional>
 #include <list>
 #include <string>
+#include <vector>
 
 class CBlock;
+class CBlockIndex;
 class CBigNum;
 struct CMintMeta;
 class CTransaction;
@@ -32,6 +35,9 @@ bool IsSerialKnown(const CBigNum& bnSerial);
 bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx);
 bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& txidSpend);
 bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& txidSpend, CTransaction& tx);
+/** Read the blocks in vIndex on worker threads and call func(i, block) for each of them, in no particular order.
+ *  func may only touch state owned by index i. Returns false if a block could not be read or func failed. */
+bool ReadBlocksParallel(const std::vector<CBlockIndex*>& vIndex, const std::function<bool(size_t, const CBlock&)>& func);
 bool RemoveSerialFromDB(const CBigNum& bnSerial);
 std::string ReindexZerocoinDB();
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
@@ -0,0 +1,147 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zbeetspendcache.h"
+
+#include "hash.h"
+#include "libzerocoin/CoinSpend.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+#include "version.h"
+
+#include <atomic>
+#include <set>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Valid zerocoin spend cache, to avoid verifying the spend proofs twice for
+ * every zerocoin spend (once when accepted into memory pool, and again when
+ * accepted into the block chain)
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! Random salt so that cache keys cannot be predicted by peers
+    uint256 nSalt;
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_spendcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CZerocoinSpendCache() : nHits(0), nMisses(0)
+    {
+        nSalt = GetRandHash();
+    }
+
+    uint256 ComputeEntry(const libzerocoin::CoinSpend& spend, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue)
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << nSalt << spend << params->accumulatorParams.accumulatorModulus << bnAccumulatorValue;
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.count(entry);
+    }
+
+    void Set(const uint256& entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxzerocoinspendcachesize", DEFAULT_MAX_ZEROCOIN_SPEND_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize) {
+            // Evict a random entry, see CSignatureCache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(entry);
+    }
+
+    uint64_t Size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.size();
+    }
+};
+
+CZerocoinSpendCache& GetSpendCache()
+{
+    static CZerocoinSpendCache spendCache;
+    return spendCache;
+}
+
+}
+
+bool VerifyZerocoinSpendCached(const libzerocoin::CoinSpend& spend, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue, bool fStore)
+{
+    CZerocoinSpendCache& spendCache = GetSpendCache();
+    uint256 entry = spendCache.ComputeEntry(spend, params, bnAccumulatorValue);
+    if (spendCache.Get(entry)) {
+        spendCache.nHits++;
+        return true;
+    }
+    spendCache.nMisses++;
+
+    libzerocoin::Accumulator accumulator(params, spend.getDenomination(), bnAccumulatorValue);
+    if (!spend.Verify(accumulator))
+        return false;
+
+    if (fStore)
+        spendCache.Set(entry);
+    return true;
+}
+
+bool VerifyZerocoinSpendsCached(const std::vector<const libzerocoin::CoinSpend*>& vSpends, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue, bool fStore)
+{
+    if (vSpends.empty())
+        return true;
+
+    CZerocoinSpendCache& spendCache = GetSpendCache();
+    std::vector<const libzerocoin::CoinSpend*> vUnverified;
+    std::vector<uint256> vEntries;
+    for (const libzerocoin::CoinSpend* spend : vSpends) {
+        uint256 entry = spendCache.ComputeEntry(*spend, params, bnAccumulatorValue);
+        if (spendCache.Get(entry)) {
+            spendCache.nHits++;
+            continue;
+        }
+        spendCache.nMisses++;
+        vUnverified.push_back(spend);
+        vEntries.push_back(entry);
+    }
+
+    if (vUnverified.empty())
+        return true;
+
+    libzerocoin::Accumulator accumulator(params, vUnverified.front()->getDenomination(), bnAccumulatorValue);
+    if (!libzerocoin::BatchVerify(accumulator, vUnverified))
+        return false;
+
+    if (fStore) {
+        for (const uint256& entry : vEntries)
+            spendCache.Set(entry);
+    }
+    return true;
+}
+
+void GetZerocoinSpendCacheStats(uint64_t& nEntries, uint64_t& nHits, uint64_t& nMisses)
+{
+    CZerocoinSpendCache& spendCache = GetSpendCache();
+    nEntries = spendCache.Size();
+    nHits = spendCache.nHits;
+    nMisses = spendCache.nMisses;
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2019 The BeetleCoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BEETLECOIN_ZBEETSPENDCACHE_H
+#define BEETLECOIN_ZBEETSPENDCACHE_H
+
+#include <stdint.h>
+#include <vector>
+
+class CBigNum;
+
+namespace libzerocoin
+{
+class CoinSpend;
+class ZerocoinParams;
+}
+
+/** Default for -maxzerocoinspendcachesize, maximum number of verified zerocoin spends remembered */
+static const int64_t DEFAULT_MAX_ZEROCOIN_SPEND_CACHE_SIZE = 10000;
+
+/**
+ * Verify a zerocoin spend against the accumulator with the given value, skipping the proof
+ * if the same spend already verified against that accumulator. Successful results are only
+ * remembered when fStore is set, so that block connection does not evict spends seen at relay time.
+ */
+bool VerifyZerocoinSpendCached(const libzerocoin::CoinSpend& spend, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue, bool fStore);
+
+/**
+ * Verify spends of one denomination that reference the same accumulator as a batch,
+ * skipping those already in the cache. See VerifyZerocoinSpendCached.
+ */
+bool VerifyZerocoinSpendsCached(const std::vector<const libzerocoin::CoinSpend*>& vSpends, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue, bool fStore);
+
+/** Statistics of the verified zerocoin spend cache */
+void GetZerocoinSpendCacheStats(uint64_t& nEntries, uint64_t& nHits, uint64_t& nMisses);
+
+#endif // BEETLECOIN_ZBEETSPENDCACHE_H
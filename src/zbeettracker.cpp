@@ -54,6 +54,7 @@ bool CzBEETTracker::Archive(CMintMeta& meta)
         if (!walletdb.ArchiveDeterministicOrphan(dMint))
             return error("%s: failed to archive deterministic ophaned mint", __func__);
     }
+    walletdb.EraseMintWitnessState(meta.hashPubcoin);
 
     LogPrintf("%s: archived pubcoinhash %s\n", __func__, meta.hashPubcoin.GetHex());
     return true;
@@ -372,6 +373,8 @@ bool CzBEETTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
         if (!setMempool.count(txidPendingSpend) || isConfirmedSpend) {
             RemovePending(txidPendingSpend);
             isPendingSpend = false;
+            if (isConfirmedSpend)
+                CWalletDB(strWalletFile).EraseMintWitnessState(mint.hashPubcoin);
             LogPrintf("%s : Pending txid %s removed because not in mempool\n", __func__, txidPendingSpend.GetHex());
         }
     }
@@ -419,6 +422,9 @@ bool CzBEETTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
 
         // Check that the mint has correct used status
         if (mint.isUsed != isUsed) {
+            // The witness of a spent mint is never needed again
+            if (isConfirmedSpend)
+                CWalletDB(strWalletFile).EraseMintWitnessState(mint.hashPubcoin);
             LogPrintf("%s : Set mint %s isUsed to %d\n", __func__, mint.hashPubcoin.GetHex(), isUsed);
             mint.isUsed = isUsed;
             return true;